@@ -0,0 +1,19 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Arena.hpp"
+
+#include <algorithm>
+
+namespace cpplox {
+
+void* Arena::grow_(size_t size, size_t align) {
+    // Anything too big for a regular chunk gets a chunk of its own.
+    auto chunk_size = std::max(chunk_size_, size + align);
+    chunks_.push_back(std::make_unique_for_overwrite<std::byte[]>(chunk_size));
+    bytes_reserved_ += chunk_size;
+
+    next_ = chunks_.back().get();
+    end_ = next_ + chunk_size;
+    return allocate(size, align);
+}
+
+} // namespace cpplox
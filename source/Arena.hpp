@@ -0,0 +1,88 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cpplox {
+
+/// A bump allocator.  Memory is carved out of large chunks and only ever given back all at once, when the arena
+/// goes away.  Nothing allocated here is destroyed, so only trivially destructible types may live in it.
+class Arena {
+private:
+    static constexpr size_t chunk_size_ = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks_;
+    std::byte* next_ = nullptr;
+    std::byte* end_ = nullptr;
+    size_t bytes_used_ = 0;
+    size_t bytes_reserved_ = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// Returns size bytes aligned to align, which must be a power of two.
+    void* allocate(size_t size, size_t align) {
+        auto address = reinterpret_cast<uintptr_t>(next_);
+        auto padding = (align - (address & (align - 1))) & (align - 1);
+        if (next_ == nullptr || size + padding > static_cast<size_t>(end_ - next_)) {
+            return grow_(size, align);
+        }
+
+        auto result = next_ + padding;
+        next_ = result + size;
+        bytes_used_ += size + padding;
+        return result;
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "The arena never runs destructors.");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// Copies items into the arena, an empty list takes no memory.
+    template<typename T>
+    std::span<T> copy(const std::vector<T>& items) {
+        static_assert(std::is_trivially_copyable_v<T>, "Lists are copied into the arena byte by byte.");
+        if (items.empty()) {
+            return {};
+        }
+
+        auto data = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), data);
+        return std::span<T>(data, items.size());
+    }
+
+    /// Frees every chunk at once, anything allocated from the arena is gone.
+    void release() {
+        chunks_.clear();
+        next_ = nullptr;
+        end_ = nullptr;
+        bytes_used_ = 0;
+        bytes_reserved_ = 0;
+    }
+
+    /// Bytes handed out so far, including alignment padding.
+    size_t bytes_used() const {
+        return bytes_used_;
+    }
+
+    /// Bytes taken from the system for the chunks.
+    size_t bytes_reserved() const {
+        return bytes_reserved_;
+    }
+
+private:
+    void* grow_(size_t size, size_t align);
+};
+
+} // namespace cpplox
@@ -4,48 +4,196 @@
 #include <sstream>
 
 namespace cpplox {
-std::string AstPrinter::print(Expr& expr) {
-    expr.accept(*this);
-    
+std::string AstPrinter::print(const FlatAst& ast, NodeIndex node) {
+    ast_ = &ast;
+    print_(node);
+
     return stream_.str();
 }
 
-void AstPrinter::visit(const AssignExpr& expr) {
-    
-}
+std::string AstPrinter::print(const FlatAst& ast) {
+    ast_ = &ast;
+    print_statements_(ast.first_statement, ast.statement_count, 0);
 
-void AstPrinter::visit(const BinaryExpr& expr) {
-    parenthesize_(expr.operation.lexeme, {*(expr.left.get()), *(expr.right.get())});
+    return stream_.str();
 }
 
-void AstPrinter::visit(const LiteralExpr& expr) {
-    if (expr.value.index() == 0) {
-        stream_ << "nil";
+void AstPrinter::print_(NodeIndex node) {
+    const auto& ast = *ast_;
+    if (is_binary(ast.kinds[node]) || ast.kinds[node] == NodeKind::Logical) {
+        parenthesize_(ast.name(node), {ast.a[node], ast.b[node]});
+        return;
     }
-    
-    if (expr.value.index() == 1) {
-        stream_ << std::get<std::string>(expr.value);
-    } else {
-        stream_ << std::to_string(std::get<double>(expr.value));
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Literal: {
+            const auto& literal = ast.literals[ast.a[node]];
+            if (literal.index() == 1) {
+                stream_ << "\"" << std::get<std::string_view>(literal) << "\"";
+            } else if (literal.index() == 2) {
+                stream_ << std::to_string(std::get<double>(literal));
+            } else if (literal.index() == 3) {
+                stream_ << (std::get<bool>(literal) ? "true" : "false");
+            } else {
+                stream_ << "nil";
+            }
+            break;
+        }
+
+        case NodeKind::Grouping:
+            parenthesize_("group", {ast.a[node]});
+            break;
+
+        case NodeKind::Unary:
+            parenthesize_(ast.name(node), {ast.a[node]});
+            break;
+
+        case NodeKind::Variable:
+        case NodeKind::This:
+            stream_ << ast.name(node);
+            break;
+
+        case NodeKind::Assign:
+            stream_ << "(= " << ast.name(node) << " ";
+            print_(ast.a[node]);
+            stream_ << ")";
+            break;
+
+        case NodeKind::Call:
+            stream_ << "(call ";
+            print_(ast.a[node]);
+            for(auto arg: ast.list(ast.b[node], ast.c[node])) {
+                stream_ << " ";
+                print_(arg);
+            }
+            stream_ << ")";
+            break;
+
+        case NodeKind::Get:
+            stream_ << "(get ";
+            print_(ast.a[node]);
+            stream_ << " " << ast.name(node) << ")";
+            break;
+
+        case NodeKind::Set:
+            stream_ << "(set ";
+            print_(ast.a[node]);
+            stream_ << " " << ast.name(node) << " ";
+            print_(ast.b[node]);
+            stream_ << ")";
+            break;
+
+        case NodeKind::Super:
+            stream_ << "(super " << ast.name(node) << ")";
+            break;
+
+        default:
+            break;
     }
 }
 
-void AstPrinter::visit(const GroupingExpr& expr) {
-    parenthesize_("group", {*(expr.expression.get())});
+void AstPrinter::print_statement_(NodeIndex node, int depth) {
+    const auto& ast = *ast_;
+    stream_ << std::string(depth * 2, ' ');
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Print:
+            parenthesize_("print", {ast.a[node]});
+            break;
+
+        case NodeKind::Expression:
+            parenthesize_("expr", {ast.a[node]});
+            break;
+
+        case NodeKind::VariableDecl:
+            stream_ << "(var " << ast.name(node);
+            if (ast.a[node] != no_node) {
+                stream_ << " ";
+                print_(ast.a[node]);
+            }
+            stream_ << ")";
+            break;
+
+        case NodeKind::Block:
+            stream_ << "(block\n";
+            print_statements_(ast.a[node], ast.b[node], depth + 1);
+            stream_ << std::string(depth * 2, ' ') << ")";
+            break;
+
+        case NodeKind::If:
+            stream_ << "(if ";
+            print_(ast.a[node]);
+            stream_ << "\n";
+            print_statement_(ast.b[node], depth + 1);
+            if (ast.c[node] != no_node) {
+                print_statement_(ast.c[node], depth + 1);
+            }
+            stream_ << std::string(depth * 2, ' ') << ")";
+            break;
+
+        case NodeKind::While:
+            stream_ << "(while ";
+            print_(ast.a[node]);
+            stream_ << "\n";
+            print_statement_(ast.b[node], depth + 1);
+            stream_ << std::string(depth * 2, ' ') << ")";
+            break;
+
+        case NodeKind::FunctionDecl: {
+            stream_ << "(fun " << ast.name(node) << " (";
+            const char* separator = "";
+            for(auto param: ast.list(ast.a[node], ast.b[node])) {
+                stream_ << separator << ast.name_table[param];
+                separator = " ";
+            }
+            stream_ << ")\n";
+            auto body = ast.c[node];
+            print_statements_(ast.a[body], ast.b[body], depth + 1);
+            stream_ << std::string(depth * 2, ' ') << ")";
+            break;
+        }
+
+        case NodeKind::Return:
+            stream_ << "(return";
+            if (ast.a[node] != no_node) {
+                stream_ << " ";
+                print_(ast.a[node]);
+            }
+            stream_ << ")";
+            break;
+
+        case NodeKind::ClassDecl:
+            stream_ << "(class " << ast.name(node);
+            if (ast.a[node] != no_node) {
+                stream_ << " < " << ast.name(ast.a[node]);
+            }
+            stream_ << "\n";
+            print_statements_(ast.b[node], ast.c[node], depth + 1);
+            stream_ << std::string(depth * 2, ' ') << ")";
+            break;
+
+        default:
+            print_(node);
+            break;
+    }
+
+    stream_ << "\n";
 }
 
-void AstPrinter::visit(const UnaryExpr& expr) {
-    parenthesize_(expr.operation.lexeme, {*(expr.right.get())});
+void AstPrinter::print_statements_(uint32_t first, uint32_t count, int depth) {
+    for(auto stmt: ast_->list(first, count)) {
+        print_statement_(stmt, depth);
+    }
 }
 
-void AstPrinter::parenthesize_(const std::string& name, const std::vector<std::reference_wrapper<Expr>>& exprs) {
+void AstPrinter::parenthesize_(std::string_view name, std::initializer_list<NodeIndex> nodes) {
     stream_ << "(" << name;
-    
-    for(Expr& curr: exprs) {
+
+    for(auto curr: nodes) {
         stream_ << " ";
-        curr.accept(*this);
+        print_(curr);
     }
-    
+
     stream_ << ")";
 }
 
@@ -1,27 +1,31 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
-#include "Expr.hpp"
+#include "FlatAst.hpp"
 
-#include <functional>
+#include <initializer_list>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 
 namespace cpplox {
 
 /// Helper class that prints out the AST.
-struct AstPrinter: public ExprVisitor {
+struct AstPrinter {
 public:
-    std::string print(Expr& expr);
-    virtual void visit(const AssignExpr& expr);
-    virtual void visit(const BinaryExpr& expr);
-    virtual void visit(const LiteralExpr& expr);
-    virtual void visit(const GroupingExpr& expr);
-    virtual void visit(const UnaryExpr& expr);
-    
+    /// Prints one expression on a single line.
+    std::string print(const FlatAst& ast, NodeIndex node);
+
+    /// Prints every statement of the program, one per line and nested statements indented under their parent.
+    std::string print(const FlatAst& ast);
+
 private:
-    void parenthesize_(const std::string& name, const std::vector<std::reference_wrapper<Expr>>& exprs);
+    void print_(NodeIndex node);
+    void print_statement_(NodeIndex node, int depth);
+    void print_statements_(uint32_t first, uint32_t count, int depth);
+    void parenthesize_(std::string_view name, std::initializer_list<NodeIndex> nodes);
+    const FlatAst* ast_ = nullptr;
     std::stringstream stream_;
 };
 } // namespace cpplox
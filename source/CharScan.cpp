@@ -0,0 +1,279 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "CharScan.hpp"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CPPLOX_SIMD_SCAN 1
+#include <immintrin.h>
+#define CPPLOX_AVX2 __attribute__((target("avx2,popcnt")))
+#else
+#define CPPLOX_SIMD_SCAN 0
+#endif
+
+namespace cpplox {
+
+/// One version of the searches.
+struct CharScanFunctions {
+    const char* (*skip_whitespace)(const char* begin, const char* end, int& lines);
+    const char* (*skip_identifier)(const char* begin, const char* end);
+    const char* (*find)(const char* begin, const char* end, char a, char b, int& lines);
+    std::string_view isa;
+};
+
+// ---
+
+//
+// The plain loops, which the vector versions also finish the buffer with.
+//
+
+static bool is_whitespace_(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_identifier_(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static const char* scalar_skip_whitespace_(const char* begin, const char* end, int& lines) {
+    for(; begin != end && is_whitespace_(*begin); ++begin) {
+        lines += *begin == '\n';
+    }
+    return begin;
+}
+
+static const char* scalar_skip_identifier_(const char* begin, const char* end) {
+    while (begin != end && is_identifier_(*begin)) {
+        ++begin;
+    }
+    return begin;
+}
+
+static const char* scalar_find_(const char* begin, const char* end, char a, char b, int& lines) {
+    for(; begin != end && *begin != a && *begin != b; ++begin) {
+        lines += *begin == '\n';
+    }
+    return begin;
+}
+
+static constexpr CharScanFunctions scalar_functions_{
+    scalar_skip_whitespace_, scalar_skip_identifier_, scalar_find_, "scalar"
+};
+
+#if CPPLOX_SIMD_SCAN
+
+//
+// Each block of characters is turned into a bit mask, one bit per character, and the first set bit is the
+// character looked for.  Counting the newline bits in front of it keeps track of the lines.
+//
+
+/// The newlines among the first count bits of newlines.
+static int newlines_before_(uint32_t newlines, int count) {
+    return std::popcount(newlines & ((uint64_t{1} << count) - 1));
+}
+
+// ---
+
+//
+// SSE2, which every x86-64 CPU has.
+//
+
+static uint32_t sse2_mask_(__m128i matches) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+}
+
+static uint32_t sse2_whitespace_(__m128i chars) {
+    auto spaces = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+    auto breaks = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+    return sse2_mask_(_mm_or_si128(spaces, breaks));
+}
+
+/// Setting bit 5 lower-cases a letter and moves no other character into a-z.  The comparisons are signed, so
+/// characters past 0x7f compare below everything and never match.
+static uint32_t sse2_identifier_(__m128i chars) {
+    auto lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    auto letters = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                 _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    auto digits = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), chars));
+    auto underscores = _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'));
+    return sse2_mask_(_mm_or_si128(_mm_or_si128(letters, digits), underscores));
+}
+
+static const char* sse2_skip_whitespace_(const char* begin, const char* end, int& lines) {
+    for(; end - begin >= 16; begin += 16) {
+        auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        auto newlines = sse2_mask_(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+        auto others = ~sse2_whitespace_(chars) & 0xffff;
+        if (others != 0) {
+            auto index = std::countr_zero(others);
+            lines += newlines_before_(newlines, index);
+            return begin + index;
+        }
+        lines += std::popcount(newlines);
+    }
+    return scalar_skip_whitespace_(begin, end, lines);
+}
+
+static const char* sse2_skip_identifier_(const char* begin, const char* end) {
+    for(; end - begin >= 16; begin += 16) {
+        auto others = ~sse2_identifier_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin))) & 0xffff;
+        if (others != 0) {
+            return begin + std::countr_zero(others);
+        }
+    }
+    return scalar_skip_identifier_(begin, end);
+}
+
+static const char* sse2_find_(const char* begin, const char* end, char a, char b, int& lines) {
+    auto as = _mm_set1_epi8(a);
+    auto bs = _mm_set1_epi8(b);
+    for(; end - begin >= 16; begin += 16) {
+        auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        auto newlines = sse2_mask_(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+        auto found = sse2_mask_(_mm_or_si128(_mm_cmpeq_epi8(chars, as), _mm_cmpeq_epi8(chars, bs)));
+        if (found != 0) {
+            auto index = std::countr_zero(found);
+            lines += newlines_before_(newlines, index);
+            return begin + index;
+        }
+        lines += std::popcount(newlines);
+    }
+    return scalar_find_(begin, end, a, b, lines);
+}
+
+static constexpr CharScanFunctions sse2_functions_{
+    sse2_skip_whitespace_, sse2_skip_identifier_, sse2_find_, "sse2"
+};
+
+// ---
+
+//
+// AVX2, the same thirty-two characters at a time.  Only called once the CPU is known to have it.
+//
+
+CPPLOX_AVX2 static uint32_t avx2_mask_(__m256i matches) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+}
+
+CPPLOX_AVX2 static uint32_t avx2_whitespace_(__m256i chars) {
+    auto spaces = _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+                                  _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t')));
+    auto breaks = _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r')),
+                                  _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')));
+    return avx2_mask_(_mm256_or_si256(spaces, breaks));
+}
+
+CPPLOX_AVX2 static uint32_t avx2_identifier_(__m256i chars) {
+    auto lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    auto letters = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    auto digits = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    auto underscores = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_'));
+    return avx2_mask_(_mm256_or_si256(_mm256_or_si256(letters, digits), underscores));
+}
+
+CPPLOX_AVX2 static const char* avx2_skip_whitespace_(const char* begin, const char* end, int& lines) {
+    for(; end - begin >= 32; begin += 32) {
+        auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        auto newlines = avx2_mask_(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')));
+        auto others = ~avx2_whitespace_(chars);
+        if (others != 0) {
+            auto index = std::countr_zero(others);
+            lines += newlines_before_(newlines, index);
+            return begin + index;
+        }
+        lines += std::popcount(newlines);
+    }
+    return sse2_skip_whitespace_(begin, end, lines);
+}
+
+CPPLOX_AVX2 static const char* avx2_skip_identifier_(const char* begin, const char* end) {
+    for(; end - begin >= 32; begin += 32) {
+        auto others = ~avx2_identifier_(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin)));
+        if (others != 0) {
+            return begin + std::countr_zero(others);
+        }
+    }
+    return sse2_skip_identifier_(begin, end);
+}
+
+CPPLOX_AVX2 static const char* avx2_find_(const char* begin, const char* end, char a, char b, int& lines) {
+    auto as = _mm256_set1_epi8(a);
+    auto bs = _mm256_set1_epi8(b);
+    for(; end - begin >= 32; begin += 32) {
+        auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        auto newlines = avx2_mask_(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')));
+        auto found = avx2_mask_(_mm256_or_si256(_mm256_cmpeq_epi8(chars, as), _mm256_cmpeq_epi8(chars, bs)));
+        if (found != 0) {
+            auto index = std::countr_zero(found);
+            lines += newlines_before_(newlines, index);
+            return begin + index;
+        }
+        lines += std::popcount(newlines);
+    }
+    return sse2_find_(begin, end, a, b, lines);
+}
+
+static constexpr CharScanFunctions avx2_functions_{
+    avx2_skip_whitespace_, avx2_skip_identifier_, avx2_find_, "avx2"
+};
+
+#endif
+
+// ---
+
+/// The named version, or nullptr when this CPU can not run it.
+static const CharScanFunctions* supported_(std::string_view isa) {
+#if CPPLOX_SIMD_SCAN
+    if (isa == avx2_functions_.isa) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ? &avx2_functions_ : nullptr;
+    }
+    if (isa == sse2_functions_.isa) {
+        return &sse2_functions_;
+    }
+#endif
+    return isa == scalar_functions_.isa ? &scalar_functions_ : nullptr;
+}
+
+static const CharScanFunctions* fastest_() {
+    for(auto isa: {"avx2", "sse2"}) {
+        if (auto functions = supported_(isa)) {
+            return functions;
+        }
+    }
+    return &scalar_functions_;
+}
+
+static const CharScanFunctions* functions_ = fastest_();
+
+// ---
+
+const char* CharScan::skip_whitespace(const char* begin, const char* end, int& lines) {
+    return functions_->skip_whitespace(begin, end, lines);
+}
+
+const char* CharScan::skip_identifier(const char* begin, const char* end) {
+    return functions_->skip_identifier(begin, end);
+}
+
+const char* CharScan::find(const char* begin, const char* end, char a, char b, int& lines) {
+    return functions_->find(begin, end, a, b, lines);
+}
+
+std::string_view CharScan::isa() {
+    return functions_->isa;
+}
+
+bool CharScan::use(std::string_view isa) {
+    auto functions = supported_(isa);
+    if (functions == nullptr) {
+        return false;
+    }
+    functions_ = functions;
+    return true;
+}
+
+} // namespace cpplox
@@ -0,0 +1,32 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <string_view>
+
+namespace cpplox {
+
+/// The searches the Scanner spends most of its time in, done sixteen or thirty-two characters at a time.
+///
+/// Each search comes as AVX2, SSE2 and a plain loop.  The fastest one the CPU supports is picked once, at startup,
+/// and the plain loops are all there is off x86-64.  Every version reads only between begin and end, whatever is
+/// left over at the end of the buffer is done a character at a time.
+class CharScan {
+public:
+    /// The first character from begin on that is not a space, tab, carriage return or newline, or end.  Adds the
+    /// newlines passed over to lines.
+    static const char* skip_whitespace(const char* begin, const char* end, int& lines);
+
+    /// The first character from begin on that can not be part of an identifier, or end.
+    static const char* skip_identifier(const char* begin, const char* end);
+
+    /// The first a or b from begin on, or end.  Adds the newlines passed over to lines.
+    static const char* find(const char* begin, const char* end, char a, char b, int& lines);
+
+    /// Which version the searches run, "avx2", "sse2" or "scalar".
+    static std::string_view isa();
+
+    /// Runs the named version from now on, if the CPU supports it.  Returns false, and changes nothing, if not.
+    static bool use(std::string_view isa);
+};
+
+} // namespace cpplox
@@ -0,0 +1,78 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Value.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace cpplox {
+
+/// The instructions understood by the VM.  Operands follow the opcode in the byte stream, most significant byte
+/// first.  Slots, upvalues and constants are indexed with two bytes, jumps are four bytes and arg counts one.
+enum class OpCode: uint8_t {
+    CONSTANT,       // [constant index]
+    NIL,
+    TRUE,
+    FALSE,
+    POP,
+    GET_LOCAL,      // [slot]
+    SET_LOCAL,      // [slot]
+    GET_GLOBAL,     // [name constant]
+    DEFINE_GLOBAL,  // [name constant]
+    SET_GLOBAL,     // [name constant]
+    GET_UPVALUE,    // [upvalue index]
+    SET_UPVALUE,    // [upvalue index]
+    GET_PROPERTY,   // [name constant]
+    SET_PROPERTY,   // [name constant]
+    GET_SUPER,      // [name constant]
+    NO_SUPER,
+    EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    NOT,
+    NEGATE,
+    PRINT,
+    JUMP,           // [offset hi][offset lo]
+    JUMP_IF_FALSE,  // [offset hi][offset lo]
+    LOOP,           // [offset hi][offset lo]
+    CALL,           // [arg count]
+    TAIL_CALL,      // [arg count]
+    INVOKE,         // [name constant][arg count]
+    SUPER_INVOKE,   // [name constant][arg count]
+    CLOSURE,        // [function constant] then [is local][index] per upvalue
+    CLOSE_UPVALUE,
+    RETURN,
+    CLASS,          // [name constant]
+    INHERIT,
+    METHOD          // [name constant]
+};
+
+/// A compiled sequence of bytecode along with its constant pool.
+struct Chunk {
+    std::vector<uint8_t>    code;
+    std::vector<int>        lines;
+    std::vector<Value>      constants;
+
+    void write(uint8_t byte, int line) {
+        code.push_back(byte);
+        lines.push_back(line);
+    }
+
+    void write(OpCode op, int line) {
+        write(static_cast<uint8_t>(op), line);
+    }
+
+    int add_constant(const Value& value) {
+        constants.push_back(value);
+        return static_cast<int>(constants.size()) - 1;
+    }
+};
+
+} // namespace cpplox
@@ -0,0 +1,718 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "ClosureCompiler.hpp"
+
+#include "Environment.hpp"
+#include "Interpreter.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxInstance.hpp"
+#include "RuntimeError.hpp"
+#include "TokenType.hpp"
+
+#include <algorithm>
+#include <format>
+#include <map>
+#include <memory>
+#include <print>
+
+namespace cpplox {
+
+void ClosureCompiler::run(FlatAst& ast) {
+    ast_ = &ast;
+    auto program = statements_(ast.first_statement, ast.statement_count);
+    execute_all_(program);
+}
+
+std::vector<CompiledStmt> ClosureCompiler::statements_(uint32_t first, uint32_t count) {
+    std::vector<CompiledStmt> stmts;
+    stmts.reserve(count);
+    for(auto stmt: ast_->list(first, count)) {
+        stmts.push_back(statement_(stmt));
+    }
+    return stmts;
+}
+
+CompiledStmt ClosureCompiler::statement_(NodeIndex node) {
+    auto& ast = *ast_;
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Print:
+            return [value = expression_(ast.a[node])]() {
+                std::print("{}\n", stringify(value()));
+                return false;
+            };
+
+        case NodeKind::Expression:
+            return [value = expression_(ast.a[node])]() {
+                value();
+                return false;
+            };
+
+        case NodeKind::VariableDecl: {
+            auto name = ast.name(node);
+            if (ast.a[node] == no_node) {
+                return [this, name]() {
+                    interpreter_.define_variable_(name, Value::nil());
+                    return false;
+                };
+            }
+            return [this, name, initializer = expression_(ast.a[node])]() {
+                interpreter_.define_variable_(name, initializer());
+                return false;
+            };
+        }
+
+        case NodeKind::Block:
+            if (!ast.has_environment(node)) {
+                return [this, stmts = statements_(ast.a[node], ast.b[node])]() {
+                    auto defined = interpreter_.curr_env_ != nullptr ? interpreter_.curr_env_->defined() : 0;
+                    bool returned = execute_all_(stmts);
+                    interpreter_.end_block_(defined);
+                    return returned;
+                };
+            }
+            return [this, stmts = statements_(ast.a[node], ast.b[node]), slot_count = static_cast<int>(ast.c[node])]() {
+                auto env = Environment::create(slot_count);
+                Interpreter::ReleaseGuard release{interpreter_, env};
+                Interpreter::EnvGuard guard{interpreter_.curr_env_, interpreter_.saved_envs_, env};
+                return execute_all_(stmts);
+            };
+
+        case NodeKind::If: {
+            auto condition = expression_(ast.a[node]);
+            auto then_branch = statement_(ast.b[node]);
+            if (ast.c[node] == no_node) {
+                return [this, condition, then_branch]() {
+                    return !condition().is_falsey() && execute_(then_branch);
+                };
+            }
+            return [this, condition, then_branch, else_branch = statement_(ast.c[node])]() {
+                return execute_(!condition().is_falsey() ? then_branch : else_branch);
+            };
+        }
+
+        case NodeKind::While:
+            return [this, condition = expression_(ast.a[node]), body = statement_(ast.b[node])]() {
+                while (!condition().is_falsey()) {
+                    if (execute_(body)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+        case NodeKind::FunctionDecl:
+            return function_decl_(node);
+
+        case NodeKind::Return:
+            if (ast.a[node] == no_node) {
+                return [this]() {
+                    interpreter_.value = Value::nil();
+                    return true;
+                };
+            }
+            // The value waits in the Interpreter's value, where the collector sees it, until the call picks it up.
+            if (ast.b[node] != no_node) {
+                return [this, value = call_expr_(ast.b[node], true)]() {
+                    interpreter_.value = value();
+                    return true;
+                };
+            }
+            return [this, value = expression_(ast.a[node])]() {
+                interpreter_.value = value();
+                return true;
+            };
+
+        case NodeKind::ClassDecl:
+            return class_decl_(node);
+
+        default:
+            throw RuntimeError(std::format("Can not compile the statement at line {}.", ast.line(node)));
+    }
+}
+
+CompiledStmt ClosureCompiler::function_decl_(NodeIndex node) {
+    auto code = function_body_(node);
+    return [this, ast = ast_, node, code]() {
+        auto& interpreter = interpreter_;
+        auto function = interpreter.make_function_(ast, node);
+        function->closure_code = code;
+        interpreter.define_variable_(ast->name(node), Value::object(function));
+        return false;
+    };
+}
+
+CompiledStmt ClosureCompiler::class_decl_(NodeIndex node) {
+    auto& ast = *ast_;
+
+    struct Method {
+        NodeIndex declaration;
+        int id;
+        ClosureCode* code;
+    };
+
+    std::vector<Method> methods;
+    for(auto curr: ast.list(ast.b[node], ast.c[node])) {
+        methods.push_back(Method{curr, interpreter_.method_ids_.intern(ast.name(curr)), function_body_(curr)});
+    }
+
+    CompiledExpr super_class_expr;
+    if (ast.a[node] != no_node) {
+        super_class_expr = expression_(ast.a[node]);
+    }
+
+    return [this, ast = ast_, name = ast.name(node), methods, super_class_expr]() {
+        auto& interpreter = interpreter_;
+
+        LoxClass* super_class = nullptr;
+        if (super_class_expr) {
+            Value evaluated = super_class_expr();
+            if (!is_obj_type(evaluated, ObjType::LoxClass)) {
+                throw RuntimeError("The superclass is not a class.");
+            }
+            super_class = as_obj<LoxClass>(evaluated);
+        }
+
+        std::map<int, LoxFunction*> table;
+        for(const auto& curr: methods) {
+            auto method = interpreter.make_function_(ast, curr.declaration);
+            method->is_method = true;
+            method->is_initializer = curr.id == MethodIds::init_id;
+            method->super_class = super_class;
+            method->closure_code = curr.code;
+            table[curr.id] = method;
+        }
+
+        interpreter.root_shapes_.push_back(std::make_unique<Shape>());
+        auto lox_class = LoxClass::create(interpreter.heap_, std::string(name), table, super_class,
+                                          interpreter.root_shapes_.back().get());
+        interpreter.define_variable_(name, Value::object(lox_class));
+        return false;
+    };
+}
+
+ClosureCode* ClosureCompiler::function_body_(NodeIndex node) {
+    auto body = ast_->c[node];
+    auto& code = codes_.emplace_back();
+    code.slot_count = ast_->c[body];
+    code.body = statements_(ast_->a[body], ast_->b[body]);
+    return &code;
+}
+
+CompiledExpr ClosureCompiler::expression_(NodeIndex node) {
+    auto& ast = *ast_;
+    auto kind = ast.kinds[node];
+    if (is_binary(kind)) {
+        return binary_(node);
+    }
+
+    switch (kind) {
+        case NodeKind::Literal:
+            return literal_(node);
+
+        case NodeKind::Grouping:
+            return expression_(ast.a[node]);
+
+        case NodeKind::Unary:
+            return unary_(node);
+
+        case NodeKind::Variable:
+        case NodeKind::This:
+            return variable_(node);
+
+        case NodeKind::Assign:
+            return assign_(node);
+
+        case NodeKind::Logical:
+            return logical_(node);
+
+        case NodeKind::Call:
+            return call_expr_(node);
+
+        case NodeKind::Get:
+            return get_(node);
+
+        case NodeKind::Set:
+            return set_(node);
+
+        case NodeKind::Super:
+            return super_(node);
+
+        default:
+            throw RuntimeError(std::format("Can not compile the expression at line {}.", ast.line(node)));
+    }
+}
+
+CompiledExpr ClosureCompiler::literal_(NodeIndex node) {
+    const auto& literal = ast_->literals[ast_->a[node]];
+
+    Value value;
+    switch (literal.index()) {
+        case 1:
+            value = Value::object(interpreter_.heap_.intern(std::get<std::string_view>(literal)));
+            constants_.push_back(value);
+            break;
+
+        case 2:
+            value = Value::number(std::get<double>(literal));
+            break;
+
+        case 3:
+            value = Value::boolean(std::get<bool>(literal));
+            break;
+
+        default:
+            value = Value::nil();
+            break;
+    }
+
+    return [value]() {
+        return value;
+    };
+}
+
+CompiledExpr ClosureCompiler::unary_(NodeIndex node) {
+    auto right = expression_(ast_->a[node]);
+    if (static_cast<TokenType>(ast_->c[node]) == TokenType::MINUS) {
+        return [right]() {
+            Value operand = right();
+            if (!operand.is_number()) {
+                throw RuntimeError("Operand must be a number.");
+            }
+            return Value::number(-operand.as_number());
+        };
+    }
+
+    return [right]() {
+        return Value::boolean(right().is_falsey());
+    };
+}
+
+CompiledExpr ClosureCompiler::binary_(NodeIndex node) {
+    auto lhs = expression_(ast_->a[node]);
+    auto rhs = expression_(ast_->b[node]);
+
+    //
+    // Both sides run, left to right, before an operand of the wrong type throws.  An operand that is not a
+    // number is never looked at again, so the left side does not need to be kept from the collector.
+    //
+    auto numbers = [&](auto operation) -> CompiledExpr {
+        return [lhs, rhs, operation]() {
+            Value left = lhs();
+            Value right = rhs();
+            if (!left.is_number() || !right.is_number()) {
+                throw RuntimeError("Operands must be numbers.");
+            }
+            return operation(left.as_number(), right.as_number());
+        };
+    };
+
+    // Equality compares objects by address, the left side has to stay alive while the right side runs.
+    auto equality = [&](bool equal) -> CompiledExpr {
+        return [this, lhs, rhs, equal]() {
+            auto& stack = interpreter_.value_stack_;
+            stack.push_back(lhs());
+            Value right = rhs();
+            Value left = stack.back();
+            stack.pop_back();
+            return Value::boolean((left == right) == equal);
+        };
+    };
+
+    switch (static_cast<TokenType>(ast_->c[node])) {
+        case TokenType::PLUS:
+            return [this, lhs, rhs]() {
+                Value left = lhs();
+                if (left.is_number()) {
+                    Value right = rhs();
+                    if (right.is_number()) {
+                        return Value::number(left.as_number() + right.as_number());
+                    }
+                    throw RuntimeError("Operands must be two numbers or two strings.");
+                }
+
+                auto& stack = interpreter_.value_stack_;
+                stack.push_back(left);
+                Value right = rhs();
+                stack.pop_back();
+                if (!is_obj_type(left, ObjType::String) || !is_obj_type(right, ObjType::String)) {
+                    throw RuntimeError("Operands must be two numbers or two strings.");
+                }
+                return interpreter_.concatenate_(left, right);
+            };
+
+        case TokenType::MINUS:
+            return numbers([](double left, double right) { return Value::number(left - right); });
+        case TokenType::STAR:
+            return numbers([](double left, double right) { return Value::number(left * right); });
+        case TokenType::SLASH:
+            return numbers([](double left, double right) { return Value::number(left / right); });
+        case TokenType::LESS:
+            return numbers([](double left, double right) { return Value::boolean(left < right); });
+        case TokenType::LESS_EQUAL:
+            return numbers([](double left, double right) { return Value::boolean(left <= right); });
+        case TokenType::GREATER:
+            return numbers([](double left, double right) { return Value::boolean(left > right); });
+        case TokenType::GREATER_EQUAL:
+            return numbers([](double left, double right) { return Value::boolean(left >= right); });
+        case TokenType::EQUAL_EQUAL:
+            return equality(true);
+        case TokenType::BANG_EQUAL:
+            return equality(false);
+
+        default:
+            throw RuntimeError("Unknown operation");
+    }
+}
+
+CompiledExpr ClosureCompiler::logical_(NodeIndex node) {
+    auto lhs = expression_(ast_->a[node]);
+    auto rhs = expression_(ast_->b[node]);
+
+    if (static_cast<TokenType>(ast_->c[node]) == TokenType::OR) {
+        return [lhs, rhs]() {
+            Value left = lhs();
+            return left.is_falsey() ? rhs() : left;
+        };
+    }
+
+    return [lhs, rhs]() {
+        Value left = lhs();
+        return left.is_falsey() ? left : rhs();
+    };
+}
+
+CompiledExpr ClosureCompiler::variable_(NodeIndex node) {
+    auto resolved = ast_->resolved(node);
+    if (resolved.is_global()) {
+        // Globals are never removed, once found the value stays where it is.
+        return [this, name = ast_->name(node), cell = static_cast<Value*>(nullptr)]() mutable {
+            if (cell == nullptr) {
+                cell = find_global_(name);
+            }
+            return *cell;
+        };
+    }
+
+    if (resolved.is_upvalue()) {
+        return [this, slot = resolved.slot]() {
+            return interpreter_.upvalue_(slot);
+        };
+    }
+
+    return [this, slot = resolved.slot]() {
+        return interpreter_.curr_env_->at(slot);
+    };
+}
+
+CompiledExpr ClosureCompiler::assign_(NodeIndex node) {
+    auto value = expression_(ast_->a[node]);
+    auto resolved = ast_->resolved(node);
+    if (resolved.is_global()) {
+        return [this, value, name = ast_->name(node), cell = static_cast<Value*>(nullptr)]() mutable {
+            Value assigned = value();
+            if (cell == nullptr) {
+                cell = find_global_(name);
+            }
+            *cell = assigned;
+            return assigned;
+        };
+    }
+
+    if (resolved.is_upvalue()) {
+        return [this, value, slot = resolved.slot]() {
+            Value assigned = value();
+            interpreter_.upvalue_(slot) = assigned;
+            return assigned;
+        };
+    }
+
+    return [this, value, slot = resolved.slot]() {
+        Value assigned = value();
+        interpreter_.curr_env_->at(slot) = assigned;
+        return assigned;
+    };
+}
+
+CompiledExpr ClosureCompiler::call_expr_(NodeIndex node, bool tail) {
+    auto& ast = *ast_;
+
+    std::vector<CompiledExpr> args;
+    for(auto arg: ast.list(ast.b[node], ast.c[node])) {
+        args.push_back(expression_(arg));
+    }
+    int line = ast.line(node);
+
+    //
+    // Calling a method straight off an instance or off super passes the instance along as the receiver, rather
+    // than binding a copy of the method only to call it once.
+    //
+    auto callee_node = ast.a[node];
+    if (ast.kinds[callee_node] == NodeKind::Get) {
+        return [this, object = expression_(ast.a[callee_node]), cache = &ast.caches[ast.b[callee_node]],
+                name = ast.name(callee_node), args, line, tail]() {
+            auto instance = instance_(object());
+            auto property = lookup_get_(instance, *cache, name, interpreter_.cache_stats_.invoke);
+            if (property.slot >= 0) {
+                return invoke_(instance->fields[property.slot], nullptr, args, line, tail);
+            }
+            return invoke_(Value::object(property.method), instance, args, line, tail);
+        };
+    }
+
+    if (ast.kinds[callee_node] == NodeKind::Super) {
+        auto resolved = ast.resolved(callee_node);
+        return [this, resolved, name = ast.name(callee_node), method_id = -1, args, line, tail]() mutable {
+            LoxInstance* receiver = nullptr;
+            auto method = find_super_method_(resolved, name, method_id, receiver);
+            return invoke_(Value::object(method), receiver, args, line, tail);
+        };
+    }
+
+    return [this, callee = expression_(callee_node), args, line, tail]() {
+        return invoke_(callee(), nullptr, args, line, tail);
+    };
+}
+
+CompiledExpr ClosureCompiler::get_(NodeIndex node) {
+    auto& ast = *ast_;
+    return [this, object = expression_(ast.a[node]), cache = &ast.caches[ast.b[node]], name = ast.name(node)]() {
+        auto instance = instance_(object());
+        auto property = lookup_get_(instance, *cache, name, interpreter_.cache_stats_.get);
+        if (property.slot >= 0) {
+            return instance->fields[property.slot];
+        }
+        return Value::object(property.method->bind(interpreter_.heap_, instance));
+    };
+}
+
+CompiledExpr ClosureCompiler::set_(NodeIndex node) {
+    auto& ast = *ast_;
+    return [this, object = expression_(ast.a[node]), value = expression_(ast.b[node]),
+            cache = &ast.caches[ast.c[node]], name = ast.name(node)]() {
+        auto& interpreter = interpreter_;
+        Value target = object();
+        auto instance = instance_(target);
+
+        interpreter.value_stack_.push_back(target);
+        Value assigned = value();
+        interpreter.value_stack_.pop_back();
+
+        // Look the field up only now, evaluating the value may have added fields to the instance.
+        if (auto entry = cache->find(instance->shape)) {
+            ++interpreter.cache_stats_.set.hits;
+            instance->set(*entry, assigned);
+        } else {
+            ++interpreter.cache_stats_.set.misses;
+            auto property = instance->lookup_set(name);
+            cache->add(property);
+            instance->set(property, assigned);
+        }
+        return assigned;
+    };
+}
+
+CompiledExpr ClosureCompiler::super_(NodeIndex node) {
+    auto resolved = ast_->resolved(node);
+    return [this, resolved, name = ast_->name(node), method_id = -1]() mutable {
+        LoxInstance* receiver = nullptr;
+        auto method = find_super_method_(resolved, name, method_id, receiver);
+        return Value::object(method->bind(interpreter_.heap_, receiver));
+    };
+}
+
+bool ClosureCompiler::execute_(const CompiledStmt& stmt) {
+    if (interpreter_.heap_.should_collect()) {
+        interpreter_.collect_garbage_();
+    }
+
+    return stmt();
+}
+
+bool ClosureCompiler::execute_all_(const std::vector<CompiledStmt>& stmts) {
+    for(const auto& stmt: stmts) {
+        if (execute_(stmt)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Value* ClosureCompiler::find_global_(std::string_view name) {
+    auto global = interpreter_.globals_.find(name);
+    if (global == interpreter_.globals_.end()) {
+        throw RuntimeError(std::format("Undefined variable: {}", name));
+    }
+    return &global->second;
+}
+
+LoxInstance* ClosureCompiler::instance_(const Value& object) {
+    if (!is_obj_type(object, ObjType::LoxInstance)) {
+        throw RuntimeError("Only object instances have properties.");
+    }
+    return as_obj<LoxInstance>(object);
+}
+
+PropertyCacheEntry ClosureCompiler::lookup_get_(LoxInstance* instance, PropertyCache& cache, std::string_view name,
+                                                CacheCounters& counters) {
+    if (auto entry = cache.find(instance->shape)) {
+        ++counters.hits;
+        return *entry;
+    }
+
+    ++counters.misses;
+    auto property = instance->lookup_get(name, interpreter_.method_ids_.find(name));
+    cache.add(property);
+    return property;
+}
+
+LoxFunction* ClosureCompiler::find_super_method_(const VariableSlot& receiver_slot, std::string_view name,
+                                                 int& method_id, LoxInstance*& receiver) {
+    // The node is resolved to "this", the super class is the running method's.
+    auto& frames = interpreter_.frames_;
+    if (receiver_slot.is_global() || frames.empty() || frames.back().function->super_class == nullptr) {
+        throw RuntimeError("Could not find 'super' in environment.");
+    }
+
+    auto super_class = frames.back().function->super_class;
+    Value this_value = receiver_slot.is_upvalue() ? interpreter_.upvalue_(receiver_slot.slot)
+                                                  : interpreter_.curr_env_->at(receiver_slot.slot);
+    if (!is_obj_type(this_value, ObjType::LoxInstance)) {
+        throw RuntimeError("Could not find 'super' in environment.");
+    }
+
+    // Ids are never taken back, so once the name has one the closure can keep it.
+    if (method_id < 0) {
+        method_id = interpreter_.method_ids_.find(name);
+    }
+
+    auto method = super_class->find_method(method_id);
+    if (method == nullptr) {
+        throw RuntimeError(std::format("Field/method is unknown: {}", name));
+    }
+
+    receiver = as_obj<LoxInstance>(this_value);
+    return method;
+}
+
+Value ClosureCompiler::invoke_(const Value& callee, LoxInstance* receiver, const std::vector<CompiledExpr>& args,
+                               int line, bool tail) {
+    // The arguments can collect, keep the receiver (which keeps its method) or the callee on the value stack.
+    auto& stack = interpreter_.value_stack_;
+    stack.push_back(receiver ? Value::object(receiver) : callee);
+
+    size_t arg_base = stack.size();
+    for(const auto& arg: args) {
+        Value evaluated = arg();
+        stack.push_back(evaluated);
+    }
+
+    // A Lox function called in tail position runs once its caller has returned, as in the Interpreter.
+    if (tail && is_obj_type(callee, ObjType::LoxFunction)) {
+        auto function = as_obj<LoxFunction>(callee);
+        if (static_cast<int>(args.size()) != function->arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", function->arity, args.size()));
+        }
+
+        interpreter_.tail_call_pending_ = Interpreter::TailCall{function, receiver ? receiver : function->receiver,
+                                                                arg_base};
+        return Value::nil();
+    }
+
+    Value result = call_(callee, receiver, arg_base, line);
+    stack.resize(arg_base - 1);
+    return result;
+}
+
+Value ClosureCompiler::call_(const Value& callee, LoxInstance* receiver, size_t arg_base, int line) {
+    auto& interpreter = interpreter_;
+    int arg_count = static_cast<int>(interpreter.value_stack_.size() - arg_base);
+
+    if (is_obj_type(callee, ObjType::LoxFunction)) {
+        auto function = as_obj<LoxFunction>(callee);
+        if (arg_count != function->arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", function->arity, arg_count));
+        }
+
+        return call_function_(function, receiver ? receiver : function->receiver, arg_base);
+    }
+
+    if (is_obj_type(callee, ObjType::Native)) {
+        auto native = as_obj<ObjNative>(callee);
+        if (arg_count != native->arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", native->arity, arg_count));
+        }
+
+        return native->function(arg_count, interpreter.value_stack_.data() + arg_base);
+    }
+
+    if (is_obj_type(callee, ObjType::LoxClass)) {
+        //
+        // Calling a class makes a new instance and runs init on it, if there is one.
+        //
+        auto lox_class = as_obj<LoxClass>(callee);
+        auto instance = LoxInstance::create(interpreter.heap_, lox_class);
+
+        int arity = lox_class->initializer ? lox_class->initializer->arity : 0;
+        if (arg_count != arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", arity, arg_count));
+        }
+
+        if (lox_class->initializer) {
+            call_function_(lox_class->initializer, instance, arg_base);
+        }
+
+        return Value::object(instance);
+    }
+
+    throw RuntimeError(std::format("This is not a callable object at line: {}", line));
+}
+
+Value ClosureCompiler::call_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base) {
+    auto& interpreter = interpreter_;
+    auto& stack = interpreter.value_stack_;
+
+    Value result = run_function_(function, receiver, arg_base);
+    while (interpreter.tail_call_pending_.function != nullptr) {
+        auto tail_call = interpreter.tail_call_pending_;
+        interpreter.tail_call_pending_ = Interpreter::TailCall{};
+
+        std::copy(stack.begin() + static_cast<std::ptrdiff_t>(tail_call.arg_base - 1), stack.end(),
+                  stack.begin() + static_cast<std::ptrdiff_t>(arg_base - 1));
+        stack.resize(arg_base + tail_call.function->arity);
+
+        result = run_function_(tail_call.function, tail_call.receiver, arg_base);
+    }
+    return result;
+}
+
+Value ClosureCompiler::run_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base) {
+    auto& interpreter = interpreter_;
+
+    auto& frame = interpreter.push_frame_(function);
+    Interpreter::FrameGuard frame_guard{interpreter};
+
+    // A method's receiver is "this", in the slot before the arguments.
+    auto code = function->closure_code;
+    auto env = frame.env = Environment::create(static_cast<int>(code->slot_count));
+    if (function->is_method) {
+        env->define(Value::object(receiver));
+    }
+    for(int i = 0; i < function->arity; ++i) {
+        env->define(interpreter.value_stack_[arg_base + i]);
+    }
+
+    // The frame puts the caller's environment back.
+    interpreter.curr_env_ = env;
+    bool returned = execute_all_(code->body);
+
+    if (function->is_initializer) {
+        // init always hands back the instance, even from an early return.
+        return Value::object(receiver);
+    }
+
+    // If the function just ends with no return, the result is nil.
+    return returned ? interpreter.value : Value::nil();
+}
+
+} // namespace cpplox
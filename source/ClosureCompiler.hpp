@@ -0,0 +1,115 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "FlatAst.hpp"
+#include "PropertyCache.hpp"
+#include "Value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+class Interpreter;
+struct LoxFunction;
+struct LoxInstance;
+
+/// An expression compiled to a closure, calling it evaluates the expression.
+using CompiledExpr = std::function<Value()>;
+
+/// A statement compiled to a closure, calling it runs the statement.  Returns true when a return statement ran.
+using CompiledStmt = std::function<bool()>;
+
+/// The body of one function declaration, shared by every function made from it.
+struct ClosureCode {
+    uint32_t slot_count = 0;
+    std::vector<CompiledStmt> body;
+};
+
+/// Compiles the flat AST into a tree of closures and runs it, which is what --engine=closure does.
+///
+/// Everything the tree-walker decodes from a node each time it gets there, the handler for its kind, the
+/// operator, a variable's slot, a literal's value, is decided once when the node is compiled and bound
+/// into the node's closure.  Running the program is then nothing but closures calling their children.
+///
+/// The closures run on the Interpreter's runtime: its heap, globals, environments, classes and inline caches.
+/// Only the way the nodes are dispatched differs between the two engines.
+class ClosureCompiler {
+private:
+    Interpreter& interpreter_;
+    FlatAst* ast_ = nullptr;
+
+    /// Every compiled declaration.  Functions point at their code, so it stays for as long as the compiler does.
+    std::deque<ClosureCode> codes_;
+
+    /// The string literals, interned once when they are compiled.  The closures hold on to them, so they are
+    /// roots for the collector.
+    std::vector<Value> constants_;
+
+public:
+    explicit ClosureCompiler(Interpreter& interpreter): interpreter_{interpreter} {
+    }
+
+    ClosureCompiler(const ClosureCompiler&) = delete;
+    ClosureCompiler& operator=(const ClosureCompiler&) = delete;
+
+    /// Compiles the program's statements, then runs them.
+    void run(FlatAst& ast);
+
+    const std::vector<Value>& roots() const {
+        return constants_;
+    }
+
+// Internal Helpers
+private:
+    std::vector<CompiledStmt> statements_(uint32_t first, uint32_t count);
+    CompiledStmt statement_(NodeIndex node);
+    CompiledStmt function_decl_(NodeIndex node);
+    CompiledStmt class_decl_(NodeIndex node);
+    ClosureCode* function_body_(NodeIndex node);
+
+    CompiledExpr expression_(NodeIndex node);
+    CompiledExpr literal_(NodeIndex node);
+    CompiledExpr unary_(NodeIndex node);
+    CompiledExpr binary_(NodeIndex node);
+    CompiledExpr logical_(NodeIndex node);
+    CompiledExpr variable_(NodeIndex node);
+    CompiledExpr assign_(NodeIndex node);
+
+    /// A call in tail position leaves a Lox function callee for call_function_ to run after its caller.
+    CompiledExpr call_expr_(NodeIndex node, bool tail = false);
+    CompiledExpr get_(NodeIndex node);
+    CompiledExpr set_(NodeIndex node);
+    CompiledExpr super_(NodeIndex node);
+
+    //
+    // What the closures call at run time.
+    //
+
+    /// Runs a statement, collecting first if the heap is due.
+    bool execute_(const CompiledStmt& stmt);
+    bool execute_all_(const std::vector<CompiledStmt>& stmts);
+
+    Value* find_global_(std::string_view name);
+    LoxInstance* instance_(const Value& object);
+    PropertyCacheEntry lookup_get_(LoxInstance* instance, PropertyCache& cache, std::string_view name,
+                                   CacheCounters& counters);
+    LoxFunction* find_super_method_(const VariableSlot& receiver_slot, std::string_view name, int& method_id,
+                                    LoxInstance*& receiver);
+
+    /// Evaluates the arguments onto the value stack, behind the callee, and calls it.
+    Value invoke_(const Value& callee, LoxInstance* receiver, const std::vector<CompiledExpr>& args, int line,
+                  bool tail);
+    Value call_(const Value& callee, LoxInstance* receiver, size_t arg_base, int line);
+
+    /// Calls the function and then whatever it, and its tail callees in turn, called in tail position.
+    Value call_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base);
+    Value run_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base);
+};
+
+} // namespace cpplox
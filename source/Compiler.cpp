@@ -0,0 +1,655 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Compiler.hpp"
+
+#include "ParserError.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace cpplox {
+
+// The operands that index locals, upvalues and constants are two bytes.
+static constexpr int max_uint16_count_ = std::numeric_limits<uint16_t>::max() + 1;
+
+ObjFunction* Compiler::compile(std::span<Stmt*> stmts) {
+    FunctionState script;
+    script.function = heap_.allocate<ObjFunction>();
+    script.type = FunctionType::Script;
+
+    // Slot zero belongs to the function being called.
+    script.locals.push_back(Local{"", 0, false});
+    current_ = &script;
+
+    for(auto stmt: stmts) {
+        compile_(*(stmt));
+    }
+    emit_return_();
+
+    current_ = nullptr;
+    return script.function;
+}
+
+void Compiler::visit(const AssignExpr& expr) {
+    line_ = expr.name.line;
+    named_variable_(expr.name, expr.value);
+}
+
+void Compiler::visit(const BinaryExpr& expr) {
+    compile_(*(expr.left));
+    compile_(*(expr.right));
+
+    line_ = expr.operation.line;
+    switch (expr.operation.type) {
+        case TokenType::BANG_EQUAL:
+            emit_(OpCode::EQUAL);
+            emit_(OpCode::NOT);
+            break;
+        case TokenType::EQUAL_EQUAL:
+            emit_(OpCode::EQUAL);
+            break;
+        case TokenType::GREATER:
+            emit_(OpCode::GREATER);
+            break;
+        case TokenType::GREATER_EQUAL:
+            emit_(OpCode::GREATER_EQUAL);
+            break;
+        case TokenType::LESS:
+            emit_(OpCode::LESS);
+            break;
+        case TokenType::LESS_EQUAL:
+            emit_(OpCode::LESS_EQUAL);
+            break;
+        case TokenType::MINUS:
+            emit_(OpCode::SUBTRACT);
+            break;
+        case TokenType::PLUS:
+            emit_(OpCode::ADD);
+            break;
+        case TokenType::SLASH:
+            emit_(OpCode::DIVIDE);
+            break;
+        case TokenType::STAR:
+            emit_(OpCode::MULTIPLY);
+            break;
+        default:
+            throw ParserError("Unknown binary operation.", expr.operation);
+    }
+}
+
+void Compiler::visit(const LiteralExpr& expr) {
+    switch (expr.value.index()) {
+        case 1:
+            emit_index_(OpCode::CONSTANT, make_constant_(Value::object(heap_.intern(std::get<std::string_view>(expr.value)))));
+            break;
+
+        case 2:
+            emit_index_(OpCode::CONSTANT, make_constant_(Value::number(std::get<double>(expr.value))));
+            break;
+
+        case 3:
+            emit_(std::get<bool>(expr.value) ? OpCode::TRUE : OpCode::FALSE);
+            break;
+
+        default:
+            emit_(OpCode::NIL);
+            break;
+    }
+}
+
+void Compiler::visit(const GroupingExpr& expr) {
+    compile_(*(expr.expression));
+}
+
+void Compiler::visit(const UnaryExpr& expr) {
+    compile_(*(expr.right));
+
+    line_ = expr.operation.line;
+    switch (expr.operation.type) {
+        case TokenType::BANG:
+            emit_(OpCode::NOT);
+            break;
+        case TokenType::MINUS:
+            emit_(OpCode::NEGATE);
+            break;
+        default:
+            throw ParserError("Unknown unary operation.", expr.operation);
+    }
+}
+
+void Compiler::visit(const VariableExpr& expr) {
+    line_ = expr.name.line;
+    named_variable_(expr.name, nullptr);
+}
+
+void Compiler::visit(const LogicalExpr& expr) {
+    compile_(*(expr.left));
+
+    line_ = expr.operation.line;
+    if (expr.operation.type == TokenType::OR) {
+        int else_jump = emit_jump_(OpCode::JUMP_IF_FALSE);
+        int end_jump = emit_jump_(OpCode::JUMP);
+
+        patch_jump_(else_jump);
+        emit_(OpCode::POP);
+
+        compile_(*(expr.right));
+        patch_jump_(end_jump);
+    } else {
+        int end_jump = emit_jump_(OpCode::JUMP_IF_FALSE);
+
+        emit_(OpCode::POP);
+        compile_(*(expr.right));
+        patch_jump_(end_jump);
+    }
+}
+
+void Compiler::visit(const CallExpr& expr) {
+    //
+    // Calling a method directly off an instance or super is common enough that we skip creating the bound method.
+    //
+    if (auto get_expr = dynamic_cast<GetExpr*>(expr.callee)) {
+        compile_(*(get_expr->object));
+        uint16_t name = identifier_constant_(get_expr->name);
+        for(auto arg: expr.args) {
+            compile_(*(arg));
+        }
+
+        line_ = expr.closing_paren.line;
+        emit_index_(OpCode::INVOKE, name);
+        emit_(static_cast<uint8_t>(expr.args.size()));
+        return;
+    }
+
+    //
+    // Without a superclass to call, the callee fails when it is evaluated, see SuperExpr.
+    //
+    auto super_expr = dynamic_cast<SuperExpr*>(expr.callee);
+    if (super_expr && current_class_ && current_class_->has_super_class) {
+        uint16_t name = identifier_constant_(super_expr->method);
+        named_variable_(TokenRef{TokenType::THIS, "this", super_expr->keyword.line}, nullptr);
+        for(auto arg: expr.args) {
+            compile_(*(arg));
+        }
+        named_variable_(super_expr->keyword, nullptr);
+
+        line_ = expr.closing_paren.line;
+        emit_index_(OpCode::SUPER_INVOKE, name);
+        emit_(static_cast<uint8_t>(expr.args.size()));
+        return;
+    }
+
+    compile_(*(expr.callee));
+    for(auto arg: expr.args) {
+        compile_(*(arg));
+    }
+
+    line_ = expr.closing_paren.line;
+    emit_(OpCode::CALL, static_cast<uint8_t>(expr.args.size()));
+}
+
+void Compiler::visit(const GetExpr& expr) {
+    compile_(*(expr.object));
+
+    line_ = expr.name.line;
+    emit_index_(OpCode::GET_PROPERTY, identifier_constant_(expr.name));
+}
+
+void Compiler::visit(const SetExpr& expr) {
+    compile_(*(expr.object));
+    compile_(*(expr.value));
+
+    line_ = expr.name.line;
+    emit_index_(OpCode::SET_PROPERTY, identifier_constant_(expr.name));
+}
+
+void Compiler::visit(const ThisExpr& expr) {
+    line_ = expr.keyword.line;
+    if (current_class_ == nullptr) {
+        throw ParserError("Can't use 'this' outside of a class.", expr.keyword);
+    }
+
+    named_variable_(expr.keyword, nullptr);
+}
+
+void Compiler::visit(const SuperExpr& expr) {
+    line_ = expr.keyword.line;
+
+    // As on the tree-walker, super without a superclass is an error once it runs, not when it is compiled.
+    if (current_class_ == nullptr || !current_class_->has_super_class) {
+        emit_(OpCode::NO_SUPER);
+        return;
+    }
+
+    uint16_t name = identifier_constant_(expr.method);
+    named_variable_(TokenRef{TokenType::THIS, "this", expr.keyword.line}, nullptr);
+    named_variable_(expr.keyword, nullptr);
+    emit_index_(OpCode::GET_SUPER, name);
+}
+
+void Compiler::visit(const PrintStatement& stmt) {
+    compile_(*(stmt.expression));
+    emit_(OpCode::PRINT);
+}
+
+void Compiler::visit(const ExpressionStatement& stmt) {
+    compile_(*(stmt.expression));
+    emit_(OpCode::POP);
+}
+
+void Compiler::visit(const VariableDeclStatement& stmt) {
+    line_ = stmt.name.line;
+    declare_variable_(stmt.name);
+    uint16_t global = current_->scope_depth > 0 ? 0 : identifier_constant_(stmt.name);
+
+    if (stmt.initializer) {
+        compile_(*(stmt.initializer));
+    } else {
+        emit_(OpCode::NIL);
+    }
+
+    define_variable_(global);
+}
+
+void Compiler::visit(const BlockStatement& stmt) {
+    begin_scope_();
+    for(auto curr: stmt.statements) {
+        compile_(*(curr));
+    }
+    end_scope_();
+}
+
+void Compiler::visit(const IfStatement& stmt) {
+    compile_(*(stmt.condition));
+
+    int then_jump = emit_jump_(OpCode::JUMP_IF_FALSE);
+    emit_(OpCode::POP);
+    compile_(*(stmt.then_branch));
+
+    int else_jump = emit_jump_(OpCode::JUMP);
+    patch_jump_(then_jump);
+    emit_(OpCode::POP);
+
+    if (stmt.else_branch) {
+        compile_(*(stmt.else_branch));
+    }
+    patch_jump_(else_jump);
+}
+
+void Compiler::visit(const WhileStatement& stmt) {
+    int loop_start = static_cast<int>(chunk_().code.size());
+    compile_(*(stmt.condition));
+
+    int exit_jump = emit_jump_(OpCode::JUMP_IF_FALSE);
+    emit_(OpCode::POP);
+    compile_(*(stmt.body));
+    emit_loop_(loop_start);
+
+    patch_jump_(exit_jump);
+    emit_(OpCode::POP);
+}
+
+void Compiler::visit(const FunctionDeclStatementProxy& stmt_proxy) {
+    const auto& name = stmt_proxy.stmt->name;
+    line_ = name.line;
+
+    declare_variable_(name);
+    uint16_t global = current_->scope_depth > 0 ? 0 : identifier_constant_(name);
+
+    // A local function can refer to itself, so it is usable before the body is compiled.
+    mark_initialized_();
+    function_(*(stmt_proxy.stmt), FunctionType::Function);
+    define_variable_(global);
+}
+
+void Compiler::visit(const ReturnStatement& stmt) {
+    line_ = stmt.keyword.line;
+    if (current_->type == FunctionType::Script) {
+        throw ParserError("Can't return from top-level code.", stmt.keyword);
+    }
+
+    if (!stmt.value) {
+        emit_return_();
+        return;
+    }
+
+    // init hands back the instance whatever it returns, the value is only evaluated.
+    if (current_->type == FunctionType::Initializer) {
+        compile_(*(stmt.value));
+        emit_(OpCode::POP);
+        emit_return_();
+        return;
+    }
+
+    //
+    // A call in tail position hands its frame over to the callee, method calls go through INVOKE and still nest.
+    // The RETURN after it is only reached when the callee turns out not to be a Lox function.
+    //
+    auto call_expr = dynamic_cast<CallExpr*>(stmt.value);
+    if (call_expr && !dynamic_cast<GetExpr*>(call_expr->callee) && !dynamic_cast<SuperExpr*>(call_expr->callee)) {
+        compile_(*(call_expr->callee));
+        for(auto arg: call_expr->args) {
+            compile_(*(arg));
+        }
+
+        line_ = call_expr->closing_paren.line;
+        emit_(OpCode::TAIL_CALL, static_cast<uint8_t>(call_expr->args.size()));
+        emit_(OpCode::RETURN);
+        return;
+    }
+
+    compile_(*(stmt.value));
+    emit_(OpCode::RETURN);
+}
+
+void Compiler::visit(const ClassDeclStatement& stmt) {
+    line_ = stmt.name.line;
+
+    uint16_t name_constant = identifier_constant_(stmt.name);
+    declare_variable_(stmt.name);
+
+    emit_index_(OpCode::CLASS, name_constant);
+    define_variable_(name_constant);
+
+    ClassState class_state;
+    class_state.enclosing = current_class_;
+    current_class_ = &class_state;
+
+    //
+    // The superclass is captured in a scope of its own, so methods can find it as the "super" variable.
+    //
+    if (stmt.super_class) {
+        if (stmt.super_class->name.lexeme == stmt.name.lexeme) {
+            throw ParserError("A class can't inherit from itself.", stmt.super_class->name);
+        }
+        compile_(*(stmt.super_class));
+
+        begin_scope_();
+        add_local_(TokenRef{TokenType::SUPER, "super", stmt.name.line});
+        define_variable_(0);
+
+        named_variable_(stmt.name, nullptr);
+        emit_(OpCode::INHERIT);
+        class_state.has_super_class = true;
+    }
+
+    named_variable_(stmt.name, nullptr);
+    for(auto method: stmt.methods) {
+        line_ = method->name.line;
+        uint16_t method_constant = identifier_constant_(method->name);
+
+        auto type = method->name.lexeme == "init" ? FunctionType::Initializer : FunctionType::Method;
+        function_(*(method), type);
+        emit_index_(OpCode::METHOD, method_constant);
+    }
+    emit_(OpCode::POP);
+
+    if (class_state.has_super_class) {
+        end_scope_();
+    }
+
+    current_class_ = class_state.enclosing;
+}
+
+Chunk& Compiler::chunk_() {
+    return current_->function->chunk;
+}
+
+void Compiler::compile_(Expr& expr) {
+    expr.accept(*this);
+}
+
+void Compiler::compile_(Stmt& stmt) {
+    stmt.accept(*this);
+}
+
+void Compiler::emit_(uint8_t byte) {
+    chunk_().write(byte, line_);
+}
+
+void Compiler::emit_(OpCode op) {
+    chunk_().write(op, line_);
+}
+
+void Compiler::emit_(OpCode op, uint8_t operand) {
+    emit_(op);
+    emit_(operand);
+}
+
+void Compiler::emit_index_(OpCode op, int index) {
+    emit_(op);
+    emit_short_(static_cast<uint16_t>(index));
+}
+
+void Compiler::emit_short_(uint16_t value) {
+    emit_(static_cast<uint8_t>(value >> 8));
+    emit_(static_cast<uint8_t>(value & 0xff));
+}
+
+void Compiler::emit_return_() {
+    // Initializers always hand back the instance, which lives in slot zero.
+    if (current_->type == FunctionType::Initializer) {
+        emit_index_(OpCode::GET_LOCAL, 0);
+    } else {
+        emit_(OpCode::NIL);
+    }
+
+    emit_(OpCode::RETURN);
+}
+
+//
+// Jump offsets are four bytes, the tree-walker puts no limit on how much code a branch or a loop body holds.
+//
+
+int Compiler::emit_jump_(OpCode op) {
+    emit_(op);
+    for(int i = 0; i < 4; ++i) {
+        emit_(0xff);
+    }
+
+    return static_cast<int>(chunk_().code.size()) - 4;
+}
+
+void Compiler::patch_jump_(int offset) {
+    // -4 to adjust for the jump offset itself.
+    auto jump = static_cast<uint32_t>(chunk_().code.size() - offset - 4);
+    for(int i = 0; i < 4; ++i) {
+        chunk_().code[offset + i] = (jump >> (24 - 8 * i)) & 0xff;
+    }
+}
+
+void Compiler::emit_loop_(int loop_start) {
+    emit_(OpCode::LOOP);
+
+    // +4 to jump over the operand of the loop instruction too.
+    auto offset = static_cast<uint32_t>(chunk_().code.size() - loop_start + 4);
+    for(int i = 0; i < 4; ++i) {
+        emit_(static_cast<uint8_t>((offset >> (24 - 8 * i)) & 0xff));
+    }
+}
+
+uint16_t Compiler::make_constant_(const Value& value) {
+    int constant = chunk_().add_constant(value);
+    if (constant >= max_uint16_count_) {
+        error_("Too many constants in one chunk.");
+    }
+
+    return static_cast<uint16_t>(constant);
+}
+
+uint16_t Compiler::identifier_constant_(const TokenRef& name) {
+    ObjString* string = heap_.intern(name.lexeme);
+
+    auto itr = current_->identifiers.find(string);
+    if (itr != current_->identifiers.end()) {
+        return itr->second;
+    }
+
+    uint16_t constant = make_constant_(Value::object(string));
+    current_->identifiers[string] = constant;
+    return constant;
+}
+
+void Compiler::begin_scope_() {
+    ++current_->scope_depth;
+}
+
+void Compiler::end_scope_() {
+    --current_->scope_depth;
+
+    auto& locals = current_->locals;
+    while (!locals.empty() && locals.back().depth > current_->scope_depth) {
+        if (locals.back().is_captured) {
+            emit_(OpCode::CLOSE_UPVALUE);
+        } else {
+            emit_(OpCode::POP);
+        }
+        locals.pop_back();
+    }
+}
+
+void Compiler::add_local_(const TokenRef& name) {
+    if (current_->locals.size() >= max_uint16_count_) {
+        throw ParserError("Too many local variables in function.", name);
+    }
+
+    current_->locals.push_back(Local{name.lexeme, -1, false});
+    current_->function->slot_count = std::max(current_->function->slot_count,
+                                              static_cast<int>(current_->locals.size()));
+}
+
+void Compiler::declare_variable_(const TokenRef& name) {
+    if (current_->scope_depth == 0) {
+        return;
+    }
+
+    // A name declared again in the same scope gets a new slot that shadows the old one, as on the tree-walker.
+    add_local_(name);
+}
+
+void Compiler::mark_initialized_() {
+    if (current_->scope_depth == 0) {
+        return;
+    }
+
+    current_->locals.back().depth = current_->scope_depth;
+}
+
+void Compiler::define_variable_(uint16_t global) {
+    if (current_->scope_depth > 0) {
+        mark_initialized_();
+        return;
+    }
+
+    emit_index_(OpCode::DEFINE_GLOBAL, global);
+}
+
+int Compiler::resolve_local_(FunctionState& state, const TokenRef& name) {
+    for(int i = static_cast<int>(state.locals.size()) - 1; i >= 0; --i) {
+        if (state.locals[i].name == name.lexeme) {
+            if (state.locals[i].depth == -1) {
+                throw ParserError("Can't read local variable in its own initializer.", name);
+            }
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int Compiler::resolve_upvalue_(FunctionState& state, const TokenRef& name) {
+    if (state.enclosing == nullptr) {
+        return -1;
+    }
+
+    int local = resolve_local_(*(state.enclosing), name);
+    if (local != -1) {
+        state.enclosing->locals[local].is_captured = true;
+        return add_upvalue_(state, static_cast<uint16_t>(local), true, name);
+    }
+
+    int upvalue = resolve_upvalue_(*(state.enclosing), name);
+    if (upvalue != -1) {
+        return add_upvalue_(state, static_cast<uint16_t>(upvalue), false, name);
+    }
+
+    return -1;
+}
+
+int Compiler::add_upvalue_(FunctionState& state, uint16_t index, bool is_local, const TokenRef& name) {
+    for(size_t i = 0; i < state.upvalues.size(); ++i) {
+        if (state.upvalues[i].index == index && state.upvalues[i].is_local == is_local) {
+            return static_cast<int>(i);
+        }
+    }
+
+    if (state.upvalues.size() >= max_uint16_count_) {
+        throw ParserError("Too many closure variables in function.", name);
+    }
+
+    state.upvalues.push_back(Upvalue{index, is_local});
+    return static_cast<int>(state.upvalues.size()) - 1;
+}
+
+void Compiler::named_variable_(const TokenRef& name, Expr* value) {
+    OpCode get_op;
+    OpCode set_op;
+
+    int arg = resolve_local_(*current_, name);
+    if (arg != -1) {
+        get_op = OpCode::GET_LOCAL;
+        set_op = OpCode::SET_LOCAL;
+    } else if ((arg = resolve_upvalue_(*current_, name)) != -1) {
+        get_op = OpCode::GET_UPVALUE;
+        set_op = OpCode::SET_UPVALUE;
+    } else {
+        arg = identifier_constant_(name);
+        get_op = OpCode::GET_GLOBAL;
+        set_op = OpCode::SET_GLOBAL;
+    }
+
+    if (value) {
+        compile_(*value);
+        emit_index_(set_op, arg);
+    } else {
+        emit_index_(get_op, arg);
+    }
+}
+
+void Compiler::function_(const FunctionDeclStatement& stmt, FunctionType type) {
+    FunctionState state;
+    state.enclosing = current_;
+    state.type = type;
+    state.function = heap_.allocate<ObjFunction>();
+    state.function->name = heap_.intern(stmt.name.lexeme);
+
+    // Methods find their instance in slot zero.
+    state.locals.push_back(Local{type == FunctionType::Function ? "" : "this", 0, false});
+    current_ = &state;
+
+    begin_scope_();
+    for(const auto& param: stmt.params) {
+        ++state.function->arity;
+        declare_variable_(param);
+        define_variable_(0);
+    }
+
+    for(auto curr: stmt.body) {
+        compile_(*(curr));
+    }
+    emit_return_();
+
+    current_ = state.enclosing;
+    state.function->upvalue_count = static_cast<int>(state.upvalues.size());
+
+    emit_index_(OpCode::CLOSURE, make_constant_(Value::object(state.function)));
+    for(const auto& upvalue: state.upvalues) {
+        emit_(upvalue.is_local ? 1 : 0);
+        emit_short_(upvalue.index);
+    }
+}
+
+void Compiler::error_(const std::string& message) {
+    throw ParserError(message, TokenRef{TokenType::UNDEFINED, "", line_});
+}
+
+} // namespace cpplox
@@ -0,0 +1,130 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Chunk.hpp"
+#include "Expr.hpp"
+#include "Heap.hpp"
+#include "Object.hpp"
+#include "Stmt.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cpplox {
+
+/// Compiles the AST into bytecode for the VM.  Locals live in stack slots and captured variables become upvalues.
+class Compiler: public ExprVisitor,
+                public StmtVisitor {
+private:
+    enum class FunctionType {
+        Script,
+        Function,
+        Method,
+        Initializer
+    };
+
+    /// The name points into the program being compiled, or is one of the names the compiler makes up itself.
+    struct Local {
+        std::string_view name;
+        int depth = -1;
+        bool is_captured = false;
+    };
+
+    struct Upvalue {
+        uint16_t index = 0;
+        bool is_local = false;
+    };
+
+    /// State for the function currently being compiled, functions nest so these form a chain.
+    struct FunctionState {
+        FunctionState*          enclosing = nullptr;
+        ObjFunction*            function = nullptr;
+        FunctionType            type = FunctionType::Script;
+        std::vector<Local>      locals;
+        std::vector<Upvalue>    upvalues;
+        int                     scope_depth = 0;
+
+        // Names get looked up over and over, so each one only takes a single constant slot.
+        std::unordered_map<ObjString*, uint16_t> identifiers;
+    };
+
+    struct ClassState {
+        ClassState* enclosing = nullptr;
+        bool has_super_class = false;
+    };
+
+    Heap&           heap_;
+    FunctionState*  current_ = nullptr;
+    ClassState*     current_class_ = nullptr;
+    int             line_ = 0;
+
+public:
+    Compiler(Heap& heap):
+        heap_{heap} {
+    }
+
+    /// Compiles the statements into a function that runs them as the top-level script.
+    ObjFunction* compile(std::span<Stmt*> stmts);
+
+// ExprVisitor Implementation
+public:
+    void visit(const AssignExpr& expr) override;
+    void visit(const BinaryExpr& expr) override;
+    void visit(const LiteralExpr& expr) override;
+    void visit(const GroupingExpr& expr) override;
+    void visit(const UnaryExpr& expr) override;
+    void visit(const VariableExpr& expr) override;
+    void visit(const LogicalExpr& expr) override;
+    void visit(const CallExpr& expr) override;
+    void visit(const GetExpr& expr) override;
+    void visit(const SetExpr& expr) override;
+    void visit(const ThisExpr& expr) override;
+    void visit(const SuperExpr& expr) override;
+
+// StmtVisitor Implementation
+public:
+    void visit(const PrintStatement& stmt) override;
+    void visit(const ExpressionStatement& stmt) override;
+    void visit(const VariableDeclStatement& stmt) override;
+    void visit(const BlockStatement& stmt) override;
+    void visit(const IfStatement& stmt) override;
+    void visit(const WhileStatement& stmt) override;
+    void visit(const FunctionDeclStatementProxy& stmt_proxy) override;
+    void visit(const ReturnStatement& stmt) override;
+    void visit(const ClassDeclStatement& stmt) override;
+
+// Internal Helpers
+private:
+    Chunk& chunk_();
+    void compile_(Expr& expr);
+    void compile_(Stmt& stmt);
+    void emit_(uint8_t byte);
+    void emit_(OpCode op);
+    void emit_(OpCode op, uint8_t operand);
+    void emit_index_(OpCode op, int index);
+    void emit_short_(uint16_t value);
+    void emit_return_();
+    int emit_jump_(OpCode op);
+    void patch_jump_(int offset);
+    void emit_loop_(int loop_start);
+    uint16_t make_constant_(const Value& value);
+    uint16_t identifier_constant_(const TokenRef& name);
+    void begin_scope_();
+    void end_scope_();
+    void add_local_(const TokenRef& name);
+    void declare_variable_(const TokenRef& name);
+    void mark_initialized_();
+    void define_variable_(uint16_t global);
+    int resolve_local_(FunctionState& state, const TokenRef& name);
+    int resolve_upvalue_(FunctionState& state, const TokenRef& name);
+    int add_upvalue_(FunctionState& state, uint16_t index, bool is_local, const TokenRef& name);
+    void named_variable_(const TokenRef& name, Expr* value);
+    void function_(const FunctionDeclStatement& stmt, FunctionType type);
+    [[noreturn]] void error_(const std::string& message);
+};
+
+} // namespace cpplox
@@ -0,0 +1,522 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "CppEmitter.hpp"
+
+#include "CppRuntime.hpp"
+#include "RuntimeError.hpp"
+#include "TokenType.hpp"
+
+#include <cmath>
+#include <format>
+
+namespace cpplox {
+
+/// A double literal that reads back as exactly value, -0 and NaN keep their sign.
+static std::string number_literal_(double value) {
+    if (std::isnan(value)) {
+        return std::signbit(value) ? "-std::numeric_limits<double>::quiet_NaN()" : "std::numeric_limits<double>::quiet_NaN()";
+    }
+    if (std::isinf(value)) {
+        return value < 0 ? "-std::numeric_limits<double>::infinity()" : "std::numeric_limits<double>::infinity()";
+    }
+
+    auto text = std::format("{}", value);
+    if (text.find_first_of(".e") == std::string::npos) {
+        text += ".0";
+    }
+    return text;
+}
+
+/// Lox strings have no escapes, anything that is not plain printable ASCII goes out as an octal escape.
+static std::string string_literal_(std::string_view chars) {
+    std::string text = "\"";
+    for(auto curr: chars) {
+        auto byte = static_cast<unsigned char>(curr);
+        if (curr == '"' || curr == '\\') {
+            text += '\\';
+            text += curr;
+        } else if (byte < 0x20 || byte >= 0x7f) {
+            text += std::format("\\{:03o}", byte);
+        } else {
+            text += curr;
+        }
+    }
+    text += "\"";
+    return text;
+}
+
+std::string CppEmitter::emit(const FlatAst& ast, std::string_view script) {
+    ast_ = &ast;
+    for(auto stmt: ast.list(ast.first_statement, ast.statement_count)) {
+        find_captures_(stmt, no_node);
+    }
+
+    statements_(ast.first_statement, ast.statement_count);
+
+    std::stringstream unit;
+    unit << "// Generated by cpplox --emit-cpp from " << script << ".\n";
+    unit << cpp_runtime << "\n";
+    unit << "namespace {\n\n";
+
+    // clock is the one global there is before the script runs.
+    for(const auto& [name, global]: globals_) {
+        if (name == "clock") {
+            unit << "lox::Global " << global << "{\"clock\", lox::Value{std::make_shared<lox::Native>(0, lox::clock)}};\n";
+        } else {
+            unit << "lox::Global " << global << "{\"" << name << "\"};\n";
+        }
+    }
+    for(const auto& [chars, constant]: strings_) {
+        unit << "const lox::Value " << constant << " = lox::string(" << string_literal_(chars) << ");\n";
+    }
+
+    unit << "\nvoid run() {\n" << body_.str() << "}\n\n";
+    unit << "} // namespace\n\n";
+    unit << "int main() {\n"
+            "    try {\n"
+            "        run();\n"
+            "    } catch (const std::exception& error) {\n"
+            "        std::printf(\"Caught exception: %s\\n\", error.what());\n"
+            "    }\n"
+            "    return 0;\n"
+            "}\n";
+    return unit.str();
+}
+
+void CppEmitter::find_captures_(NodeIndex node, NodeIndex home) {
+    auto& ast = *ast_;
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Block: {
+            auto block_home = ast.has_environment(node) ? node : home;
+            ast.for_each_child(node, [&](NodeIndex child) { find_captures_(child, block_home); });
+            break;
+        }
+
+        case NodeKind::FunctionDecl:
+            find_captures_in_function_(node, home);
+            break;
+
+        case NodeKind::ClassDecl:
+            if (ast.a[node] != no_node) {
+                find_captures_(ast.a[node], home);
+            }
+            for(auto method: ast.list(ast.b[node], ast.c[node])) {
+                find_captures_in_function_(method, home);
+            }
+            break;
+
+        default:
+            ast.for_each_child(node, [&](NodeIndex child) { find_captures_(child, home); });
+            break;
+    }
+}
+
+void CppEmitter::find_captures_in_function_(NodeIndex node, NodeIndex home) {
+    // The function's closures capture these locals of the environment it is declared in.
+    for(uint32_t i = 0; i < ast_->capture_count(node); ++i) {
+        auto capture = ast_->capture(node, i);
+        if (capture.local) {
+            captured_.emplace(home, capture.index);
+        }
+    }
+
+    auto body = ast_->c[node];
+    for(auto stmt: ast_->list(ast_->a[body], ast_->b[body])) {
+        find_captures_(stmt, node);
+    }
+}
+
+void CppEmitter::statements_(uint32_t first, uint32_t count) {
+    for(auto stmt: ast_->list(first, count)) {
+        statement_(stmt);
+    }
+}
+
+void CppEmitter::statement_(NodeIndex node) {
+    auto& ast = *ast_;
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Print:
+            line_(std::format("lox::print({});", expression_(ast.a[node])));
+            break;
+
+        case NodeKind::Expression:
+            line_(std::format("static_cast<void>({});", expression_(ast.a[node])));
+            break;
+
+        case NodeKind::VariableDecl: {
+            auto initializer = ast.a[node] != no_node ? expression_(ast.a[node]) : "lox::Value()";
+            if (scopes_.empty()) {
+                line_(std::format("{}.define({});", global_(ast.name(node)), initializer));
+            } else {
+                declare_(ast.name(node), initializer);
+            }
+            break;
+        }
+
+        case NodeKind::Block:
+            line_("{");
+            ++indent_;
+            if (ast.has_environment(node)) {
+                scopes_.push_back(Scope{node, {}, {}});
+                statements_(ast.a[node], ast.b[node]);
+                scopes_.pop_back();
+            } else {
+                // The Resolver gave the block's locals slots in the enclosing scope, free again once it ends.
+                auto slot_count = scopes_.empty() ? 0 : scopes_.back().names.size();
+                statements_(ast.a[node], ast.b[node]);
+                if (!scopes_.empty()) {
+                    scopes_.back().names.resize(slot_count);
+                }
+            }
+            --indent_;
+            line_("}");
+            break;
+
+        case NodeKind::If:
+            line_(std::format("if (lox::truthy({})) {{", expression_(ast.a[node])));
+            ++indent_;
+            statement_(ast.b[node]);
+            --indent_;
+            if (ast.c[node] != no_node) {
+                line_("} else {");
+                ++indent_;
+                statement_(ast.c[node]);
+                --indent_;
+            }
+            line_("}");
+            break;
+
+        case NodeKind::While:
+            line_(std::format("while (lox::truthy({})) {{", expression_(ast.a[node])));
+            ++indent_;
+            statement_(ast.b[node]);
+            --indent_;
+            line_("}");
+            break;
+
+        case NodeKind::FunctionDecl:
+            function_decl_(node);
+            break;
+
+        case NodeKind::Return: {
+            //
+            // init hands back the instance, even from an early return.  A call in tail position runs once this
+            // function has returned, see lox::tail_call.
+            //
+            if (ast.b[node] != no_node) {
+                line_(std::format("return {};", call_(ast.b[node], "tail_call")));
+                break;
+            }
+
+            auto result = ast.a[node] != no_node ? expression_(ast.a[node]) : "lox::Value()";
+            if (initializers_.empty() || initializers_.back().empty()) {
+                line_(std::format("return {};", result));
+            } else {
+                if (ast.a[node] != no_node) {
+                    line_(std::format("static_cast<void>({});", result));
+                }
+                line_(std::format("return {};", initializers_.back()));
+            }
+            break;
+        }
+
+        case NodeKind::ClassDecl:
+            class_decl_(node);
+            break;
+
+        default:
+            throw RuntimeError(std::format("Can not emit C++ for the statement at line {}.", ast.line(node)));
+    }
+}
+
+void CppEmitter::function_decl_(NodeIndex node) {
+    //
+    // A local function is declared before its lambda is made, so the function can call itself through the box.
+    //
+    auto name = ast_->name(node);
+    std::string target;
+    if (scopes_.empty()) {
+        body_ << indentation_() << global_(name) << ".define(";
+    } else {
+        target = declare_(name, "lox::Value()");
+        if (is_boxed_(scopes_.back(), static_cast<uint32_t>(scopes_.back().names.size() - 1))) {
+            target = "*" + target;
+        }
+        body_ << indentation_() << target << " = ";
+    }
+
+    body_ << std::format("lox::function(\"{}\", {}, ", name, ast_->b[node]);
+    lambda_(node, "", false);
+    body_ << (scopes_.empty() ? "));\n" : ");\n");
+}
+
+void CppEmitter::class_decl_(NodeIndex node) {
+    auto& ast = *ast_;
+    auto name = ast.name(node);
+
+    // The name is declared before the methods, they may use the class through it.
+    std::string target;
+    if (!scopes_.empty()) {
+        target = declare_(name, "lox::Value()");
+        if (is_boxed_(scopes_.back(), static_cast<uint32_t>(scopes_.back().names.size() - 1))) {
+            target = "*" + target;
+        }
+    }
+
+    line_("{");
+    ++indent_;
+
+    //
+    // Methods get their receiver as the lambda's first parameter.  "super" means the class's super class in them,
+    // and in the functions nested in them, which capture it along with everything else.
+    //
+    auto klass = unique_("class");
+    std::string super_class;
+    if (ast.a[node] != no_node) {
+        super_class = unique_("super");
+        line_(std::format("lox::Value {} = {};", super_class, expression_(ast.a[node])));
+        line_(std::format("auto {} = lox::make_subclass(\"{}\", {});", klass, name, super_class));
+    } else {
+        line_(std::format("auto {} = lox::make_class(\"{}\");", klass, name));
+    }
+
+    super_classes_.push_back(super_class);
+    auto receiver = unique_("receiver");
+    for(auto method: ast.list(ast.b[node], ast.c[node])) {
+        auto method_name = ast.name(method);
+        body_ << indentation_()
+              << std::format("{}->methods[\"{}\"] = lox::method(\"{}\", {}, ", klass, method_name, method_name, ast.b[method]);
+        lambda_(method, receiver, method_name == "init");
+        body_ << ");\n";
+    }
+    super_classes_.pop_back();
+
+    if (target.empty()) {
+        line_(std::format("{}.define(lox::Value{{{}}});", global_(name), klass));
+    } else {
+        line_(std::format("{} = lox::Value{{{}}};", target, klass));
+    }
+
+    --indent_;
+    line_("}");
+}
+
+void CppEmitter::lambda_(NodeIndex node, const std::string& receiver, bool initializer) {
+    auto& ast = *ast_;
+    auto body = ast.c[node];
+
+    body_ << std::format("[=](const lox::Value&{}{}, const lox::Value* args) -> lox::Value {{\n", receiver.empty() ? "" : " ",
+                         receiver);
+    ++indent_;
+    initializers_.push_back(initializer ? receiver : "");
+
+    // The upvalues are the boxes of the enclosing function's locals, or its own upvalues.
+    Scope scope{node, {}, {}};
+    for(uint32_t i = 0; i < ast.capture_count(node); ++i) {
+        auto capture = ast.capture(node, i);
+        const auto& enclosing = scopes_.back();
+        scope.upvalues.push_back(capture.local ? enclosing.names[capture.index] : enclosing.upvalues[capture.index]);
+    }
+    scopes_.push_back(std::move(scope));
+
+    // A method's receiver is "this", in the slot before the params.
+    if (!receiver.empty()) {
+        declare_("this", receiver);
+    }
+    uint32_t index = 0;
+    for(auto param: ast.list(ast.a[node], ast.b[node])) {
+        declare_(ast.name_table[param], std::format("args[{}]", index++));
+    }
+    statements_(ast.a[body], ast.b[body]);
+
+    // Falling off the end returns nil, or the instance from init.
+    auto last = ast.b[body] ? ast.lists[ast.a[body] + ast.b[body] - 1] : no_node;
+    if (last == no_node || ast.kinds[last] != NodeKind::Return) {
+        line_(std::format("return {};", initializer ? receiver : "lox::Value()"));
+    }
+
+    scopes_.pop_back();
+    initializers_.pop_back();
+    --indent_;
+    body_ << indentation_() << "}";
+}
+
+std::string CppEmitter::expression_(NodeIndex node) {
+    auto& ast = *ast_;
+    auto kind = ast.kinds[node];
+    if (is_binary(kind)) {
+        return binary_(node);
+    }
+
+    switch (kind) {
+        case NodeKind::Literal:
+            return literal_(node);
+
+        case NodeKind::Grouping:
+            return expression_(ast.a[node]);
+
+        case NodeKind::Unary:
+            if (static_cast<TokenType>(ast.c[node]) == TokenType::MINUS) {
+                return std::format("lox::negate({})", expression_(ast.a[node]));
+            }
+            return std::format("lox::logical_not({})", expression_(ast.a[node]));
+
+        case NodeKind::Variable:
+            return is_global_(node) ? global_(ast.name(node)) + ".get()" : local_(node);
+
+        case NodeKind::Assign:
+            if (is_global_(node)) {
+                return std::format("{}.assign({})", global_(ast.name(node)), expression_(ast.a[node]));
+            }
+            return std::format("({} = {})", local_(node), expression_(ast.a[node]));
+
+        case NodeKind::Logical:
+            return logical_(node);
+
+        case NodeKind::Call:
+            return call_(node);
+
+        case NodeKind::Get:
+            return std::format("lox::get({}, \"{}\")", expression_(ast.a[node]), ast.name(node));
+
+        case NodeKind::Set:
+            return std::format("lox::set({{{}, {}}}, \"{}\")", expression_(ast.a[node]), expression_(ast.b[node]),
+                               ast.name(node));
+
+        case NodeKind::This:
+            return local_(node);
+
+        case NodeKind::Super:
+            return super_(node);
+
+        default:
+            throw RuntimeError(std::format("Can not emit C++ for the expression at line {}.", ast.line(node)));
+    }
+}
+
+std::string CppEmitter::literal_(NodeIndex node) {
+    const auto& literal = ast_->literals[ast_->a[node]];
+
+    switch (literal.index()) {
+        case 1: {
+            // Strings are made once, before the script runs.
+            auto chars = std::get<std::string_view>(literal);
+            auto& constant = strings_[chars];
+            if (constant.empty()) {
+                constant = std::format("s{}", strings_.size() - 1);
+            }
+            return constant;
+        }
+
+        case 2:
+            return std::format("lox::number({})", number_literal_(std::get<double>(literal)));
+
+        case 3:
+            return std::get<bool>(literal) ? "lox::boolean(true)" : "lox::boolean(false)";
+
+        default:
+            return "lox::Value()";
+    }
+}
+
+std::string CppEmitter::binary_(NodeIndex node) {
+    const char* function = nullptr;
+    switch (static_cast<TokenType>(ast_->c[node])) {
+        case TokenType::PLUS:           function = "add"; break;
+        case TokenType::MINUS:          function = "subtract"; break;
+        case TokenType::STAR:           function = "multiply"; break;
+        case TokenType::SLASH:          function = "divide"; break;
+        case TokenType::LESS:           function = "less"; break;
+        case TokenType::LESS_EQUAL:     function = "less_equal"; break;
+        case TokenType::GREATER:        function = "greater"; break;
+        case TokenType::GREATER_EQUAL:  function = "greater_equal"; break;
+        case TokenType::EQUAL_EQUAL:    function = "equal"; break;
+        case TokenType::BANG_EQUAL:     function = "not_equal"; break;
+        default:
+            throw RuntimeError(std::format("Can not emit C++ for the operator at line {}.", ast_->line(node)));
+    }
+
+    return std::format("lox::{}({{{}, {}}})", function, expression_(ast_->a[node]), expression_(ast_->b[node]));
+}
+
+std::string CppEmitter::logical_(NodeIndex node) {
+    // The left side is the result when it decides the outcome, the right side is only evaluated otherwise.
+    bool is_or = static_cast<TokenType>(ast_->c[node]) == TokenType::OR;
+    return std::format("[&]() -> lox::Value {{ lox::Value left = {}; if ({}lox::truthy(left)) {{ return left; }} "
+                       "return {}; }}()",
+                       expression_(ast_->a[node]), is_or ? "" : "!", expression_(ast_->b[node]));
+}
+
+std::string CppEmitter::call_(NodeIndex node, std::string_view function) {
+    auto& ast = *ast_;
+    auto text = std::format("lox::{}({}, {{{}", function, ast.line(node), expression_(ast.a[node]));
+    for(auto arg: ast.list(ast.b[node], ast.c[node])) {
+        text += ", " + expression_(arg);
+    }
+    return text + "})";
+}
+
+std::string CppEmitter::super_(NodeIndex node) {
+    if (is_global_(node)) {
+        return "lox::no_super()";
+    }
+
+    // The node resolved to "this", the super class is the one of the class whose method this is.
+    return std::format("lox::super_method({}, {}, \"{}\")", super_classes_.back(), local_(node), ast_->name(node));
+}
+
+std::string CppEmitter::declare_(std::string_view name, const std::string& initializer) {
+    auto& scope = scopes_.back();
+    auto local = unique_(name);
+    if (is_boxed_(scope, static_cast<uint32_t>(scope.names.size()))) {
+        line_(std::format("auto {} = std::make_shared<lox::Value>({});", local, initializer));
+    } else {
+        line_(std::format("lox::Value {} = {};", local, initializer));
+    }
+
+    scope.names.push_back(local);
+    return local;
+}
+
+std::string CppEmitter::unique_(std::string_view name) {
+    return std::format("v{}_{}", next_id_++, name);
+}
+
+std::string CppEmitter::local_(NodeIndex node) const {
+    auto resolved = ast_->resolved(node);
+    auto slot = static_cast<uint32_t>(resolved.slot);
+    const auto& scope = scopes_.back();
+    if (resolved.is_upvalue()) {
+        return "(*" + scope.upvalues[slot] + ")";
+    }
+
+    const auto& local = scope.names[slot];
+    return is_boxed_(scope, slot) ? "(*" + local + ")" : local;
+}
+
+bool CppEmitter::is_boxed_(const Scope& scope, uint32_t slot) const {
+    return captured_.contains({scope.node, slot});
+}
+
+bool CppEmitter::is_global_(NodeIndex node) const {
+    return ast_->resolved(node).is_global();
+}
+
+std::string CppEmitter::global_(std::string_view name) {
+    auto& global = globals_[name];
+    if (global.empty()) {
+        global = std::format("g_{}", name);
+    }
+    return global;
+}
+
+void CppEmitter::line_(std::string_view text) {
+    body_ << indentation_() << text << "\n";
+}
+
+std::string CppEmitter::indentation_() const {
+    return std::string(indent_ * 4, ' ');
+}
+
+} // namespace cpplox
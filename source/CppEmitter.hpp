@@ -0,0 +1,100 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "FlatAst.hpp"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cpplox {
+
+/// Translates a resolved program into a standalone C++ translation unit, which builds into a native binary that
+/// prints what the tree-walk interpreter would.
+///
+/// Locals become C++ locals and functions become lambdas.  A local that a nested function uses is kept in a
+/// shared box, so the function and the scope that declared it see the same variable.  Globals are statics that
+/// remember whether their declaration has run yet.  Operands and arguments are built with braced lists, which C++
+/// evaluates left to right, as the interpreter does.
+class CppEmitter {
+private:
+    /// The locals of one environment, a function's or a top-level block's.
+    struct Scope {
+        /// The FunctionDecl or Block the environment is for.
+        NodeIndex node = no_node;
+
+        /// The C++ name of each slot, filled in as the locals are declared.
+        std::vector<std::string> names;
+
+        /// For a function, the C++ names of the boxes its upvalues are.  The lambda captures them.
+        std::vector<std::string> upvalues;
+    };
+
+    const FlatAst* ast_ = nullptr;
+    std::vector<Scope> scopes_;
+
+    /// The locals a nested function uses, by the node of their scope and their slot.
+    std::set<std::pair<NodeIndex, uint32_t>> captured_;
+
+    /// The C++ name of the super class of the class whose methods are being emitted, empty when it has none.
+    std::vector<std::string> super_classes_;
+
+    /// The C++ names of the globals by their Lox names, and of the string constants by their characters.
+    std::map<std::string_view, std::string> globals_;
+    std::map<std::string_view, std::string> strings_;
+
+    /// The receiver of the initializer being emitted, empty inside any other function.
+    std::vector<std::string> initializers_;
+
+    std::stringstream body_;
+    int indent_ = 1;
+    uint32_t next_id_ = 0;
+
+public:
+    /// Returns the translation unit, script names the file it came from.
+    std::string emit(const FlatAst& ast, std::string_view script);
+
+// Internal Helpers
+private:
+    /// Finds the locals the functions declared in node capture, home is the environment node runs in.
+    void find_captures_(NodeIndex node, NodeIndex home);
+    void find_captures_in_function_(NodeIndex node, NodeIndex home);
+
+    void statements_(uint32_t first, uint32_t count);
+    void statement_(NodeIndex node);
+    void function_decl_(NodeIndex node);
+    void class_decl_(NodeIndex node);
+
+    /// Writes a function as a lambda, receiver names its first parameter when it is a method.
+    void lambda_(NodeIndex node, const std::string& receiver, bool initializer);
+
+    std::string expression_(NodeIndex node);
+    std::string literal_(NodeIndex node);
+    std::string binary_(NodeIndex node);
+    std::string logical_(NodeIndex node);
+    /// A call through lox::call, or through lox::tail_call when it is in tail position.
+    std::string call_(NodeIndex node, std::string_view function = "call");
+    std::string super_(NodeIndex node);
+
+    /// Declares the next local of the innermost scope and returns its C++ name.
+    std::string declare_(std::string_view name, const std::string& initializer);
+
+    /// Makes a name for a local that no Lox name can collide with.
+    std::string unique_(std::string_view name);
+
+    /// The C++ expression for the local or upvalue a Variable, Assign, This or Super node resolved to.
+    std::string local_(NodeIndex node) const;
+    bool is_boxed_(const Scope& scope, uint32_t slot) const;
+    bool is_global_(NodeIndex node) const;
+    std::string global_(std::string_view name);
+
+    void line_(std::string_view text);
+    std::string indentation_() const;
+};
+
+} // namespace cpplox
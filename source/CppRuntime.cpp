@@ -0,0 +1,547 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "CppRuntime.hpp"
+
+namespace cpplox {
+
+const std::string_view cpp_runtime = R"runtime(
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <format>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace lox {
+
+struct RuntimeError: std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+enum class Kind: unsigned char {
+    String,
+    Function,
+    Native,
+    Class,
+    Instance
+};
+
+struct Object {
+    Kind kind;
+
+    explicit Object(Kind kind): kind{kind} {
+    }
+
+    virtual ~Object() = default;
+    virtual std::string str() const = 0;
+};
+
+/// nil, a boolean, a number or a reference counted object.
+struct Value {
+    enum class Type: unsigned char {
+        Nil,
+        Bool,
+        Number,
+        Object
+    };
+
+    Type type = Type::Nil;
+    union {
+        bool boolean;
+        double number = 0;
+    };
+    std::shared_ptr<Object> object;
+
+    Value() {
+    }
+
+    explicit Value(std::shared_ptr<Object> object): type{Type::Object}, object{std::move(object)} {
+    }
+
+    bool is_object(Kind kind) const {
+        return type == Type::Object && object->kind == kind;
+    }
+
+    template<typename T>
+    T* as() const {
+        return static_cast<T*>(object.get());
+    }
+};
+
+inline Value boolean(bool value) {
+    Value result;
+    result.type = Value::Type::Bool;
+    result.boolean = value;
+    return result;
+}
+
+inline Value number(double value) {
+    Value result;
+    result.type = Value::Type::Number;
+    result.number = value;
+    return result;
+}
+
+struct String: Object {
+    std::string chars;
+
+    explicit String(std::string chars): Object{Kind::String}, chars{std::move(chars)} {
+    }
+
+    std::string str() const override {
+        return chars;
+    }
+};
+
+inline Value string(std::string chars) {
+    return Value{std::make_shared<String>(std::move(chars))};
+}
+
+/// A function, or a method, which gets its receiver as the first argument of body.
+struct Function: Object {
+    using Body = std::function<Value(const Value& receiver, const Value* args)>;
+
+    std::string_view name;
+    int arity = 0;
+    bool initializer = false;
+    Body body;
+
+    /// Set once the method has been read off an instance.
+    Value receiver;
+
+    Function(std::string_view name, int arity, bool initializer, Body body):
+        Object{Kind::Function}, name{name}, arity{arity}, initializer{initializer}, body{std::move(body)} {
+    }
+
+    std::string str() const override {
+        return std::format("<fn {}>", name);
+    }
+};
+
+inline Value function(std::string_view name, int arity, Function::Body body) {
+    return Value{std::make_shared<Function>(name, arity, false, std::move(body))};
+}
+
+inline std::shared_ptr<Function> method(std::string_view name, int arity, Function::Body body) {
+    return std::make_shared<Function>(name, arity, name == "init", std::move(body));
+}
+
+struct Native: Object {
+    int arity = 0;
+    Value (*function)() = nullptr;
+
+    Native(int arity, Value (*function)()): Object{Kind::Native}, arity{arity}, function{function} {
+    }
+
+    std::string str() const override {
+        return "<native fn>";
+    }
+};
+
+inline Value clock() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return number(std::chrono::duration<double>(now).count());
+}
+
+/// Methods are flattened when the class is declared, a class starts with a copy of its super class's methods.
+struct Class: Object {
+    std::string_view name;
+    std::unordered_map<std::string_view, std::shared_ptr<Function>> methods;
+
+    explicit Class(std::string_view name): Object{Kind::Class}, name{name} {
+    }
+
+    Function* find_method(std::string_view method) const {
+        auto found = methods.find(method);
+        return found == methods.end() ? nullptr : found->second.get();
+    }
+
+    std::string str() const override {
+        return std::string(name);
+    }
+};
+
+/// Property names are string literals in the program, so the fields can be keyed by views of them.
+struct Instance: Object {
+    std::shared_ptr<Class> klass;
+    std::unordered_map<std::string_view, Value> fields;
+
+    explicit Instance(std::shared_ptr<Class> klass): Object{Kind::Instance}, klass{std::move(klass)} {
+    }
+
+    std::string str() const override {
+        return std::string(klass->name) + " instance";
+    }
+};
+
+inline std::shared_ptr<Class> make_class(std::string_view name) {
+    return std::make_shared<Class>(name);
+}
+
+inline std::shared_ptr<Class> make_subclass(std::string_view name, const Value& super_class) {
+    if (!super_class.is_object(Kind::Class)) {
+        throw RuntimeError("The superclass is not a class.");
+    }
+
+    auto klass = std::make_shared<Class>(name);
+    klass->methods = super_class.as<Class>()->methods;
+    return klass;
+}
+
+/// A global variable, which has to be defined before it is read or assigned.
+struct Global {
+    const char* name;
+    bool defined = false;
+    Value value;
+
+    explicit Global(const char* name): name{name} {
+    }
+
+    Global(const char* name, Value value): name{name}, defined{true}, value{std::move(value)} {
+    }
+
+    const Value& get() const {
+        if (!defined) {
+            undefined_();
+        }
+        return value;
+    }
+
+    Value assign(Value assigned) {
+        if (!defined) {
+            undefined_();
+        }
+        value = std::move(assigned);
+        return value;
+    }
+
+    void define(Value defined_value) {
+        value = std::move(defined_value);
+        defined = true;
+    }
+
+    [[noreturn]] void undefined_() const {
+        throw RuntimeError(std::string("Undefined variable: ") + name);
+    }
+};
+
+inline std::string stringify(const Value& value) {
+    switch (value.type) {
+        case Value::Type::Nil:
+            return "nil";
+        case Value::Type::Bool:
+            return value.boolean ? "true" : "false";
+        case Value::Type::Number:
+            return std::format("{}", value.number);
+        default:
+            return value.object->str();
+    }
+}
+
+inline void print(const Value& value) {
+    auto text = stringify(value);
+    text += '\n';
+    std::fwrite(text.data(), 1, text.size(), stdout);
+}
+
+inline bool truthy(const Value& value) {
+    return !(value.type == Value::Type::Nil || (value.type == Value::Type::Bool && !value.boolean));
+}
+
+inline Value logical_not(const Value& value) {
+    return boolean(!truthy(value));
+}
+
+inline Value negate(const Value& value) {
+    if (value.type != Value::Type::Number) {
+        throw RuntimeError("Operand must be a number.");
+    }
+    return number(-value.number);
+}
+
+/// The operands of a binary operator.  The program builds them with a braced list, which evaluates the left side
+/// before the right side as the interpreter does.
+struct Operands {
+    Value lhs;
+    Value rhs;
+
+    bool numbers() const {
+        return lhs.type == Value::Type::Number && rhs.type == Value::Type::Number;
+    }
+
+    void check_numbers() const {
+        if (!numbers()) {
+            throw RuntimeError("Operands must be numbers.");
+        }
+    }
+};
+
+inline Value add(const Operands& operands) {
+    if (operands.numbers()) {
+        return number(operands.lhs.number + operands.rhs.number);
+    }
+    if (operands.lhs.is_object(Kind::String) && operands.rhs.is_object(Kind::String)) {
+        return string(operands.lhs.as<String>()->chars + operands.rhs.as<String>()->chars);
+    }
+    throw RuntimeError("Operands must be two numbers or two strings.");
+}
+
+inline Value subtract(const Operands& operands) {
+    operands.check_numbers();
+    return number(operands.lhs.number - operands.rhs.number);
+}
+
+inline Value multiply(const Operands& operands) {
+    operands.check_numbers();
+    return number(operands.lhs.number * operands.rhs.number);
+}
+
+inline Value divide(const Operands& operands) {
+    operands.check_numbers();
+    return number(operands.lhs.number / operands.rhs.number);
+}
+
+inline Value less(const Operands& operands) {
+    operands.check_numbers();
+    return boolean(operands.lhs.number < operands.rhs.number);
+}
+
+inline Value less_equal(const Operands& operands) {
+    operands.check_numbers();
+    return boolean(operands.lhs.number <= operands.rhs.number);
+}
+
+inline Value greater(const Operands& operands) {
+    operands.check_numbers();
+    return boolean(operands.lhs.number > operands.rhs.number);
+}
+
+inline Value greater_equal(const Operands& operands) {
+    operands.check_numbers();
+    return boolean(operands.lhs.number >= operands.rhs.number);
+}
+
+/// Numbers compare as doubles, strings by their characters and other objects by identity.
+inline bool is_equal(const Value& a, const Value& b) {
+    if (a.type != b.type) {
+        return false;
+    }
+
+    switch (a.type) {
+        case Value::Type::Nil:
+            return true;
+        case Value::Type::Bool:
+            return a.boolean == b.boolean;
+        case Value::Type::Number:
+            return a.number == b.number;
+        default:
+            if (a.is_object(Kind::String) && b.is_object(Kind::String)) {
+                return a.as<String>()->chars == b.as<String>()->chars;
+            }
+            return a.object == b.object;
+    }
+}
+
+inline Value equal(const Operands& operands) {
+    return boolean(is_equal(operands.lhs, operands.rhs));
+}
+
+inline Value not_equal(const Operands& operands) {
+    return boolean(!is_equal(operands.lhs, operands.rhs));
+}
+
+inline Value bind(const Function& method, const Value& receiver) {
+    auto bound = std::make_shared<Function>(method);
+    bound->receiver = receiver;
+    return Value{std::move(bound)};
+}
+
+/// The object of a property, checked to be an instance before anything else is evaluated.
+struct Receiver {
+    Value object;
+
+    Receiver(Value value): object{std::move(value)} {
+        if (!object.is_object(Kind::Instance)) {
+            throw RuntimeError("Only object instances have properties.");
+        }
+    }
+
+    Instance* instance() const {
+        return object.as<Instance>();
+    }
+};
+
+inline Value get(const Receiver& receiver, std::string_view name) {
+    auto instance = receiver.instance();
+    if (auto field = instance->fields.find(name); field != instance->fields.end()) {
+        return field->second;
+    }
+    if (auto method = instance->klass->find_method(name)) {
+        return bind(*method, receiver.object);
+    }
+    throw RuntimeError(std::format("Field/method is unknown: {}", name));
+}
+
+/// The instance and the value of a set, in the order they are evaluated.
+struct Assignment {
+    Receiver receiver;
+    Value value;
+};
+
+inline Value set(const Assignment& assignment, std::string_view name) {
+    assignment.receiver.instance()->fields[name] = assignment.value;
+    return assignment.value;
+}
+
+inline Value super_method(const Value& super_class, const Value& receiver, std::string_view name) {
+    if (!super_class.is_object(Kind::Class) || !receiver.is_object(Kind::Instance)) {
+        throw RuntimeError("Could not find 'super' in environment.");
+    }
+    if (auto method = super_class.as<Class>()->find_method(name)) {
+        return bind(*method, receiver);
+    }
+    throw RuntimeError(std::format("Field/method is unknown: {}", name));
+}
+
+[[noreturn]] inline Value no_super() {
+    throw RuntimeError("Could not find 'super' in environment.");
+}
+
+inline void check_arity(int arity, size_t arg_count) {
+    if (static_cast<size_t>(arity) != arg_count) {
+        throw RuntimeError(std::format("Expected {} arguments but got {}.", arity, arg_count));
+    }
+}
+
+/// Lox calls may nest as deep as on the interpreter, as long as the native stack has room for them.
+inline constexpr size_t max_call_depth = 100'000;
+
+/// How much of the native stack to leave for the deepest call's expressions and for unwinding, at most half.
+inline constexpr uintptr_t stack_reserve = 1024 * 1024;
+
+/// Counts a call for as long as it runs.  A call nested too deep, or too close to the end of the native stack,
+/// fails with the interpreter's stack overflow error instead of crashing.
+class CallDepth {
+private:
+    static inline size_t depth_ = 0;
+    static inline uintptr_t stack_limit_ = 0;
+
+public:
+    CallDepth() {
+        char here;
+        auto address = reinterpret_cast<uintptr_t>(&here);
+        if (stack_limit_ == 0) {
+            auto size = stack_size_();
+            stack_limit_ = address - size + std::min(stack_reserve, size / 2);
+        }
+        if (depth_ == max_call_depth || address < stack_limit_) {
+            throw RuntimeError("Stack overflow.");
+        }
+        ++depth_;
+    }
+
+    CallDepth(const CallDepth&) = delete;
+    CallDepth& operator=(const CallDepth&) = delete;
+
+    ~CallDepth() {
+        --depth_;
+    }
+
+private:
+    /// The size the native stack may grow to, counted from the first call, which is close to its top.
+    static uintptr_t stack_size_() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_STACK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+            return 8 * 1024 * 1024;
+        }
+        return static_cast<uintptr_t>(limit.rlim_cur);
+    }
+};
+
+/// A call in tail position that is left for the caller's caller to make, once the caller has returned.
+///
+/// The arguments go in one buffer that every tail call reuses, so a tail call allocates nothing once it has grown.
+/// A function copies its arguments into its parameters before it runs anything else, by the time it can make a
+/// tail call of its own it is done with the buffer.
+struct TailCall {
+    Value callee;
+    std::vector<Value> args;
+};
+
+inline TailCall pending_tail_call;
+
+/// Runs a function, then every tail call it leaves behind in its place, so tail recursion runs in constant stack.
+inline Value run_function(const Function& function, const Value* args) {
+    Value result = function.body(function.receiver, args);
+    while (pending_tail_call.callee.type == Value::Type::Object) {
+        Value callee = std::move(pending_tail_call.callee);
+        pending_tail_call.callee = Value();
+
+        auto next = callee.as<Function>();
+        result = next->body(next->receiver, pending_tail_call.args.data());
+    }
+    return result;
+}
+
+/// Calls the first value with the rest as arguments, they were all evaluated left to right.
+inline Value call(int line, std::initializer_list<Value> callee_and_args) {
+    CallDepth depth;
+    const auto& callee = *callee_and_args.begin();
+    const Value* args = callee_and_args.begin() + 1;
+    size_t arg_count = callee_and_args.size() - 1;
+
+    if (callee.is_object(Kind::Function)) {
+        auto function = callee.as<Function>();
+        check_arity(function->arity, arg_count);
+        return run_function(*function, args);
+    }
+
+    if (callee.is_object(Kind::Native)) {
+        auto native = callee.as<Native>();
+        check_arity(native->arity, arg_count);
+        return native->function();
+    }
+
+    if (callee.is_object(Kind::Class)) {
+        // Calling a class makes a new instance and runs init on it, if there is one.
+        auto klass = callee.as<Class>();
+        Value instance{std::make_shared<Instance>(std::static_pointer_cast<Class>(callee.object))};
+        auto initializer = klass->find_method("init");
+        check_arity(initializer ? initializer->arity : 0, arg_count);
+        if (initializer) {
+            initializer->body(instance, args);
+        }
+        return instance;
+    }
+
+    throw RuntimeError(std::format("This is not a callable object at line: {}", line));
+}
+
+/// A call in tail position.  A function is only checked here, the caller returns what this returns and the function
+/// runs after it, anything else is called right away.
+inline Value tail_call(int line, std::initializer_list<Value> callee_and_args) {
+    const auto& callee = *callee_and_args.begin();
+    if (!callee.is_object(Kind::Function)) {
+        return call(line, callee_and_args);
+    }
+
+    check_arity(callee.as<Function>()->arity, callee_and_args.size() - 1);
+    pending_tail_call.callee = callee;
+    pending_tail_call.args.assign(callee_and_args.begin() + 1, callee_and_args.end());
+    return Value();
+}
+
+} // namespace lox
+)runtime";
+
+} // namespace cpplox
@@ -0,0 +1,12 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <string_view>
+
+namespace cpplox {
+
+/// The runtime library every translation unit from --emit-cpp starts with.  It gives values, functions, classes
+/// and instances the semantics of the tree-walk interpreter, objects are reference counted rather than collected.
+extern const std::string_view cpp_runtime;
+
+} // namespace cpplox
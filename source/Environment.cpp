@@ -5,58 +5,41 @@
 
 namespace cpplox {
 
-void Environment::define(const std::string& name, const ValueType& value) {
-    values_[name] = value;
+void EnvironmentPool::grow_() {
+    // The chunks stay for as long as the program runs, their blocks go around the free lists.
+    next_ = static_cast<std::byte*>(::operator new(chunk_size_));
+    end_ = next_ + chunk_size_;
+    ++stats_.chunks;
+    poison_(next_, chunk_size_);
 }
 
-const ValueType& Environment::get(const Token& name) const {
-    auto itr = values_.find(name.lexeme);
-    if (itr == values_.end()) {
-        if (parent_ == nullptr) {
-            std::stringstream stream;
-            stream << "Undefined variable: " << name.lexeme;
-            throw RuntimeError(stream.str());
-        }
-        
-        return parent_->get(name);
-    }
-    
-    return itr->second;
-}
+// ---
 
-const ValueType& Environment::get_at(int distance, const std::string& name) {
-    return ancestor_(distance).values_[name];
-}
+constinit EnvironmentPool Environment::pool_;
 
-void Environment::assign(const Token& name, const ValueType& value) {
-    auto itr = values_.find(name.lexeme);
-    if (itr == values_.end()) {
-        if (parent_ == nullptr) {
-            std::stringstream stream;
-            stream << "Undefined variable: " << name.lexeme;
-            throw RuntimeError(stream.str());
-        }
-        
-        return parent_->assign(name, value);
+Environment::Environment(uint32_t slot_count):
+    Obj{ObjType::Environment},
+    slot_count_{slot_count} {
+    auto slots = values();
+    for(uint32_t i = 0; i < slot_count; ++i) {
+        slots[i] = Value::nil();
     }
-    
-    itr->second = value;
-    
 }
 
-void Environment::assign_at(int distance,
-                            const Token& name,
-                            const ValueType& value) {
-    ancestor_(distance).values_[name.lexeme] = value;
+int Environment::define(const Value& value) {
+    if (defined_ >= slot_count_) {
+        throw RuntimeError("More variables defined than the scope has slots for.");
+    }
+    
+    values()[defined_] = value;
+    return static_cast<int>(defined_++);
 }
 
-Environment& Environment::ancestor_(int distance) {
-    Environment* curr = this;
-    for(int i = 0; i < distance; ++i) {
-        curr = curr->parent_;
+void Environment::trace(Heap& heap) {
+    auto slots = values();
+    for(uint32_t i = 0; i < defined_; ++i) {
+        heap.mark(slots[i]);
     }
-    
-    return *curr;
 }
 
 } // namespace cpplox
@@ -1,43 +1,233 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
-#include "Common.hpp"
+#include "Heap.hpp"
+#include "Object.hpp"
 #include "Token.hpp"
+#include "Value.hpp"
 
-#include <any>
-#include <map>
-#include <memory>
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define CPPLOX_POOL_POISONING 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CPPLOX_POOL_POISONING 1
+#endif
+#endif
+
+#if defined(CPPLOX_POOL_POISONING)
+#include <sanitizer/asan_interface.h>
+#endif
 
 namespace cpplox {
 
-/// The execution environment of the script, will contain sub-environments for things such as functions and class methods.
-class Environment {
+/// How many environments were made and where their memory came from, for --alloc-stats.
+struct EnvironmentStats {
+    size_t environments = 0;
+
+    /// Environments that took the memory of one freed earlier, the rest were carved out of a chunk.
+    size_t reused = 0;
+    size_t chunks = 0;
+
+    /// Environments too big for the pool, or made with it turned off, that came from the global allocator.
+    size_t unpooled = 0;
+};
+
+// ---
+
+/// Hands out the memory environments live in.
+///
+/// Scopes come and go in LIFO order, so a freed block goes on the top of a free list and the next environment
+/// of the same size takes it straight back, while it is still in the cache.  There is one list per slot count,
+/// each block being an environment with room for exactly that many values.  When a list is empty, the block is
+/// bumped off the current chunk.  Chunks are never given back, their blocks are recycled for the rest of the run.
+///
+/// Environments with more slots than pooled_slot_count come from the global allocator, and so do all of them
+/// once the pool is turned off, to compare against.
+class EnvironmentPool {
+public:
+    static constexpr uint32_t pooled_slot_count = 64;
+
+private:
+    static constexpr size_t chunk_size_ = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* free_[pooled_slot_count] = {};
+    std::byte* next_ = nullptr;
+    std::byte* end_ = nullptr;
+    bool enabled_ = true;
+    EnvironmentStats stats_;
+
+public:
+    constexpr EnvironmentPool() = default;
+    EnvironmentPool(const EnvironmentPool&) = delete;
+    EnvironmentPool& operator=(const EnvironmentPool&) = delete;
+
+    /// A block of size bytes for an environment with slot_count slots.
+    void* allocate(size_t size, uint32_t slot_count) {
+        ++stats_.environments;
+        if (!enabled_ || slot_count >= pooled_slot_count) {
+            ++stats_.unpooled;
+            return ::operator new(size);
+        }
+
+        if (auto block = free_[slot_count]; block != nullptr) {
+            free_[slot_count] = block->next;
+            ++stats_.reused;
+            unpoison_(block, size);
+            return block;
+        }
+
+        //
+        // What is left of the chunk when a block does not fit is dropped.  It is smaller than that block, and no
+        // pooled block is much over 500 bytes, so under 1% of a 64 KB chunk goes to waste, and only once per chunk.
+        //
+        if (next_ == nullptr || size > static_cast<size_t>(end_ - next_)) {
+            grow_();
+        }
+
+        auto block = next_;
+        next_ += size;
+        unpoison_(block, size);
+        return block;
+    }
+
+    /// Takes back a block of size bytes that allocate handed out for slot_count slots.
+    void free(void* memory, size_t size, uint32_t slot_count) {
+        if (!enabled_ || slot_count >= pooled_slot_count) {
+            ::operator delete(memory);
+            return;
+        }
+
+        auto block = static_cast<FreeBlock*>(memory);
+        block->next = free_[slot_count];
+        free_[slot_count] = block;
+        poison_(reinterpret_cast<std::byte*>(block + 1), size - sizeof(FreeBlock));
+    }
+
+    /// Sends every environment to the global allocator, for --no-env-pool.  Has to be called before the first one
+    /// is made, since free tells where a block came from by the same test.
+    void disable() {
+        enabled_ = false;
+    }
+
+    const EnvironmentStats& stats() const {
+        return stats_;
+    }
+
+private:
+    void grow_();
+
+    //
+    // Under AddressSanitizer a free block, but for the link to the next one, and what is left of the chunk can
+    // not be touched, so an environment used after its scope ended is still caught.
+    //
+    static void poison_([[maybe_unused]] void* memory, [[maybe_unused]] size_t size) {
+#if defined(CPPLOX_POOL_POISONING)
+        ASAN_POISON_MEMORY_REGION(memory, size);
+#endif
+    }
+
+    static void unpoison_([[maybe_unused]] void* memory, [[maybe_unused]] size_t size) {
+#if defined(CPPLOX_POOL_POISONING)
+        ASAN_UNPOISON_MEMORY_REGION(memory, size);
+#endif
+    }
+};
+
+// ---
+
+/// The execution environment for one call of a function, or one block of top-level code.
+///
+/// The Resolver works out ahead of time how many variables a scope declares and which slot each one lives in,
+/// so the values are just a flat array and variables are found by slot rather than by name.  The array sits right
+/// after the environment, in the same block of the pool.
+///
+/// Closures capture the variables they use as upvalues, never the environment, so every environment dies with its
+/// scope.  The Interpreter owns it and deletes it as soon as the scope ends, once it has closed the upvalues that
+/// point into it.
+class Environment: public Obj {
 private:
-    std::map<std::string, ValueType> values_;
-    Environment* parent_= nullptr;
-    
+    uint32_t slot_count_ = 0;
+    uint32_t defined_ = 0;
+
+    explicit Environment(uint32_t slot_count);
+
 public:
-    Environment(Environment* parent): parent_{parent} {
-    }
-    
-    Environment() {
-    }
-    
-    void set_parent(Environment* parent) {
-        parent_ = parent;
-    }
-    void define(const std::string& name, const ValueType& value);
-    const ValueType& get(const Token& name) const;
-    const ValueType& get_at(int distance, const std::string& name);
-    void assign(const Token& name, const ValueType& value);
-    void assign_at(int distance,
-                   const Token& name,
-                   const ValueType& value);
-                 
-    
+    static Environment* create(int size) {
+        auto slot_count = static_cast<uint32_t>(size);
+        return new (slot_count) Environment(slot_count);
+    }
+
+    /// Variables are defined in the same order the Resolver handed out their slots, returns the slot used.
+    int define(const Value& value);
+
+    /// How many variables are defined so far.
+    uint32_t defined() const {
+        return defined_;
+    }
+
+    /// Forgets the variables past the first count, once the block that defined them in this environment is done.
+    void truncate(uint32_t count) {
+        defined_ = count;
+    }
+
+    /// The slots, which the variables live in for as long as the environment does.
+    Value* values() {
+        return reinterpret_cast<Value*>(this + 1);
+    }
+
+    Value& at(int slot) {
+        return values()[slot];
+    }
+
+    void trace(Heap& heap) override;
+
+    size_t owned_bytes() const override {
+        return slot_count_ * sizeof(Value);
+    }
+
+    /// Every environment comes from, and goes back to, this pool.
+    static EnvironmentPool& pool() {
+        return pool_;
+    }
+
+    //
+    // The block holds the slot count in front of the environment, so delete, which is not told the size, can
+    // put it back on the right list.
+    //
+    static void* operator new(size_t, uint32_t slot_count) {
+        auto block = static_cast<std::byte*>(pool_.allocate(block_size_(slot_count), slot_count));
+        *reinterpret_cast<uint32_t*>(block) = slot_count;
+        return block + block_header_;
+    }
+
+    static void operator delete(void* memory) {
+        auto block = static_cast<std::byte*>(memory) - block_header_;
+        auto slot_count = *reinterpret_cast<uint32_t*>(block);
+        pool_.free(block, block_size_(slot_count), slot_count);
+    }
+
+    static void operator delete(void* memory, uint32_t slot_count) {
+        pool_.free(static_cast<std::byte*>(memory) - block_header_, block_size_(slot_count), slot_count);
+    }
+
 private:
-    Environment& ancestor_(int distance);
-    
+    /// Keeps the environment and its values 8 byte aligned, which is all they need.
+    static constexpr size_t block_header_ = sizeof(uint64_t);
+
+    static constinit EnvironmentPool pool_;
+
+    static size_t block_size_(uint32_t slot_count);
 };
 
+inline size_t Environment::block_size_(uint32_t slot_count) {
+    return block_header_ + sizeof(Environment) + slot_count * sizeof(Value);
+}
+
 } // namespace cpplox
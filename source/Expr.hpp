@@ -1,8 +1,11 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
+#include "Program.hpp"
 #include "Token.hpp"
 
-#include <memory>
+#include <span>
+#include <string_view>
+#include <variant>
 #include <vector>
 
 /// These are the expression objects used throughout the interpter.
@@ -41,32 +44,30 @@ struct ExprVisitor {
     virtual void visit(const SuperExpr& expr) = 0;
 };
 
+/// Nodes live in their Program's arena and are never destroyed one at a time, so they have no virtual destructor
+/// and must stay trivially destructible.
 struct Expr {
     Expr() {
     }
     
-    virtual ~Expr() {
-    }
-    
     virtual void accept(ExprVisitor& visit) = 0;
 };
 
 // ---
 
 struct AssignExpr: public Expr {
-    Token                   name;
-    std::unique_ptr<Expr>   value;
-    
-    AssignExpr(const Token& name,
-               std::unique_ptr<Expr> value): name{name},
-                                             value{std::move(value)} {
+    TokenRef        name;
+    Expr*           value;
+        
+    AssignExpr(const TokenRef& name,
+               Expr* value): name{name},
+                             value{value} {
     }
     
-    static std::unique_ptr<AssignExpr> create(const Token& name,
-                                              std::unique_ptr<Expr> value) {
-        auto ptr = std::make_unique<AssignExpr>(name, std::move(value));
-        
-        return ptr;
+    static AssignExpr* create(Program& program,
+                              const TokenRef& name,
+                              Expr* value) {
+        return program.make<AssignExpr>(name, value);
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -77,16 +78,20 @@ struct AssignExpr: public Expr {
 // ---
 
 struct LiteralExpr: public Expr {
-    TokenValueType value;
+    LiteralValue value;
     
-    LiteralExpr(const TokenValueType& value): value{value} {
+    LiteralExpr(const LiteralValue& value): value{value} {
         
     }
     
-    static std::unique_ptr<LiteralExpr> create(const TokenValueType& value) {
-        auto ptr = std::make_unique<LiteralExpr>(value);
+    static LiteralExpr* create(Program& program, const TokenValueType& value) {
+        if (auto string = std::get_if<std::string_view>(&value)) {
+            return program.make<LiteralExpr>(program.intern(*string));
+        }
         
-        return ptr;
+        return program.make<LiteralExpr>(std::visit([](const auto& alternative) -> LiteralValue {
+            return alternative;
+        }, value));
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -97,25 +102,23 @@ struct LiteralExpr: public Expr {
 // ---
 
 struct BinaryExpr: public Expr {
-    std::unique_ptr<Expr>   left;
-    Token                   operation;
-    std::unique_ptr<Expr>   right;
-    
-    BinaryExpr(std::unique_ptr<Expr> left,
-               const Token& operation,
-               std::unique_ptr<Expr> right): left{std::move(left)},
-                                             operation{operation},
-                                             right{std::move(right)} {
+    Expr*       left;
+    TokenRef    operation;
+    Expr*       right;
+    
+    BinaryExpr(Expr* left,
+               const TokenRef& operation,
+               Expr* right): left{left},
+                             operation{operation},
+                             right{right} {
         
     }
     
-    static std::unique_ptr<BinaryExpr> create(std::unique_ptr<Expr> left,
-                                              const Token& operation,
-                                              std::unique_ptr<Expr> right) {
-        auto ptr = std::make_unique<BinaryExpr>(std::move(left),
-                                                operation,
-                                                std::move(right));
-        return ptr;
+    static BinaryExpr* create(Program& program,
+                              Expr* left,
+                              const Token& operation,
+                              Expr* right) {
+        return program.make<BinaryExpr>(left, program.ref(operation), right);
     }
     
     
@@ -127,15 +130,13 @@ struct BinaryExpr: public Expr {
 // ---
 
 struct GroupingExpr: public Expr {
-    std::unique_ptr<Expr> expression;
+    Expr* expression;
     
-    GroupingExpr(std::unique_ptr<Expr> expression): expression{std::move(expression)} {
+    GroupingExpr(Expr* expression): expression{expression} {
     }
     
-    static std::unique_ptr<GroupingExpr> create(std::unique_ptr<Expr> expression) {
-        auto ptr = std::make_unique<GroupingExpr>(std::move(expression));
-        
-        return ptr;
+    static GroupingExpr* create(Program& program, Expr* expression) {
+        return program.make<GroupingExpr>(expression);
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -146,20 +147,19 @@ struct GroupingExpr: public Expr {
 // ---
 
 struct UnaryExpr: public Expr {
-    Token                   operation;
-    std::unique_ptr<Expr>   right;
+    TokenRef    operation;
+    Expr*       right;
     
-    UnaryExpr(const Token& operation,
-              std::unique_ptr<Expr> right):
+    UnaryExpr(const TokenRef& operation,
+              Expr* right):
         operation{operation},
-        right{std::move(right)} {
+        right{right} {
     }
     
-    static std::unique_ptr<UnaryExpr> create(const Token& token,
-                                             std::unique_ptr<Expr> right) {
-        auto ptr = std::make_unique<UnaryExpr>(token, std::move(right));
-        
-        return ptr;
+    static UnaryExpr* create(Program& program,
+                             const Token& token,
+                             Expr* right) {
+        return program.make<UnaryExpr>(program.ref(token), right);
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -170,14 +170,14 @@ struct UnaryExpr: public Expr {
 // ---
 
 struct VariableExpr: public Expr {
-    Token name;
-    
-    VariableExpr(const Token& name): name{name} {
+    TokenRef name;
+        
+    VariableExpr(const TokenRef& name): name{name} {
         
     }
     
-    static std::unique_ptr<VariableExpr> create(const Token& name) {
-        return std::make_unique<VariableExpr>(name);
+    static VariableExpr* create(Program& program, const Token& name) {
+        return program.make<VariableExpr>(program.ref(name));
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -188,23 +188,24 @@ struct VariableExpr: public Expr {
 // ---
 
 struct LogicalExpr: public Expr {
-    std::unique_ptr<Expr>   left;
-    Token                   operation;
-    std::unique_ptr<Expr>   right;
-    
-    LogicalExpr(std::unique_ptr<Expr> left,
-                Token operation,
-                std::unique_ptr<Expr> right):
-        left{std::move(left)},
-        operation{std::move(operation)},
-        right{std::move(right)} {
+    Expr*       left;
+    TokenRef    operation;
+    Expr*       right;
+    
+    LogicalExpr(Expr* left,
+                const TokenRef& operation,
+                Expr* right):
+        left{left},
+        operation{operation},
+        right{right} {
         
     }
     
-    static std::unique_ptr<LogicalExpr> create(std::unique_ptr<Expr> left,
-                                               Token operation,
-                                               std::unique_ptr<Expr> right) {
-        return std::make_unique<LogicalExpr>(std::move(left), std::move(operation), std::move(right));
+    static LogicalExpr* create(Program& program,
+                               Expr* left,
+                               const Token& operation,
+                               Expr* right) {
+        return program.make<LogicalExpr>(left, program.ref(operation), right);
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -215,23 +216,24 @@ struct LogicalExpr: public Expr {
 // ---
 
 struct CallExpr: public Expr {
-    std::unique_ptr<Expr>               callee;
-    Token                               closing_paren;
-    std::vector<std::unique_ptr<Expr>>  args;
-    
-    CallExpr(std::unique_ptr<Expr> callee,
-             const Token& closing_paren,
-             std::vector<std::unique_ptr<Expr>> args):
-        callee{std::move(callee)},
+    Expr*               callee;
+    TokenRef            closing_paren;
+    std::span<Expr*>    args;
+    
+    CallExpr(Expr* callee,
+             const TokenRef& closing_paren,
+             std::span<Expr*> args):
+        callee{callee},
         closing_paren{closing_paren},
-        args{std::move(args)} {
+        args{args} {
         
     }
     
-    static std::unique_ptr<CallExpr> create(std::unique_ptr<Expr> callee,
-                                            const Token& closing_paren,
-                                            std::vector<std::unique_ptr<Expr>> args) {
-        return std::make_unique<CallExpr>(std::move(callee), closing_paren, std::move(args));
+    static CallExpr* create(Program& program,
+                            Expr* callee,
+                            const Token& closing_paren,
+                            const std::vector<Expr*>& args) {
+        return program.make<CallExpr>(callee, program.ref(closing_paren), program.list(args));
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -242,18 +244,19 @@ struct CallExpr: public Expr {
 // ---
 
 struct GetExpr: public Expr {
-    std::unique_ptr<Expr> object;
-    Token name;
-    
-    GetExpr(std::unique_ptr<Expr> object,
-            const Token& name):
-        object{std::move(object)},
+    Expr*       object;
+    TokenRef    name;
+        
+    GetExpr(Expr* object,
+            const TokenRef& name):
+        object{object},
         name{name} {
     }
     
-    static std::unique_ptr<GetExpr> create(std::unique_ptr<Expr> object,
-                                           const Token& name) {
-        return std::make_unique<GetExpr>(std::move(object), name);
+    static GetExpr* create(Program& program,
+                           Expr* object,
+                           const Token& name) {
+        return program.make<GetExpr>(object, program.ref(name));
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -264,22 +267,23 @@ struct GetExpr: public Expr {
 // ---
 
 struct SetExpr: public Expr {
-    std::unique_ptr<Expr>   object;
-    Token                   name;
-    std::unique_ptr<Expr>   value;
-    
-    SetExpr(std::unique_ptr<Expr> object,
-            const Token& name,
-            std::unique_ptr<Expr> value):
-        object{std::move(object)},
+    Expr*       object;
+    TokenRef    name;
+    Expr*       value;
+        
+    SetExpr(Expr* object,
+            const TokenRef& name,
+            Expr* value):
+        object{object},
         name{name},
-        value{std::move(value)} {
+        value{value} {
     }
     
-    static std::unique_ptr<SetExpr> create(std::unique_ptr<Expr> object,
-                                           const Token& name,
-                                           std::unique_ptr<Expr> value) {
-        return std::make_unique<SetExpr>(std::move(object), name, std::move(value));
+    static SetExpr* create(Program& program,
+                           Expr* object,
+                           const TokenRef& name,
+                           Expr* value) {
+        return program.make<SetExpr>(object, name, value);
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -290,13 +294,13 @@ struct SetExpr: public Expr {
 // ---
 
 struct ThisExpr: public Expr {
-    Token keyword;
-    
-    ThisExpr(const Token& keyword): keyword{keyword} {
+    TokenRef keyword;
+        
+    ThisExpr(const TokenRef& keyword): keyword{keyword} {
     }
     
-    static std::unique_ptr<ThisExpr> create(const Token& keyword) {
-        return std::make_unique<ThisExpr>(keyword);
+    static ThisExpr* create(Program& program, const Token& keyword) {
+        return program.make<ThisExpr>(program.ref(keyword));
     }
     
     void accept(ExprVisitor& visitor) override {
@@ -307,18 +311,19 @@ struct ThisExpr: public Expr {
 // ---
 
 struct SuperExpr: public Expr {
-    Token keyword;
-    Token method;
-    
-    SuperExpr(const Token& keyword,
-              const Token& method):
+    TokenRef keyword;
+    TokenRef method;
+        
+    SuperExpr(const TokenRef& keyword,
+              const TokenRef& method):
         keyword{keyword},
         method{method} {
     }
     
-    static std::unique_ptr<SuperExpr> create(const Token& keyword,
-                                             const Token& method) {
-        return std::make_unique<SuperExpr>(keyword, method);
+    static SuperExpr* create(Program& program,
+                             const Token& keyword,
+                             const Token& method) {
+        return program.make<SuperExpr>(program.ref(keyword), program.ref(method));
     }
    
     void accept(ExprVisitor& visitor) override {
@@ -327,4 +332,3 @@ struct SuperExpr: public Expr {
 };
 
 } // namespace cpplox
-
@@ -0,0 +1,338 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "FlatAst.hpp"
+
+#include "Expr.hpp"
+#include "Stmt.hpp"
+
+#include <string_view>
+#include <unordered_map>
+
+namespace cpplox {
+
+/// Walks the pointer AST once and appends each node to the flat one, parents before their children.
+class Flattener: public ExprVisitor,
+                 public StmtVisitor {
+private:
+    FlatAst& ast_;
+    NodeIndex result_ = no_node;
+    std::unordered_map<std::string_view, uint32_t> name_indices_;
+
+    static constexpr uint32_t unresolved_ = static_cast<uint32_t>(-1);
+
+public:
+    Flattener(FlatAst& ast): ast_{ast} {
+    }
+
+    NodeIndex flatten(Expr* expr) {
+        if (expr == nullptr) {
+            return no_node;
+        }
+        expr->accept(*this);
+        return result_;
+    }
+
+    NodeIndex flatten(Stmt* stmt) {
+        if (stmt == nullptr) {
+            return no_node;
+        }
+        stmt->accept(*this);
+        return result_;
+    }
+
+    /// Flattens the statements and returns where their list starts.
+    uint32_t flatten(std::span<Stmt*> statements) {
+        std::vector<uint32_t> nodes;
+        nodes.reserve(statements.size());
+        for(auto stmt: statements) {
+            nodes.push_back(flatten(stmt));
+        }
+        return append_list_(nodes);
+    }
+
+// ExprVisitor Implementation
+public:
+    void visit(const AssignExpr& expr) override {
+        auto node = add_(NodeKind::Assign, expr.name);
+        ast_.a[node] = flatten(expr.value);
+        ast_.b[node] = unresolved_;
+        result_ = node;
+    }
+
+    void visit(const BinaryExpr& expr) override {
+        auto node = add_(NodeKind::Binary, expr.operation);
+        ast_.a[node] = flatten(expr.left);
+        ast_.b[node] = flatten(expr.right);
+        ast_.c[node] = static_cast<uint32_t>(expr.operation.type);
+        result_ = node;
+    }
+
+    void visit(const LiteralExpr& expr) override {
+        auto node = add_(NodeKind::Literal, 0);
+        ast_.a[node] = static_cast<uint32_t>(ast_.literals.size());
+        ast_.literals.push_back(expr.value);
+        result_ = node;
+    }
+
+    void visit(const GroupingExpr& expr) override {
+        auto node = add_(NodeKind::Grouping, 0);
+        ast_.a[node] = flatten(expr.expression);
+        result_ = node;
+    }
+
+    void visit(const UnaryExpr& expr) override {
+        auto node = add_(NodeKind::Unary, expr.operation);
+        ast_.a[node] = flatten(expr.right);
+        ast_.c[node] = static_cast<uint32_t>(expr.operation.type);
+        result_ = node;
+    }
+
+    void visit(const VariableExpr& expr) override {
+        auto node = add_(NodeKind::Variable, expr.name);
+        ast_.b[node] = unresolved_;
+        result_ = node;
+    }
+
+    void visit(const LogicalExpr& expr) override {
+        auto node = add_(NodeKind::Logical, expr.operation);
+        ast_.a[node] = flatten(expr.left);
+        ast_.b[node] = flatten(expr.right);
+        ast_.c[node] = static_cast<uint32_t>(expr.operation.type);
+        result_ = node;
+    }
+
+    void visit(const CallExpr& expr) override {
+        auto node = add_(NodeKind::Call, expr.closing_paren.line);
+        ast_.a[node] = flatten(expr.callee);
+
+        std::vector<uint32_t> args;
+        args.reserve(expr.args.size());
+        for(auto arg: expr.args) {
+            args.push_back(flatten(arg));
+        }
+        ast_.b[node] = append_list_(args);
+        ast_.c[node] = static_cast<uint32_t>(args.size());
+        result_ = node;
+    }
+
+    void visit(const GetExpr& expr) override {
+        auto node = add_(NodeKind::Get, expr.name);
+        ast_.a[node] = flatten(expr.object);
+        ast_.b[node] = add_cache_();
+        result_ = node;
+    }
+
+    void visit(const SetExpr& expr) override {
+        auto node = add_(NodeKind::Set, expr.name);
+        ast_.a[node] = flatten(expr.object);
+        ast_.b[node] = flatten(expr.value);
+        ast_.c[node] = add_cache_();
+        result_ = node;
+    }
+
+    void visit(const ThisExpr& expr) override {
+        auto node = add_(NodeKind::This, expr.keyword);
+        ast_.b[node] = unresolved_;
+        result_ = node;
+    }
+
+    void visit(const SuperExpr& expr) override {
+        auto node = add_(NodeKind::Super, expr.method);
+        ast_.a[node] = unresolved_;
+        ast_.b[node] = unresolved_;
+        result_ = node;
+    }
+
+// StmtVisitor Implementation
+public:
+    void visit(const PrintStatement& stmt) override {
+        auto node = add_(NodeKind::Print, 0);
+        ast_.a[node] = flatten(stmt.expression);
+        result_ = node;
+    }
+
+    void visit(const ExpressionStatement& stmt) override {
+        auto node = add_(NodeKind::Expression, 0);
+        ast_.a[node] = flatten(stmt.expression);
+        result_ = node;
+    }
+
+    void visit(const VariableDeclStatement& stmt) override {
+        auto node = add_(NodeKind::VariableDecl, stmt.name);
+        ast_.a[node] = flatten(stmt.initializer);
+        result_ = node;
+    }
+
+    void visit(const BlockStatement& stmt) override {
+        result_ = block_(stmt.statements);
+    }
+
+    void visit(const IfStatement& stmt) override {
+        auto node = add_(NodeKind::If, 0);
+        ast_.a[node] = flatten(stmt.condition);
+        ast_.b[node] = flatten(stmt.then_branch);
+        ast_.c[node] = flatten(stmt.else_branch);
+        result_ = node;
+    }
+
+    void visit(const WhileStatement& stmt) override {
+        auto node = add_(NodeKind::While, 0);
+        ast_.a[node] = flatten(stmt.condition);
+        ast_.b[node] = flatten(stmt.body);
+        result_ = node;
+    }
+
+    void visit(const FunctionDeclStatementProxy& stmt_proxy) override {
+        result_ = function_(*(stmt_proxy.stmt));
+    }
+
+    void visit(const ReturnStatement& stmt) override {
+        auto node = add_(NodeKind::Return, stmt.keyword.line);
+        ast_.a[node] = flatten(stmt.value);
+        result_ = node;
+    }
+
+    void visit(const ClassDeclStatement& stmt) override {
+        auto node = add_(NodeKind::ClassDecl, stmt.name);
+        ast_.a[node] = flatten(stmt.super_class);
+
+        std::vector<uint32_t> methods;
+        methods.reserve(stmt.methods.size());
+        for(auto method: stmt.methods) {
+            methods.push_back(function_(*method));
+        }
+        ast_.b[node] = append_list_(methods);
+        ast_.c[node] = static_cast<uint32_t>(methods.size());
+        result_ = node;
+    }
+
+// Internal Helpers
+private:
+    NodeIndex add_(NodeKind kind, const TokenRef& token) {
+        auto node = add_(kind, token.line);
+        ast_.names[node] = add_name_(token.lexeme);
+        return node;
+    }
+
+    NodeIndex add_(NodeKind kind, int line) {
+        ast_.kinds.push_back(kind);
+        ast_.names.push_back(no_node);
+        ast_.lines.push_back(static_cast<uint32_t>(line));
+        ast_.a.push_back(no_node);
+        ast_.b.push_back(no_node);
+        ast_.c.push_back(no_node);
+        return static_cast<NodeIndex>(ast_.kinds.size() - 1);
+    }
+
+    uint32_t add_name_(std::string_view name) {
+        auto [itr, added] = name_indices_.try_emplace(name, static_cast<uint32_t>(ast_.name_table.size()));
+        if (added) {
+            ast_.name_table.push_back(name);
+        }
+        return itr->second;
+    }
+
+    uint32_t add_cache_() {
+        ast_.caches.emplace_back();
+        return static_cast<uint32_t>(ast_.caches.size() - 1);
+    }
+
+    uint32_t append_list_(const std::vector<uint32_t>& items) {
+        auto first = static_cast<uint32_t>(ast_.lists.size());
+        ast_.lists.insert(ast_.lists.end(), items.begin(), items.end());
+        return first;
+    }
+
+    NodeIndex block_(std::span<Stmt*> statements) {
+        auto node = add_(NodeKind::Block, 0);
+        ast_.a[node] = flatten(statements);
+        ast_.b[node] = static_cast<uint32_t>(statements.size());
+        ast_.c[node] = 0;
+        return node;
+    }
+
+    NodeIndex function_(const FunctionDeclStatement& stmt) {
+        auto node = add_(NodeKind::FunctionDecl, stmt.name);
+
+        std::vector<uint32_t> params;
+        params.reserve(stmt.params.size());
+        for(const auto& param: stmt.params) {
+            params.push_back(add_name_(param.lexeme));
+        }
+        ast_.a[node] = append_list_(params);
+        ast_.b[node] = static_cast<uint32_t>(params.size());
+        ast_.c[node] = block_(stmt.body);
+        return node;
+    }
+};
+
+// ---
+
+FlatAst FlatAst::flatten(std::span<Stmt*> statements) {
+    FlatAst ast;
+    Flattener flattener{ast};
+    ast.first_statement = flattener.flatten(statements);
+    ast.statement_count = static_cast<uint32_t>(statements.size());
+
+    // Nothing gets added once the program is flat, give back what the arrays reserved to grow.
+    ast.kinds.shrink_to_fit();
+    ast.names.shrink_to_fit();
+    ast.lines.shrink_to_fit();
+    ast.a.shrink_to_fit();
+    ast.b.shrink_to_fit();
+    ast.c.shrink_to_fit();
+    ast.name_table.shrink_to_fit();
+    ast.literals.shrink_to_fit();
+    ast.lists.shrink_to_fit();
+    ast.caches.shrink_to_fit();
+    return ast;
+}
+
+void FlatAst::set_literal(NodeIndex node, const LiteralValue& value) {
+    kinds[node] = NodeKind::Literal;
+    names[node] = no_node;
+    a[node] = static_cast<uint32_t>(literals.size());
+    b[node] = no_node;
+    c[node] = no_node;
+    literals.push_back(value);
+}
+
+void FlatAst::set_captures(NodeIndex function, std::span<const Capture> captures) {
+    // The old list is left behind, as replaced nodes are.
+    auto first = static_cast<uint32_t>(lists.size());
+    for(uint32_t i = 0; i < b[function]; ++i) {
+        lists.push_back(lists[a[function] + i]);
+    }
+    lists.push_back(static_cast<uint32_t>(captures.size()));
+    for(const auto& capture: captures) {
+        lists.push_back(capture.index << 1 | (capture.local ? 1 : 0));
+    }
+    a[function] = first;
+}
+
+void FlatAst::replace(NodeIndex node, NodeIndex other) {
+    kinds[node] = kinds[other];
+    names[node] = names[other];
+    lines[node] = lines[other];
+    a[node] = a[other];
+    b[node] = b[other];
+    c[node] = c[other];
+}
+
+void FlatAst::clear(NodeIndex node) {
+    kinds[node] = NodeKind::Block;
+    names[node] = no_node;
+    a[node] = 0;
+    b[node] = 0;
+    c[node] = 0;
+}
+
+size_t FlatAst::bytes_used() const {
+    auto bytes = [](const auto& items) {
+        return items.capacity() * sizeof(items[0]);
+    };
+
+    return bytes(kinds) + bytes(names) + bytes(lines) + bytes(a) + bytes(b) + bytes(c) +
+           bytes(name_table) + bytes(literals) + bytes(lists) + bytes(caches);
+}
+
+} // namespace cpplox
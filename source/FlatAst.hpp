@@ -0,0 +1,303 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "PropertyCache.hpp"
+#include "Token.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+struct Stmt;
+
+/// Index of a node in a FlatAst.
+using NodeIndex = uint32_t;
+
+/// Stands in for a child that is not there, such as a missing else branch.
+constexpr NodeIndex no_node = std::numeric_limits<NodeIndex>::max();
+
+enum class NodeKind: uint8_t {
+    // Expressions.
+    Assign,
+    Binary,
+    Literal,
+    Grouping,
+    Unary,
+    Variable,
+    Logical,
+    Call,
+    Get,
+    Set,
+    This,
+    Super,
+
+    // Statements.
+    Print,
+    Expression,
+    VariableDecl,
+    Block,
+    If,
+    While,
+    FunctionDecl,
+    Return,
+    ClassDecl,
+
+    // Binary expressions the Interpreter specialized for the operands it saw.
+    NumberAdd,
+    NumberSubtract,
+    NumberMultiply,
+    NumberDivide,
+    NumberLess,
+    NumberLessEqual,
+    NumberGreater,
+    NumberGreaterEqual,
+    StringConcat,
+    Equal,
+    NotEqual,
+
+    // A Binary expression whose specialization failed its guard, it is not specialized again.
+    BinaryGeneric
+};
+
+constexpr size_t node_kind_count = static_cast<size_t>(NodeKind::BinaryGeneric) + 1;
+
+/// Whether kind is a Binary expression, generic or specialized.
+constexpr bool is_binary(NodeKind kind) {
+    return kind == NodeKind::Binary || (kind >= NodeKind::NumberAdd && kind <= NodeKind::BinaryGeneric);
+}
+
+/// Where a variable lives: a slot of the environment the code runs in, one of the running function's upvalues, or
+/// the globals.
+enum class Storage: int {
+    Global = -1,
+    Local,
+    Upvalue
+};
+
+/// Where the Resolver found a variable, and which slot, or upvalue, it is.  Anything it did not find in a local
+/// scope is a global.
+struct VariableSlot {
+    Storage storage = Storage::Global;
+    int slot = 0;
+
+    bool is_global() const {
+        return storage == Storage::Global;
+    }
+
+    bool is_upvalue() const {
+        return storage == Storage::Upvalue;
+    }
+};
+
+/// One of a function's upvalues, which a closure fills in when it is made: a slot of the environment the function
+/// is declared in, or one of the upvalues of the function that declares it.
+struct Capture {
+    uint32_t index = 0;
+    bool local = false;
+};
+
+/// The AST flattened into parallel arrays, which is what the tree-walk interpreter runs.
+///
+/// A node is an index into the arrays.  It has a kind, a name, a line and three 32-bit operands, what the name and
+/// the operands mean depends on the kind:
+///
+///     Kind            name            a               b               c
+///     Assign          variable        value           storage         slot
+///     Binary          operator        left            right           operator's TokenType
+///     Literal                         literal
+///     Grouping                        expression
+///     Unary           operator        right                           operator's TokenType
+///     Variable        variable                        storage         slot
+///     Logical         operator        left            right           operator's TokenType
+///     Call                            callee          first arg       arg count
+///     Get             property        object          cache
+///     Set             property        object          value           cache
+///     This            "this"                          storage         slot
+///     Super           method          method id       storage         slot of "this"
+///     Print                           expression
+///     Expression                      expression
+///     VariableDecl    variable        initializer     uses
+///     Block                           first stmt      stmt count      slot count
+///     If                              condition       then branch     else branch
+///     While                           condition       body
+///     FunctionDecl    function        first param     param count     body block
+///     Return                          value           tail call
+///     ClassDecl       class           super class     first method    method count
+///
+/// The specialized binary kinds, NumberAdd through BinaryGeneric, have the operands of Binary.  Only the
+/// Interpreter makes them, once it has run the node, so the Resolver and the passes never see them.
+///
+/// Lists of children live in lists, "first" is where a node's list starts.  A function's params are name
+/// indices, everything else in lists is a node.  Storage, slot, slot count, uses and method id start out
+/// unresolved and are filled in by the Resolver and the Interpreter.  Uses counts the reads and assignments of a
+/// local variable, globals leave it unresolved.  Only functions, and blocks outside of any function that declare
+/// something, have environments of their own.  Any other Block has no_node for its slot count, it runs in the
+/// enclosing environment and its locals take the next free slots there.  The Resolver lays a function's captures
+/// out in lists after its params, their count first.  Tail call is the Call whose result a Return hands back as is, which the
+/// Resolver finds, no_node when the value is anything else.
+///
+/// The optimization passes rewrite nodes in place.  A node that is replaced takes over its replacement's row, so
+/// its parent does not change, and whatever is no longer reachable from the statements is left behind unused.
+struct FlatAst {
+    std::vector<NodeKind>           kinds;
+    std::vector<uint32_t>           names;
+    std::vector<uint32_t>           lines;
+    std::vector<uint32_t>           a;
+    std::vector<uint32_t>           b;
+    std::vector<uint32_t>           c;
+
+    /// Every name once, they point at the names interned by the Program.
+    std::vector<std::string_view>   name_table;
+    std::vector<LiteralValue>       literals;
+    std::vector<uint32_t>           lists;
+
+    /// The inline caches of the Get and Set nodes.
+    std::vector<PropertyCache>      caches;
+
+    /// The top-level statements, in lists.
+    uint32_t first_statement = 0;
+    uint32_t statement_count = 0;
+
+    /// Flattens the statements of a parsed program.
+    static FlatAst flatten(std::span<Stmt*> statements);
+
+    size_t size() const {
+        return kinds.size();
+    }
+
+    std::string_view name(NodeIndex node) const {
+        return name_table[names[node]];
+    }
+
+    int line(NodeIndex node) const {
+        return static_cast<int>(lines[node]);
+    }
+
+    /// What errors report about the node.
+    TokenRef token(NodeIndex node) const {
+        return TokenRef{TokenType::UNDEFINED, names[node] == no_node ? std::string_view{} : name(node), line(node)};
+    }
+
+    VariableSlot resolved(NodeIndex node) const {
+        return VariableSlot{static_cast<Storage>(b[node]), static_cast<int>(c[node])};
+    }
+
+    void set_resolved(NodeIndex node, const VariableSlot& resolved) {
+        b[node] = static_cast<uint32_t>(resolved.storage);
+        c[node] = static_cast<uint32_t>(resolved.slot);
+    }
+
+    /// How many upvalues a resolved function has.
+    uint32_t capture_count(NodeIndex function) const {
+        return lists[a[function] + b[function]];
+    }
+
+    Capture capture(NodeIndex function, uint32_t index) const {
+        auto entry = lists[a[function] + b[function] + 1 + index];
+        return Capture{entry >> 1, (entry & 1) != 0};
+    }
+
+    /// Gives the function its captures, the list of its params moves to make room for them.
+    void set_captures(NodeIndex function, std::span<const Capture> captures);
+
+    /// Whether a resolved Block makes an environment of its own, rather than running in the enclosing one.
+    bool has_environment(NodeIndex block) const {
+        return c[block] != no_node;
+    }
+
+    /// The node's children, for the kinds that have a list of them.
+    std::span<const uint32_t> list(uint32_t first, uint32_t count) const {
+        return std::span<const uint32_t>(lists.data() + first, count);
+    }
+
+    /// Calls visit with each child of node, in the order they run.  A class's methods are its children, a
+    /// function's body block is its only child.
+    template<typename Visit>
+    void for_each_child(NodeIndex node, Visit&& visit) const {
+        auto visit_list = [&](uint32_t first, uint32_t count) {
+            for(uint32_t i = 0; i < count; ++i) {
+                visit(lists[first + i]);
+            }
+        };
+        auto visit_if_there = [&](NodeIndex child) {
+            if (child != no_node) {
+                visit(child);
+            }
+        };
+
+        if (is_binary(kinds[node])) {
+            visit(a[node]);
+            visit(b[node]);
+            return;
+        }
+
+        switch (kinds[node]) {
+            case NodeKind::Logical:
+            case NodeKind::Set:
+            case NodeKind::While:
+                visit(a[node]);
+                visit(b[node]);
+                break;
+            case NodeKind::Assign:
+            case NodeKind::Grouping:
+            case NodeKind::Unary:
+            case NodeKind::Get:
+            case NodeKind::Print:
+            case NodeKind::Expression:
+                visit(a[node]);
+                break;
+            case NodeKind::VariableDecl:
+            case NodeKind::Return:
+                visit_if_there(a[node]);
+                break;
+            case NodeKind::Call:
+                visit(a[node]);
+                visit_list(b[node], c[node]);
+                break;
+            case NodeKind::Block:
+                visit_list(a[node], b[node]);
+                break;
+            case NodeKind::If:
+                visit(a[node]);
+                visit(b[node]);
+                visit_if_there(c[node]);
+                break;
+            case NodeKind::FunctionDecl:
+                visit(c[node]);
+                break;
+            case NodeKind::ClassDecl:
+                visit_if_there(a[node]);
+                visit_list(b[node], c[node]);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool is_literal(NodeIndex node) const {
+        return kinds[node] == NodeKind::Literal;
+    }
+
+    const LiteralValue& literal(NodeIndex node) const {
+        return literals[a[node]];
+    }
+
+    /// Turns node into a literal, keeping its line.
+    void set_literal(NodeIndex node, const LiteralValue& value);
+
+    /// Makes node a copy of other, which is left unreachable.
+    void replace(NodeIndex node, NodeIndex other);
+
+    /// Turns node into an empty block, which runs nothing.
+    void clear(NodeIndex node);
+
+    /// Memory taken by the arrays.
+    size_t bytes_used() const;
+};
+
+} // namespace cpplox
@@ -0,0 +1,97 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Heap.hpp"
+
+#include "RuntimeError.hpp"
+
+#include <algorithm>
+#include <format>
+
+namespace cpplox {
+
+Heap::~Heap() {
+    Obj* curr = objects_;
+    while (curr != nullptr) {
+        Obj* next = curr->next;
+        delete curr;
+        curr = next;
+    }
+}
+
+void Heap::set_policy(const HeapPolicy& policy) {
+    policy_ = policy;
+    next_gc_ = policy_.initial_threshold;
+    if (policy_.max_heap != 0) {
+        next_gc_ = std::min(next_gc_, policy_.max_heap);
+    }
+}
+
+ObjString* Heap::intern(std::string_view chars) {
+    auto itr = strings_.find(chars);
+    if (itr != strings_.end()) {
+        return itr->second;
+    }
+
+    auto string = allocate<ObjString>(std::string{chars});
+    strings_[string->chars] = string;
+    return string;
+}
+
+void Heap::mark(Obj* object) {
+    if (object == nullptr || object->marked) {
+        return;
+    }
+    
+    object->marked = true;
+    gray_.push_back(object);
+}
+
+void Heap::collect() {
+    while (!gray_.empty()) {
+        Obj* object = gray_.back();
+        gray_.pop_back();
+        object->trace(*this);
+    }
+    
+    // The intern table does not keep strings alive, drop the ones that are about to go.
+    std::erase_if(strings_, [](const auto& entry) {
+        return !entry.second->marked;
+    });
+    
+    sweep_();
+    
+    next_gc_ = std::max(static_cast<size_t>(static_cast<double>(bytes_allocated_) * policy_.growth_factor),
+                        policy_.initial_threshold);
+    if (policy_.max_heap != 0) {
+        if (bytes_allocated_ > policy_.max_heap) {
+            throw RuntimeError(std::format("Out of memory, {} bytes are live but --max-heap is {}.",
+                                           bytes_allocated_, policy_.max_heap));
+        }
+        next_gc_ = std::min(next_gc_, policy_.max_heap);
+    }
+}
+
+void Heap::sweep_() {
+    Obj* previous = nullptr;
+    Obj* curr = objects_;
+    while (curr != nullptr) {
+        if (curr->marked) {
+            curr->marked = false;
+            previous = curr;
+            curr = curr->next;
+            continue;
+        }
+        
+        Obj* unreached = curr;
+        curr = curr->next;
+        if (previous == nullptr) {
+            objects_ = curr;
+        } else {
+            previous->next = curr;
+        }
+        
+        bytes_allocated_ -= unreached->size;
+        delete unreached;
+    }
+}
+
+} // namespace cpplox
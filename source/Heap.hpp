@@ -0,0 +1,100 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Object.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cpplox {
+
+/// When the heap collects, and how big it is allowed to get.
+struct HeapPolicy {
+    /// Bytes allocated before the first collection.
+    size_t initial_threshold = 16 * 1024 * 1024;
+    
+    /// After a collection, the next one runs once the heap is this many times the size of what survived.
+    double growth_factor = 2.0;
+    
+    /// Live bytes the heap may hold after a collection, 0 for no limit.
+    size_t max_heap = 0;
+};
+
+// ---
+
+/// Owns every object an engine allocates and frees them with a mark-and-sweep collector.
+///
+/// The heap does not know the engine's roots and it never collects on its own.  The engine checks
+/// should_collect() at points where every live value is somewhere it can find, marks its roots with mark() and
+/// then calls collect(), which traces from there and sweeps whatever was not reached.
+class Heap {
+private:
+    Obj* objects_ = nullptr;
+    std::unordered_map<std::string_view, ObjString*> strings_;
+    
+    HeapPolicy policy_;
+    size_t bytes_allocated_ = 0;
+    size_t next_gc_ = policy_.initial_threshold;
+    std::vector<Obj*> gray_;
+
+public:
+    Heap() {
+    }
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    ~Heap();
+    
+    void set_policy(const HeapPolicy& policy);
+
+    template<typename T, typename... Args>
+    T* allocate(Args&&... args) {
+        T* object = new T(std::forward<Args>(args)...);
+        adopt(object);
+        return object;
+    }
+    
+    /// Hands an object that was created outside the heap over to the collector, from now on it is swept like
+    /// any other object.
+    template<typename T>
+    void adopt(T* object) {
+        object->size = static_cast<uint32_t>(sizeof(T) + object->owned_bytes());
+        object->next = objects_;
+        objects_ = object;
+        
+        bytes_allocated_ += object->size;
+    }
+
+    /// Returns the one string object holding chars, creating it if needed.
+    ObjString* intern(std::string_view chars);
+    
+    size_t bytes_allocated() const {
+        return bytes_allocated_;
+    }
+    
+    bool should_collect() const {
+        return bytes_allocated_ > next_gc_;
+    }
+    
+    void mark(Obj* object);
+    
+    void mark(const Value& value) {
+        if (value.is_obj()) {
+            mark(value.as_obj());
+        }
+    }
+    
+    /// Traces from the roots marked so far and frees everything that was not reached.  Throws when what is
+    /// left is still over the policy's max_heap.
+    void collect();
+    
+private:
+    void sweep_();
+};
+
+} // namespace cpplox
@@ -2,148 +2,251 @@
 #include "Interpreter.hpp"
 
 #include "LoxClass.hpp"
+#include "LoxFunction.hpp"
 #include "LoxInstance.hpp"
 #include "RuntimeError.hpp"
 
+#include <algorithm>
 #include <chrono>
-#include <functional>
+#include <format>
+#include <limits>
 #include <print>
-#include <typeinfo>
-#include <type_traits>
 
 
 namespace cpplox {
 
-Interpreter::Interpreter() {
-    curr_env_ = &global_env_;
-    Callable callable;
-    callable.arity = 0;
-    callable.func = [](const std::vector<std::any>&) -> std::any {
-        // TODO: Calculate this properly.
-        return ValueType{200.0};
-    };
-    
-    global_env_.define("clock", callable);
+static Value clock_native_(int, Value*) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return Value::number(std::chrono::duration<double>(now).count());
 }
 
-void Interpreter::interpret(Expr& expr) {
-    evaluate_(expr);
-    stringify_();
+Interpreter::Interpreter() {
+    globals_["clock"] = Value::object(heap_.allocate<ObjNative>(0, clock_native_));
 }
 
-void Interpreter::interpret(const std::vector<std::unique_ptr<Stmt>>& stmts) {
-    for(auto& curr: stmts) {
-        execute_(*(curr.get()));
+/// Below the native stack limit there is still this much left, for the work done between two calls.
+static constexpr size_t native_stack_reserve_ = 256 * 1024;
+
+/// The native stack the handlers need for one Lox call, with plenty to spare.  Each call takes a few native
+/// frames as the handlers recurse through the expression the call is in.
+static constexpr size_t native_stack_per_call_ = 2 * 1024;
+
+static constexpr size_t min_native_stack_ = 8 * 1024 * 1024;
+
+void Interpreter::interpret(FlatAst& ast) {
+    //
+    // Lox calls still nest native calls, so the program runs on a native stack of its own with room for as many
+    // of them as --max-stack-depth allows.  The stack is mapped once and kept for the programs that come after.
+    //
+    auto max_depth = (std::numeric_limits<size_t>::max() - native_stack_reserve_) / native_stack_per_call_;
+    auto stack_size = std::max(min_native_stack_,
+                               std::min(max_stack_depth_, max_depth) * native_stack_per_call_ + native_stack_reserve_);
+    if (native_stack_ == nullptr || native_stack_->size() < stack_size) {
+        native_stack_.reset();
+        native_stack_ = NativeStack::create(stack_size);
+        if (native_stack_ == nullptr) {
+            throw RuntimeError(std::format("Could not make a native stack for {} calls.", max_stack_depth_));
+        }
     }
+
+    native_stack_limit_ = native_stack_->bottom() + native_stack_reserve_;
+    native_stack_->run([this, &ast] {
+        run_program_(ast);
+    });
 }
 
-void Interpreter::resolve(uintptr_t expr_ptr, int depth) {
-    locals_[expr_ptr] = depth;
+void Interpreter::run_program_(FlatAst& ast) {
+    // A runtime error can leave values and frames behind, and a tail call that never ran.
+    value_stack_.clear();
+    frames_.clear();
+    tail_call_pending_ = TailCall{};
+
+    if (compile_closures_) {
+        closures_.run(ast);
+        return;
+    }
+
+    use_ast_(&ast);
+    for(auto curr: ast.list(ast.first_statement, ast.statement_count)) {
+        execute_(curr);
+    }
 }
 
-void Interpreter::visit(const AssignExpr& expr) {
-    evaluate_(*(expr.value.get()));
+// In the order of NodeKind.
+const Interpreter::Handler Interpreter::handlers_[node_kind_count] = {
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.assign_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.binary_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.literal_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.grouping_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.unary_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.variable_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.logical_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.call_expr_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.get_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.set_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.variable_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.super_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.print_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.expression_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.var_decl_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.block_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.if_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.while_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.function_decl_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.return_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.class_decl_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_add_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_subtract_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_multiply_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_divide_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_less_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_less_equal_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_greater_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.number_greater_equal_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.string_concat_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.equal_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.not_equal_(node); },
+    [](Interpreter& interpreter, NodeIndex node) { interpreter.binary_(node); }
+};
+
+void Interpreter::assign_(NodeIndex node) {
+    evaluate_(a_[node]);
     auto rhs = value;
-    
-    auto itr = locals_.find(reinterpret_cast<uintptr_t>(&expr));
-    if (itr == locals_.end()) {
-        global_env_.assign(expr.name, rhs);
+
+    auto resolved = resolved_(node);
+    if (resolved.is_global()) {
+        auto name = ast_->name(node);
+        auto global = globals_.find(name);
+        if (global == globals_.end()) {
+            std::stringstream stream;
+            stream << "Undefined variable: " << name;
+            throw RuntimeError(stream.str());
+        }
+        global->second = rhs;
+    } else if (resolved.is_upvalue()) {
+        upvalue_(resolved.slot) = rhs;
     } else {
-        curr_env_->assign_at(itr->second, expr.name, rhs);
+        curr_env_->at(resolved.slot) = rhs;
     }
 }
 
-void Interpreter::visit(const BinaryExpr& expr) {
-    evaluate_(*(expr.left.get()));
-    auto lhs = value;
-    
-    evaluate_(*(expr.right.get()));
-    auto rhs = value;
-    
-    switch (expr.operation.type) {
-        case TokenType::GREATER:
-            value = std::get<double>(lhs) > std::get<double>(rhs);
-            break;
-        case TokenType::GREATER_EQUAL:
-            value = std::get<double>(lhs) >= std::get<double>(rhs);
-            break;
-        case TokenType::LESS:
-            value = std::get<double>(lhs) < std::get<double>(rhs);
-            break;
-        case TokenType::LESS_EQUAL:
-            value = std::get<double>(lhs) <= std::get<double>(rhs);
-            break;
-        case TokenType::MINUS:
-            value = std::get<double>(lhs) - std::get<double>(rhs);
-            break;
-            
-        case TokenType::SLASH:
-            value = std::get<double>(lhs) - std::get<double>(rhs);
-            break;
-            
-        case TokenType::STAR:
-            value = std::get<double>(lhs) * std::get<double>(rhs);
-            break;
-            
-        case TokenType::PLUS:
-            if (lhs.index() == 2 &&
-                rhs.index() == 2) {
-                value = std::get<double>(lhs) + std::get<double>(rhs);
-            } else if (lhs.index() == 1 &&
-                       rhs.index() == 1) {
-                value = std::get<std::string>(lhs) + std::get<std::string>(rhs);
-            }
-            break;
-            
-        default:
-            throw RuntimeError("Unknown operation");
-            break;
+void Interpreter::binary_(NodeIndex node) {
+    Value lhs;
+    Value rhs;
+    evaluate_operands_(node, lhs, rhs);
+
+    if (kinds_[node] == NodeKind::Binary) {
+        specialize_(node, lhs, rhs);
     }
-    
+    value = binary_operation_(node, lhs, rhs);
+}
+
+void Interpreter::number_add_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::number(lhs + rhs); });
+}
+
+void Interpreter::number_subtract_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::number(lhs - rhs); });
 }
 
-void Interpreter::visit(const LiteralExpr& expr) {
-    switch (expr.value.index()) {
+void Interpreter::number_multiply_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::number(lhs * rhs); });
+}
+
+void Interpreter::number_divide_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::number(lhs / rhs); });
+}
+
+void Interpreter::number_less_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::boolean(lhs < rhs); });
+}
+
+void Interpreter::number_less_equal_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::boolean(lhs <= rhs); });
+}
+
+void Interpreter::number_greater_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::boolean(lhs > rhs); });
+}
+
+void Interpreter::number_greater_equal_(NodeIndex node) {
+    number_binary_(node, [](double lhs, double rhs) { return Value::boolean(lhs >= rhs); });
+}
+
+void Interpreter::string_concat_(NodeIndex node) {
+    Value lhs;
+    Value rhs;
+    evaluate_operands_(node, lhs, rhs);
+
+    if (is_obj_type(lhs, ObjType::String) && is_obj_type(rhs, ObjType::String)) {
+        value = concatenate_(lhs, rhs);
+    } else {
+        despecialize_(node);
+        value = binary_operation_(node, lhs, rhs);
+    }
+}
+
+void Interpreter::equal_(NodeIndex node) {
+    Value lhs;
+    Value rhs;
+    evaluate_operands_(node, lhs, rhs);
+    value = Value::boolean(is_equal_(lhs, rhs));
+}
+
+void Interpreter::not_equal_(NodeIndex node) {
+    Value lhs;
+    Value rhs;
+    evaluate_operands_(node, lhs, rhs);
+    value = Value::boolean(!is_equal_(lhs, rhs));
+}
+
+void Interpreter::literal_(NodeIndex node) {
+    const auto& literal = literals_[a_[node]];
+
+    switch (literal.index()) {
         case 0:
-            value = nullptr;
+            value = Value::nil();
         break;
-        
+
         case 1:
-            value = std::get<std::string>(expr.value);
+            value = Value::object(heap_.intern(std::get<std::string_view>(literal)));
         break;
-            
+
         case 2:
-            value = std::get<double>(expr.value);
+            value = Value::number(std::get<double>(literal));
         break;
-            
+
         case 3:
-            value = std::get<bool>(expr.value);
+            value = Value::boolean(std::get<bool>(literal));
         break;
-            
+
         case 4:
-            value = nullptr;
+            value = Value::nil();
         break;
-            
+
         default:
             throw RuntimeError("Invalid value");
         break;
     }
 }
 
-void Interpreter::visit(const GroupingExpr& expr) {
-    evaluate_(*(expr.expression.get()));
+void Interpreter::grouping_(NodeIndex node) {
+    evaluate_(a_[node]);
 }
 
-void Interpreter::visit(const UnaryExpr& expr) {
-    evaluate_(*(expr.right.get()));
-    auto rhs = value;
-    
-    switch (expr.operation.type) {
+void Interpreter::unary_(NodeIndex node) {
+    evaluate_(a_[node]);
+    Value rhs = value;
+
+    switch (static_cast<TokenType>(c_[node])) {
         case TokenType::MINUS:
-            value =  -(std::get<double>(rhs));
+            if (!rhs.is_number()) {
+                throw RuntimeError("Operand must be a number.");
+            }
+            value = Value::number(-rhs.as_number());
             break;
         case TokenType::BANG:
-            value = !is_thruthy_(rhs);
+            value = Value::boolean(!is_thruthy_(rhs));
             break;
         default:
             // TODO: Error..
@@ -151,396 +254,739 @@ void Interpreter::visit(const UnaryExpr& expr) {
     }
 }
 
-void Interpreter::visit(const VariableExpr& expr) {
-    value = lookup_variable_(expr.name, reinterpret_cast<uintptr_t>(&expr));
+void Interpreter::variable_(NodeIndex node) {
+    value = lookup_variable_(node);
 }
 
-void Interpreter::visit(const LogicalExpr& expr) {
-    evaluate_(*(expr.left.get()));
-    auto left = value;
-    
-    if (expr.operation.type == TokenType::OR) {
+void Interpreter::logical_(NodeIndex node) {
+    evaluate_(a_[node]);
+    Value left = value;
+
+    // Short circuit, value still holds the left side.
+    if (static_cast<TokenType>(c_[node]) == TokenType::OR) {
         if (is_thruthy_(left)) {
-            value = left;
+            return;
         }
     } else {
         if (!is_thruthy_(left)) {
-            value = left;
+            return;
         }
     }
-    
-    evaluate_(*(expr.right.get()));
+
+    evaluate_(b_[node]);
 }
 
-void Interpreter::visit(const CallExpr& expr) {
-    evaluate_(*(expr.callee));
-    auto callee = value;
-    
-    if (callee.index() != 5) {
-        //
-        // If we are not Callable and we're not a LoxClass, nothing we can do with this.
-        //
-        if (callee.index() != 7) {
-            std::stringstream stream;
-            stream << "This is not a callable object at line: " << expr.closing_paren.line;
-            throw RuntimeError(stream.str());
+void Interpreter::call_expr_(NodeIndex node) {
+    Value callee;
+    LoxInstance* receiver = nullptr;
+    auto arg_base = evaluate_call_(node, callee, receiver);
+
+    call_(callee, receiver, arg_base, node);
+    value_stack_.resize(arg_base - 1);
+}
+
+size_t Interpreter::evaluate_call_(NodeIndex node, Value& callee, LoxInstance*& receiver) {
+    //
+    // Calling a method straight off an instance or off super passes the instance along as the receiver, rather
+    // than binding a copy of the method only to call it once.
+    //
+    auto callee_node = a_[node];
+    auto callee_kind = kinds_[callee_node];
+    if (callee_kind == NodeKind::Get) {
+        evaluate_(a_[callee_node]);
+        if (!is_obj_type(value, ObjType::LoxInstance)) {
+            throw RuntimeError("Only object instances have properties.");
         }
-    }
-    
-    std::vector<std::any> args;
-    for(auto& arg: expr.args) {
-        evaluate_(*(arg.get()));
-        args.push_back(std::move(value));
-    }
-    
-    if (callee.index() == 5) {
-        Callable function_info = std::get<Callable>(callee);
-        if (args.size() != function_info.arity) {
-            throw RuntimeError("Wrong number of args");
+
+        auto instance = as_obj<LoxInstance>(value);
+        auto property = lookup_get_(instance, callee_node, cache_stats_.invoke);
+        if (property.slot >= 0) {
+            callee = instance->fields[property.slot];
+        } else {
+            callee = Value::object(property.method);
+            receiver = instance;
         }
-        
-        auto result = function_info.func(args);
-        value = std::any_cast<ValueType>(result);
+    } else if (callee_kind == NodeKind::Super) {
+        callee = Value::object(find_super_method_(callee_node, receiver));
     } else {
-        std::shared_ptr<LoxClass> lox_class = std::get<std::shared_ptr<LoxClass>>(callee);
-        if (lox_class->initializer.arity != args.size()) {
-            throw RuntimeError("Wrong number of args for initializer");
-        }
-        
-        auto result = lox_class->initializer.func(args);
-        value = std::any_cast<ValueType>(result);
+        evaluate_(callee_node);
+        callee = value;
     }
+
+    // The arguments can collect, keep the receiver (which keeps its method) or the callee on the value stack.
+    value_stack_.push_back(receiver ? Value::object(receiver) : callee);
+
+    size_t arg_base = value_stack_.size();
+    auto first_arg = b_[node];
+    auto arg_count = c_[node];
+    for(uint32_t i = 0; i < arg_count; ++i) {
+        evaluate_(lists_[first_arg + i]);
+        value_stack_.push_back(value);
+    }
+
+    return arg_base;
 }
 
-void Interpreter::visit(const GetExpr& expr) {
-    evaluate_(*(expr.object.get()));
-    ValueType object = value;
-    
-    if (object.index() != 6) {
+void Interpreter::get_(NodeIndex node) {
+    evaluate_(a_[node]);
+    Value object = value;
+
+    if (!is_obj_type(object, ObjType::LoxInstance)) {
         throw RuntimeError("Only object instances have properties.");
     }
-    
-    auto instance = std::get<std::shared_ptr<LoxInstance>>(object);
-    value = instance->get(expr.name);
+
+    auto instance = as_obj<LoxInstance>(object);
+    auto property = lookup_get_(instance, node, cache_stats_.get);
+    if (property.slot >= 0) {
+        value = instance->fields[property.slot];
+    } else {
+        value = Value::object(property.method->bind(heap_, instance));
+    }
 }
 
-void Interpreter::visit(const SetExpr& expr) {
-    evaluate_(*(expr.object.get()));
-    ValueType object = value;
-    
-    if (object.index() != 6) {
+void Interpreter::set_(NodeIndex node) {
+    evaluate_(a_[node]);
+    Value object = value;
+
+    if (!is_obj_type(object, ObjType::LoxInstance)) {
         throw RuntimeError("Only object instances have properties.");
     }
-    
-    evaluate_(*(expr.value.get()));
-    auto the_value = value;
-    
-    auto instance = std::get<std::shared_ptr<LoxInstance>>(object);
-    instance->set(expr.name, the_value);
-    
-}
 
-void Interpreter::visit(const ThisExpr& expr) {
-    value = lookup_variable_(expr.keyword, reinterpret_cast<uintptr_t>(&expr));
-}
+    value_stack_.push_back(object);
+    evaluate_(b_[node]);
+    Value the_value = value;
+    value_stack_.pop_back();
 
-void Interpreter::visit(const SuperExpr& expr) {
-    auto itr = locals_.find(reinterpret_cast<uintptr_t>(&expr));
-    if (itr == locals_.end()) {
-        throw RuntimeError("Could not find 'super' in environment.");
+    //
+    // Look the field up only now, evaluating the value may have added fields to the instance.
+    //
+    auto instance = as_obj<LoxInstance>(object);
+    auto& cache = ast_->caches[c_[node]];
+    auto entry = cache.find(instance->shape);
+    if (entry) {
+        ++cache_stats_.set.hits;
+        instance->set(*entry, the_value);
+    } else {
+        ++cache_stats_.set.misses;
+        auto property = instance->lookup_set(ast_->name(node));
+        cache.add(property);
+        instance->set(property, the_value);
     }
-    
-    auto super = curr_env_->get_at(itr->second, "super");
-    auto super_class = std::get<std::shared_ptr<LoxClass>>(super);
-    value = super_class->find_method(expr.method.lexeme);
 }
 
-void Interpreter::evaluate_(Expr& expr) {
-    expr.accept(*this);
+void Interpreter::super_(NodeIndex node) {
+    LoxInstance* receiver = nullptr;
+    auto method = find_super_method_(node, receiver);
+    value = Value::object(method->bind(heap_, receiver));
 }
 
-void Interpreter::execute_(Stmt& stmt) {
-    stmt.accept(*this);
+void Interpreter::print_(NodeIndex node) {
+    evaluate_(a_[node]);
+    stringify_();
 }
 
-ValueType Interpreter::lookup_variable_(const Token& name, uintptr_t expr_ptr) {
-    auto itr = locals_.find(expr_ptr);
-    if (itr == locals_.end()) {
-        return global_env_.get(name);
-    } else {
-        return curr_env_->get_at(itr->second, name.lexeme);
-    }
+void Interpreter::expression_(NodeIndex node) {
+    evaluate_(a_[node]);
 }
 
-// Makes sure environment gets setup correclty.
-struct EnvGuard {
-    Environment*& curr_env;
-    Environment* original;
-    EnvGuard(Environment*& curr_env,
-             Environment* new_env): curr_env{curr_env} {
-        this->original = curr_env;
-        this->curr_env = new_env;
-
-    }
-    
-    ~EnvGuard() {
-        curr_env = original;
+const Value& Interpreter::lookup_variable_(NodeIndex node) {
+    auto resolved = resolved_(node);
+    if (resolved.is_global()) {
+        auto name = ast_->name(node);
+        auto global = globals_.find(name);
+        if (global == globals_.end()) {
+            std::stringstream stream;
+            stream << "Undefined variable: " << name;
+            throw RuntimeError(stream.str());
+        }
+        return global->second;
+    } else if (resolved.is_upvalue()) {
+        return upvalue_(resolved.slot);
+    } else {
+        return curr_env_->at(resolved.slot);
     }
-};
+}
 
-void Interpreter::execute_block_(const std::vector<std::unique_ptr<Stmt>>& statements,
-                                 Environment& env) {
-    EnvGuard guard{curr_env_, &env};
+void Interpreter::execute_block_(NodeIndex block,
+                                 Environment* env) {
+    EnvGuard guard{curr_env_, saved_envs_, env};
+    execute_statements_(block);
+}
 
-    for(auto& statement: statements) {
-        execute_(*(statement.get()));
+void Interpreter::execute_statements_(NodeIndex block) {
+    auto first = a_[block];
+    auto count = b_[block];
+    for(uint32_t i = 0; i < count; ++i) {
+        execute_(lists_[first + i]);
         if (return_called_) {
             break;
         }
     }
 }
 
-void Interpreter::visit(const PrintStatement& stmt) {
-    evaluate_(*(stmt.expression.get()));
-    stringify_();
+void Interpreter::release_(Environment* env) {
+    if (env != nullptr) {
+        close_upvalues_(env->values());
+        delete env;
+    }
 }
 
-void Interpreter::visit(const ExpressionStatement& stmt) {
-    evaluate_(*(stmt.expression.get()));
+LoxFunction* Interpreter::make_function_(FlatAst* ast, NodeIndex declaration) {
+    //
+    // A closure captures the variables of the environment it is made in, and passes on those of the function making
+    // it.  So does "super", which means the same in a function nested in a method as in the method.
+    //
+    auto function = LoxFunction::create(heap_, ast, declaration);
+    auto enclosing = frames_.empty() ? nullptr : frames_.back().function;
+    auto capture_count = ast->capture_count(declaration);
+    function->upvalues.reserve(capture_count);
+    for(uint32_t i = 0; i < capture_count; ++i) {
+        auto capture = ast->capture(declaration, i);
+        function->upvalues.push_back(capture.local ? capture_upvalue_(curr_env_->values() + capture.index)
+                                                   : enclosing->upvalues[capture.index]);
+    }
+    if (enclosing != nullptr) {
+        function->super_class = enclosing->super_class;
+    }
+
+    return function;
+}
+
+ObjUpvalue* Interpreter::capture_upvalue_(Value* local) {
+    ObjUpvalue* prev = nullptr;
+    ObjUpvalue* curr = open_upvalues_;
+    while (curr != nullptr && curr->location > local) {
+        prev = curr;
+        curr = curr->next_open;
+    }
+
+    if (curr != nullptr && curr->location == local) {
+        return curr;
+    }
+
+    auto created = heap_.allocate<ObjUpvalue>(local);
+    created->next_open = curr;
+    if (prev == nullptr) {
+        open_upvalues_ = created;
+    } else {
+        prev->next_open = created;
+    }
+    return created;
 }
 
-void Interpreter::visit(const VariableDeclStatement& stmt) {
-    ValueType initial_value;
-    
-    if (stmt.initializer) {
-        evaluate_(*(stmt.initializer.get()));
+void Interpreter::var_decl_(NodeIndex node) {
+    Value initial_value;
+
+    if (a_[node] != no_node) {
+        evaluate_(a_[node]);
         initial_value = value;
     }
-    
-    curr_env_->define(stmt.name.lexeme, initial_value);
+
+    define_variable_(ast_->name(node), initial_value);
 }
 
-void Interpreter::visit(const BlockStatement& stmt) {
-    Environment new_env{curr_env_};
-    execute_block_(stmt.statements, new_env);
+void Interpreter::block_(NodeIndex node) {
+    // A block the Resolver flattened defines its locals in the enclosing environment, they go when it ends.
+    if (c_[node] == no_node) {
+        auto defined = curr_env_ != nullptr ? curr_env_->defined() : 0;
+        execute_statements_(node);
+        end_block_(defined);
+        return;
+    }
+
+    auto env = Environment::create(static_cast<int>(c_[node]));
+    ReleaseGuard release{*this, env};
+    execute_block_(node, env);
 }
 
-void Interpreter::visit(const IfStatement& stmt) {
-    evaluate_(*(stmt.condition.get()));
-    auto result = value;
-    
+void Interpreter::if_(NodeIndex node) {
+    evaluate_(a_[node]);
+    Value result = value;
+
     if (is_thruthy_(result)) {
-        execute_(*(stmt.then_branch.get()));
-    } else if (stmt.else_branch) {
-        execute_(*(stmt.else_branch.get()));
+        execute_(b_[node]);
+    } else if (c_[node] != no_node) {
+        execute_(c_[node]);
     }
 }
 
-void Interpreter::visit(const WhileStatement& stmt) {
-    evaluate_(*(stmt.condition.get()));
+void Interpreter::while_(NodeIndex node) {
+    auto condition = a_[node];
+    auto body = b_[node];
+
+    evaluate_(condition);
     while(is_thruthy_(value)) {
-        execute_(*(stmt.body.get()));
+        execute_(body);
         if (return_called_) {
             break;
         }
-        evaluate_(*(stmt.condition.get()));
+        evaluate_(condition);
     }
 }
 
-void Interpreter::visit(const FunctionDeclStatementProxy& stmt_proxy) {
-    curr_env_->define(stmt_proxy.stmt->name.lexeme, make_func_callable_(stmt_proxy.stmt));
+void Interpreter::function_decl_(NodeIndex node) {
+    define_variable_(ast_->name(node), Value::object(make_function_(ast_, node)));
 }
 
-void Interpreter::visit(const ReturnStatement& stmt) {
-    if (stmt.value) {
-        evaluate_(*(stmt.value.get()));
+void Interpreter::return_(NodeIndex node) {
+    if (b_[node] != no_node) {
+        tail_call_(b_[node]);
+    } else if (a_[node] != no_node) {
+        evaluate_(a_[node]);
     } else {
-        value = std::monostate();
+        value = Value::nil();
     }
-    
+
     return_called_ = true;
 }
 
-void Interpreter::visit(const ClassDeclStatement& stmt) {
-    curr_env_->define(stmt.name.lexeme, nullptr);
-    
+void Interpreter::class_decl_(NodeIndex node) {
     //
     // Handle super class if one is defined.
     //
-    std::shared_ptr<LoxClass> super_class;
-    if (stmt.super_class) {
-        evaluate_(*(stmt.super_class));
-        auto evaulated_super_class = value;
-        
-        if (evaulated_super_class.index() != 7) {
+    LoxClass* super_class = nullptr;
+    if (a_[node] != no_node) {
+        evaluate_(a_[node]);
+        Value evaulated_super_class = value;
+
+        if (!is_obj_type(evaulated_super_class, ObjType::LoxClass)) {
             throw RuntimeError("The superclass is not a class.");
         } else {
-            super_class = std::get<std::shared_ptr<LoxClass>>(evaulated_super_class);
+            super_class = as_obj<LoxClass>(evaulated_super_class);
         }
     }
-    
+
     //
-    // Sets up the methods in the class.
+    // Sets up the methods in the class, they get their receiver when called.
     //
-    auto lox_instance = LoxInstance::create();
-    
-    std::map<std::string, ValueType> methods;
-    std::shared_ptr<FunctionDeclStatement> init_method;
-    for(const auto& curr: stmt.methods) {
-        methods[curr->name.lexeme] = make_func_callable_(curr, lox_instance, super_class);
-        if (curr->name.lexeme == "init") {
-            init_method = curr;
-        }
+    std::map<int, LoxFunction*> methods;
+    for(auto curr: ast_->list(b_[node], c_[node])) {
+        int method_id = method_ids_.intern(ast_->name(curr));
+        auto method = make_function_(ast_, curr);
+        method->is_method = true;
+        method->is_initializer = method_id == MethodIds::init_id;
+        method->super_class = super_class;
+        methods[method_id] = method;
     }
-    
-    auto lox_class = LoxClass::create(stmt.name.lexeme, methods, super_class);
-    lox_instance->lox_class = lox_class;
-    
+
+    auto name = ast_->name(node);
+    root_shapes_.push_back(std::make_unique<Shape>());
+    auto lox_class = LoxClass::create(heap_, std::string(name), methods, super_class, root_shapes_.back().get());
+
+    // Methods only look the class up when they run, so the name can be defined once the class is complete.
+    define_variable_(name, Value::object(lox_class));
+}
+
+void Interpreter::use_ast_(FlatAst* ast) {
+    ast_ = ast;
+    kinds_ = ast->kinds.data();
+    a_ = ast->a.data();
+    b_ = ast->b.data();
+    c_ = ast->c.data();
+    lists_ = ast->lists.data();
+    literals_ = ast->literals.data();
+}
+
+void Interpreter::evaluate_operands_(NodeIndex node, Value& lhs, Value& rhs) {
+    // The right side can run statements and collect, so the left side waits on the value stack.
+    evaluate_(a_[node]);
+    value_stack_.push_back(value);
+
+    evaluate_(b_[node]);
+    lhs = value_stack_.back();
+    rhs = value;
+    value_stack_.pop_back();
+}
+
+template<typename Operation>
+void Interpreter::number_binary_(NodeIndex node, Operation operation) {
     //
-    // Sets up initializer that will create class instance and initialize.
+    // A number needs nothing from the collector, so the left side only goes on the value stack once the guard
+    // has failed and the node runs the generic way.
     //
-    Callable init_call;
-    if (init_method) {
-        init_call =  make_func_callable_(init_method, lox_instance);
-    } else {
-        init_call.arity = 0;
-        init_call.func = [this, lox_instance](const std::vector<std::any>& params) -> std::any {
-            Environment env{curr_env_};
-            
-            ValueType instance =  lox_instance;
-            return instance;
-        };
-    }
-    
-    lox_class->initializer = std::move(init_call);
-    
-    curr_env_->assign(stmt.name, lox_class);
-}
-
-bool Interpreter::is_thruthy_(const ValueType& value) {
-    if (value.index() == 0) {
-        return false;
-    }
-    
-    if (value.index() == 3) {
-        bool result = std::get<bool>(value);
-        if (!result) {
-            return false;
+    evaluate_(a_[node]);
+    Value lhs = value;
+    if (lhs.is_number()) {
+        evaluate_(b_[node]);
+        if (value.is_number()) {
+            value = operation(lhs.as_number(), value.as_number());
+            return;
         }
+
+        despecialize_(node);
+        value = binary_operation_(node, lhs, value);
+        return;
     }
-    
-    return true;
+
+    despecialize_(node);
+    value_stack_.push_back(lhs);
+    evaluate_(b_[node]);
+    Value rhs = value;
+    value_stack_.pop_back();
+    value = binary_operation_(node, lhs, rhs);
 }
 
-bool Interpreter::is_equal_(const ValueType& a, const ValueType& b) {
-    switch (a.index()) {
-        case 0:
-            return false;
-            
-        case 1:
-            return std::get<1>(a) == std::get<1>(b);
-            
-        case 2:
-            return std::get<2>(a) == std::get<2>(b);
-            
-        case 3:
-            return std::get<3>(a) == std::get<3>(b);
-            
-        case 4:
-            return std::get<4>(a) == std::get<4>(b);
-            
+Value Interpreter::binary_operation_(NodeIndex node, const Value& lhs, const Value& rhs) {
+    auto operation = static_cast<TokenType>(c_[node]);
+
+    //
+    // Everything but equality and + only works on numbers.
+    //
+    switch (operation) {
+        case TokenType::BANG_EQUAL:
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::PLUS:
+            break;
         default:
-            // TODO: Error...
+            if (!lhs.is_number() || !rhs.is_number()) {
+                throw RuntimeError("Operands must be numbers.");
+            }
             break;
     }
-    
-    
-    return false;
+
+    switch (operation) {
+        case TokenType::BANG_EQUAL:
+            return Value::boolean(!is_equal_(lhs, rhs));
+        case TokenType::EQUAL_EQUAL:
+            return Value::boolean(is_equal_(lhs, rhs));
+        case TokenType::GREATER:
+            return Value::boolean(lhs.as_number() > rhs.as_number());
+        case TokenType::GREATER_EQUAL:
+            return Value::boolean(lhs.as_number() >= rhs.as_number());
+        case TokenType::LESS:
+            return Value::boolean(lhs.as_number() < rhs.as_number());
+        case TokenType::LESS_EQUAL:
+            return Value::boolean(lhs.as_number() <= rhs.as_number());
+        case TokenType::MINUS:
+            return Value::number(lhs.as_number() - rhs.as_number());
+        case TokenType::SLASH:
+            return Value::number(lhs.as_number() / rhs.as_number());
+        case TokenType::STAR:
+            return Value::number(lhs.as_number() * rhs.as_number());
+        case TokenType::PLUS:
+            if (lhs.is_number() &&
+                rhs.is_number()) {
+                return Value::number(lhs.as_number() + rhs.as_number());
+            } else if (is_obj_type(lhs, ObjType::String) &&
+                       is_obj_type(rhs, ObjType::String)) {
+                return concatenate_(lhs, rhs);
+            } else {
+                throw RuntimeError("Operands must be two numbers or two strings.");
+            }
+
+        default:
+            throw RuntimeError("Unknown operation");
+    }
+}
+
+void Interpreter::specialize_(NodeIndex node, const Value& lhs, const Value& rhs) {
+    //
+    // Equality works on any two values and needs no guard.  A node that has no specialized kind for what it saw
+    // is generic from now on, so it is only looked at once.
+    //
+    auto& kind = ast_->kinds[node];
+    auto operation = static_cast<TokenType>(c_[node]);
+    kind = NodeKind::BinaryGeneric;
+
+    if (operation == TokenType::EQUAL_EQUAL) {
+        kind = NodeKind::Equal;
+    } else if (operation == TokenType::BANG_EQUAL) {
+        kind = NodeKind::NotEqual;
+    } else if (lhs.is_number() && rhs.is_number()) {
+        switch (operation) {
+            case TokenType::PLUS:           kind = NodeKind::NumberAdd; break;
+            case TokenType::MINUS:          kind = NodeKind::NumberSubtract; break;
+            case TokenType::STAR:           kind = NodeKind::NumberMultiply; break;
+            case TokenType::SLASH:          kind = NodeKind::NumberDivide; break;
+            case TokenType::LESS:           kind = NodeKind::NumberLess; break;
+            case TokenType::LESS_EQUAL:     kind = NodeKind::NumberLessEqual; break;
+            case TokenType::GREATER:        kind = NodeKind::NumberGreater; break;
+            case TokenType::GREATER_EQUAL:  kind = NodeKind::NumberGreaterEqual; break;
+            default: break;
+        }
+    } else if (operation == TokenType::PLUS &&
+               is_obj_type(lhs, ObjType::String) &&
+               is_obj_type(rhs, ObjType::String)) {
+        kind = NodeKind::StringConcat;
+    }
+}
+
+void Interpreter::despecialize_(NodeIndex node) {
+    ast_->kinds[node] = NodeKind::BinaryGeneric;
+}
+
+Value Interpreter::concatenate_(const Value& lhs, const Value& rhs) {
+    return Value::object(heap_.intern(as_obj<ObjString>(lhs)->chars + as_obj<ObjString>(rhs)->chars));
+}
+
+bool Interpreter::is_thruthy_(const Value& value) {
+    return !value.is_falsey();
+}
+
+bool Interpreter::is_equal_(const Value& a, const Value& b) {
+    // Strings are interned, so comparing the values is enough.
+    return a == b;
+}
+
+void Interpreter::define_variable_(std::string_view name, const Value& value) {
+    if (curr_env_) {
+        curr_env_->define(value);
+    } else if (auto global = globals_.find(name); global != globals_.end()) {
+        global->second = value;
+    } else {
+        globals_.emplace(name, value);
+    }
 }
 
 void Interpreter::stringify_() {
-    switch (value.index()) {
-        case 0:
-            std::print("nil\n");
-            break;
-            
-        case 1:
-            std::print("{}\n", std::get<1>(value));
-            break;
-            
-        case 2:
-            std::print("{}\n", std::get<2>(value));
-            break;
-            
-        case 3:
-            std::print("{}\n", std::get<3>(value));
-            break;
-            
-        case 4:
-            std::print("{}\n", std::get<4>(value));
-            break;
-            
-        case 5:
-            std::cout << std::get<Callable>(value) << "\n";
-            break;
-            
-        case 6:
-            std::cout << std::get<std::shared_ptr<LoxInstance>>(value)->lox_class->name << "\n";
-            break;
-            
-        default:
-            std::print("Unknown value type\n");
-            break;
+    std::print("{}\n", stringify(value));
+}
+
+void Interpreter::collect_garbage_() {
+    heap_.mark(value);
+    heap_.mark(curr_env_);
+    for(auto env: saved_envs_) {
+        heap_.mark(env);
+    }
+    for(auto upvalue = open_upvalues_; upvalue != nullptr; upvalue = upvalue->next_open) {
+        heap_.mark(upvalue);
+    }
+    for(const auto& frame: frames_) {
+        heap_.mark(frame.caller_env);
+        for(auto upvalue = frame.caller_upvalues; upvalue != nullptr; upvalue = upvalue->next_open) {
+            heap_.mark(upvalue);
+        }
+    }
+    for(const auto& stacked: value_stack_) {
+        heap_.mark(stacked);
+    }
+    for(const auto& [name, global]: globals_) {
+        heap_.mark(global);
+    }
+    for(const auto& rooted: jit_.roots()) {
+        heap_.mark(rooted);
+    }
+    for(const auto& constant: closures_.roots()) {
+        heap_.mark(constant);
+    }
+
+    heap_.collect();
+
+    // The heap does not own environments, so they are not swept and nothing cleared their marks.
+    auto clear_mark = [](Environment* env) {
+        if (env != nullptr) {
+            env->marked = false;
+        }
+    };
+    clear_mark(curr_env_);
+    for(auto env: saved_envs_) {
+        clear_mark(env);
+    }
+    for(const auto& frame: frames_) {
+        clear_mark(frame.caller_env);
+    }
+}
+
+PropertyCacheEntry Interpreter::lookup_get_(LoxInstance* instance, NodeIndex get, CacheCounters& counters) {
+    auto& cache = ast_->caches[b_[get]];
+    if (auto entry = cache.find(instance->shape)) {
+        ++counters.hits;
+        return *entry;
     }
 
+    ++counters.misses;
+    auto name = ast_->name(get);
+    auto property = instance->lookup_get(name, method_ids_.find(name));
+    cache.add(property);
+    return property;
 }
 
-Callable Interpreter::make_func_callable_(const std::shared_ptr<FunctionDeclStatement>& stmt,
-                                          const std::shared_ptr<LoxInstance>& instance,
-                                          const std::shared_ptr<LoxClass>& super_class) {
-    Callable callable;
-    callable.arity = static_cast<int>(stmt->params.size());
-    callable.func = [this, stmt, instance, super_class](const std::vector<std::any>& params) -> std::any {
-        Environment env;
-        Environment class_env{curr_env_};
-        
+LoxFunction* Interpreter::find_super_method_(NodeIndex super, LoxInstance*& receiver) {
+    // The node is resolved to "this", the super class is the running method's.
+    auto resolved = resolved_(super);
+    if (resolved.is_global() || frames_.empty() || frames_.back().function->super_class == nullptr) {
+        throw RuntimeError("Could not find 'super' in environment.");
+    }
+
+    auto super_class = frames_.back().function->super_class;
+    Value this_value = lookup_variable_(super);
+    if (!is_obj_type(this_value, ObjType::LoxInstance)) {
+        throw RuntimeError("Could not find 'super' in environment.");
+    }
+
+    // Ids are never taken back, so once the name has one it can stay on the node.
+    auto method_name = ast_->name(super);
+    auto& method_id = ast_->a[super];
+    if (method_id == no_node) {
+        method_id = static_cast<uint32_t>(method_ids_.find(method_name));
+    }
+
+    auto method = super_class->find_method(static_cast<int>(method_id));
+    if (method == nullptr) {
+        std::stringstream stream;
+        stream << "Field/method is unknown: " << method_name;
+        throw RuntimeError(stream.str());
+    }
+
+    receiver = as_obj<LoxInstance>(this_value);
+    return method;
+}
+
+void Interpreter::call_(const Value& callee, LoxInstance* receiver, size_t arg_base, NodeIndex call) {
+    int arg_count = static_cast<int>(value_stack_.size() - arg_base);
+
+    if (is_obj_type(callee, ObjType::LoxFunction)) {
+        auto function = as_obj<LoxFunction>(callee);
+        if (arg_count != function->arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", function->arity, arg_count));
+        }
+
+        call_function_(function, receiver ? receiver : function->receiver, arg_base);
+    } else if (is_obj_type(callee, ObjType::Native)) {
+        auto native = as_obj<ObjNative>(callee);
+        if (arg_count != native->arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", native->arity, arg_count));
+        }
+
+        value = native->function(arg_count, value_stack_.data() + arg_base);
+    } else if (is_obj_type(callee, ObjType::LoxClass)) {
         //
-        // If there is an instance, we are setting up a class method so setup environment properly.
+        // Calling a class makes a new instance and runs init on it, if there is one.
         //
-        if (instance) {
-            class_env.define("this", instance);
-            if (super_class) {
-                class_env.define("super", super_class);
-            }
-            env.set_parent(&class_env);
-        } else {
-            env.set_parent(curr_env_);
+        auto lox_class = as_obj<LoxClass>(callee);
+        auto instance = LoxInstance::create(heap_, lox_class);
+
+        int arity = lox_class->initializer ? lox_class->initializer->arity : 0;
+        if (arg_count != arity) {
+            throw RuntimeError(std::format("Expected {} arguments but got {}.", arity, arg_count));
         }
 
-        for(int i = 0; i < params.size(); ++i) {
-            env.define(stmt->params[i].lexeme, std::any_cast<ValueType>(params[i]));
+        if (lox_class->initializer) {
+            call_function_(lox_class->initializer, instance, arg_base);
         }
 
-        return_called_ = false;
-        value = std::monostate();
+        value = Value::object(instance);
+    } else {
+        std::stringstream stream;
+        stream << "This is not a callable object at line: " << ast_->line(call);
+        throw RuntimeError(stream.str());
+    }
+}
 
-        execute_block_(stmt->body, env);
+void Interpreter::tail_call_(NodeIndex node) {
+    Value callee;
+    LoxInstance* receiver = nullptr;
+    auto arg_base = evaluate_call_(node, callee, receiver);
 
-        if (stmt->name.lexeme == "init") {
-            if (return_called_) {
-                throw RuntimeError("Return makes no sense in an initializer.");
-            }
-            value = instance;
-        } else {
-            // If the function just ends with no return, the result is nil.
-            if (!return_called_) {
-                value = std::monostate();
-            }
+    // Only a Lox function can take over the caller's frame, anything else is called right here.
+    if (!is_obj_type(callee, ObjType::LoxFunction)) {
+        call_(callee, receiver, arg_base, node);
+        value_stack_.resize(arg_base - 1);
+        return;
+    }
+
+    auto function = as_obj<LoxFunction>(callee);
+    int arg_count = static_cast<int>(value_stack_.size() - arg_base);
+    if (arg_count != function->arity) {
+        throw RuntimeError(std::format("Expected {} arguments but got {}.", function->arity, arg_count));
+    }
+
+    // The callee and its arguments stay on the value stack, call_function_ picks them up once the caller is done.
+    tail_call_pending_ = TailCall{function, receiver ? receiver : function->receiver, arg_base};
+}
+
+void Interpreter::call_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base) {
+    //
+    // A call in tail position does not run inside its caller.  The caller returns, its callee and arguments are
+    // moved down over the caller's own and the callee runs here in their place, so tail recursion runs in constant
+    // stack.
+    //
+    run_function_(function, receiver, arg_base);
+    while (tail_call_pending_.function != nullptr) {
+        auto tail_call = tail_call_pending_;
+        tail_call_pending_ = TailCall{};
+
+        std::copy(value_stack_.begin() + static_cast<std::ptrdiff_t>(tail_call.arg_base - 1), value_stack_.end(),
+                  value_stack_.begin() + static_cast<std::ptrdiff_t>(arg_base - 1));
+        value_stack_.resize(arg_base + tail_call.function->arity);
+
+        run_function_(tail_call.function, tail_call.receiver, arg_base);
+    }
+}
+
+void Interpreter::run_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base) {
+    //
+    // A function that has been called often enough runs as machine code, unless the Jit can not compile it, a
+    // guard in its code has failed or the compiled code's stack is full.
+    //
+    if (function->jit_code == nullptr && !function->is_method && jit_.count_call(*function)) {
+        function->jit_code = jit_.compile(*function);
+    }
+    if (function->jit_code != nullptr && !function->jit_code->deoptimized && jit_.has_room(*function->jit_code)) {
+        value = call_jit_(function, value_stack_.data() + arg_base);
+        return;
+    }
+
+    auto& frame = push_frame_(function);
+    FrameGuard frame_guard{*this};
+
+    // The function may come from an earlier program, run it in its own AST.  The frame goes back to the caller's.
+    use_ast_(function->ast);
+
+    // A method's receiver is "this", in the slot before the arguments.
+    auto body = c_[function->declaration];
+    auto env = frame.env = Environment::create(static_cast<int>(c_[body]));
+    if (function->is_method) {
+        env->define(Value::object(receiver));
+    }
+    for(int i = 0; i < function->arity; ++i) {
+        env->define(value_stack_[arg_base + i]);
+    }
+
+    // The body's block runs right in the call's environment, the frame puts the caller's back.
+    curr_env_ = env;
+    return_called_ = false;
+    for(auto statement: ast_->list(a_[body], b_[body])) {
+        execute_(statement);
+        if (return_called_) {
+            break;
         }
+    }
 
-        return value;
-    };
-    return callable;
+    if (function->is_initializer) {
+        // init always hands back the instance, even from an early return.
+        value = Value::object(receiver);
+    } else if (!return_called_) {
+        // If the function just ends with no return, the result is nil.
+        value = Value::nil();
+    }
+
+    // The return stops at the call, the caller carries on.
+    return_called_ = false;
+}
+
+Value Interpreter::call_jit_(LoxFunction* function, const Value* args) {
+    push_frame_(function);
+    FrameGuard frame_guard{*this};
+
+    // The arguments are still where the caller put them, this is a point where the collector may run.
+    if (heap_.should_collect()) {
+        collect_garbage_();
+    }
+
+    use_ast_(function->ast);
+    return jit_.run(*function->jit_code, args, function->arity);
+}
+
+void Interpreter::pop_frame_() {
+    auto& frame = frames_.back();
+    curr_env_ = frame.caller_env;
+    if (frame.caller_ast != ast_ && frame.caller_ast != nullptr) {
+        use_ast_(frame.caller_ast);
+    }
+    release_(frame.env);
+    open_upvalues_ = frame.caller_upvalues;
+    frames_.pop_back();
 }
 
 } // namespace cpplox
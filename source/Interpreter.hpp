@@ -1,80 +1,342 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
-#include "Common.hpp"
+#include "ClosureCompiler.hpp"
 #include "Environment.hpp"
-#include "Expr.hpp"
-#include "Stmt.hpp"
+#include "FlatAst.hpp"
+#include "Heap.hpp"
+#include "Jit.hpp"
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "NativeStack.hpp"
+#include "PropertyCache.hpp"
+#include "RuntimeError.hpp"
+#include "Shape.hpp"
+#include "StringHash.hpp"
+#include "Value.hpp"
 
-#include <any>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
-#include <variant>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace cpplox {
 
 // Forwards
-class LoxInstance;
+struct LoxClass;
+struct LoxFunction;
+struct LoxInstance;
 
-/// The interpreter that "executes" the AST nodes.
-class Interpreter: public ExprVisitor,
-                   public StmtVisitor {
+/// The interpreter that "executes" the AST nodes.  It walks the flat AST, calling the handler for each node's kind.
+class Interpreter {
+public:
+    /// Inline cache hits and misses, by the kind of site.  Method calls count separately from other gets.
+    struct CacheStats {
+        CacheCounters get;
+        CacheCounters set;
+        CacheCounters invoke;
+    };
+    
 private:
-    Environment global_env_{nullptr};
+    Heap heap_;
+    
+    /// The AST being run, which changes when we call a function declared by another program.
+    FlatAst* ast_ = nullptr;
+    
+    /// The columns of ast_ the evaluation loop reads, held here so reaching an operand takes one load less.
+    const NodeKind* kinds_ = nullptr;
+    const uint32_t* a_ = nullptr;
+    const uint32_t* b_ = nullptr;
+    const uint32_t* c_ = nullptr;
+    const uint32_t* lists_ = nullptr;
+    const LiteralValue* literals_ = nullptr;
+    
+    std::unordered_map<std::string, Value, StringHash, std::equal_to<>> globals_;
     Environment* curr_env_ = nullptr;
-    std::map<uintptr_t, int> locals_;
     bool return_called_ = false;
+    
+    /// The upvalues pointing into the environment of the running call, or of the top-level block, which closures
+    /// made there captured.  They are closed once the variable goes.  Sorted by slot, the highest first.
+    ObjUpvalue* open_upvalues_ = nullptr;
+    
+    /// Environments we will return to once the current block or call is done.
+    std::vector<Environment*> saved_envs_;
+    
+    /// Values held in the middle of an expression.  Arguments are evaluated onto it and the callee reads them
+    /// from there, and anything else that has to survive evaluating a subexpression waits here too, so the
+    /// collector can find it.
+    std::vector<Value> value_stack_;
+    
+    /// A call in tail position that is waiting for its caller to return.  Its callee and arguments are on the value
+    /// stack from arg_base on, as they would be for any call.
+    struct TailCall {
+        LoxFunction* function = nullptr;
+        LoxInstance* receiver = nullptr;
+        size_t arg_base = 0;
+    };
+    TailCall tail_call_pending_;
+    
+    /// One Lox call in progress.  Everything a call has to put back or free once it returns is kept here rather
+    /// than in the native frames of the handlers running it, so each call costs the native stack as little as it
+    /// can, and the frames sit next to each other in one stack whose depth --max-stack-depth bounds.
+    struct CallFrame {
+        LoxFunction* function = nullptr;
+        FlatAst* caller_ast = nullptr;
+        Environment* caller_env = nullptr;
+        ObjUpvalue* caller_upvalues = nullptr;
+        
+        /// The environment the call made, freed when it returns.
+        Environment* env = nullptr;
+    };
+    std::vector<CallFrame> frames_;
+    size_t max_stack_depth_ = default_max_stack_depth;
+    
+    /// The native stack programs run on, sized for max_stack_depth_ calls.
+    std::unique_ptr<NativeStack> native_stack_;
+    
+    /// A call overflows the stack once the native stack gets this low, however few frames there are.  Calls made
+    /// deep inside an expression take more native stack than most, this stops those before they run off the end.
+    const std::byte* native_stack_limit_ = nullptr;
+    
+    CacheStats cache_stats_;
+    MethodIds method_ids_;
+    
+    /// Shapes are never freed, so a shape cached at some site can not be confused with a newer one at the same address.
+    std::vector<std::unique_ptr<Shape>> root_shapes_;
+    
+    Jit jit_{*this};
+    
+    /// Compiles each program into closures and runs those instead of walking the nodes, for --engine=closure.
+    ClosureCompiler closures_{*this};
+    bool compile_closures_ = false;
                        
 public:
-    ValueType value;
+    static constexpr size_t default_max_stack_depth = 100'000;
+    
+    Value value;
     
     Interpreter();
-    void interpret(Expr& expr);
-    void interpret(const std::vector<std::unique_ptr<Stmt>>& stmts);
-                       
-    void resolve(uintptr_t expr_ptr, int depth);
+    void interpret(FlatAst& ast);
+    
+    const CacheStats& cache_stats() const {
+        return cache_stats_;
+    }
+    
+    void set_heap_policy(const HeapPolicy& policy) {
+        heap_.set_policy(policy);
+    }
+    
+    /// How many calls make a function hot enough to compile, 0 keeps everything interpreted.
+    void set_jit_threshold(uint32_t threshold) {
+        jit_.set_threshold(threshold);
+    }
+    
+    void set_compile_closures(bool compile) {
+        compile_closures_ = compile;
+    }
+    
+    /// How deep Lox calls may nest before a call fails with a stack overflow.
+    void set_max_stack_depth(size_t depth) {
+        max_stack_depth_ = depth;
+    }
     
-// ExprVisitor Implementation
-public:
-    void visit(const AssignExpr& expr) override;
-    void visit(const BinaryExpr& expr) override;
-    void visit(const LiteralExpr& expr) override;
-    void visit(const GroupingExpr& expr) override;
-    void visit(const UnaryExpr& expr) override;
-    void visit(const VariableExpr& expr) override;
-    void visit(const LogicalExpr& expr) override;
-    void visit(const CallExpr& expr) override;
-    void visit(const GetExpr& expr) override;
-    void visit(const SetExpr& expr) override;
-    void visit(const ThisExpr& expr) override;
-    void visit(const SuperExpr& expr) override;
-                       
-// StmtVisitor Implementation
-public:
-    void visit(const PrintStatement& stmt) override;
-    void visit(const ExpressionStatement& stmt) override;
-    void visit(const VariableDeclStatement& stmt) override;
-    void visit(const BlockStatement& stmt) override;
-    void visit(const IfStatement& stmt) override;
-    void visit(const WhileStatement& stmt) override;
-    void visit(const FunctionDeclStatementProxy& stmt_proxy) override;
-    void visit(const ReturnStatement& stmt) override;
-    void visit(const ClassDeclStatement& stmt) override;
-   
 // Internal Helpers
 private:
-    void evaluate_(Expr& expr);
-    void execute_(Stmt& stmt);
-    ValueType lookup_variable_(const Token& name, uintptr_t expr_ptr);
-    void execute_block_(const std::vector<std::unique_ptr<Stmt>>& statements,
-                        Environment& env);
-    bool is_thruthy_(const ValueType& value);
-    bool is_equal_(const ValueType& a, const ValueType& b);
+    // The compiled code's runtime helpers fall back on the handlers, and the closures run on the same runtime.
+    friend class Jit;
+    friend class ClosureCompiler;
+    
+    /// One handler per NodeKind.  evaluate_ and execute_ are inlined, so every place that runs a child calls
+    /// through the table on its own and each call gets predicted separately, as the virtual accept calls were.
+    using Handler = void (*)(Interpreter& interpreter, NodeIndex node);
+    static const Handler handlers_[node_kind_count];
+    
+    void evaluate_(NodeIndex node) {
+        handlers_[static_cast<size_t>(kinds_[node])](*this, node);
+    }
+    
+    void execute_(NodeIndex node) {
+        if (heap_.should_collect()) {
+            collect_garbage_();
+        }
+        
+        handlers_[static_cast<size_t>(kinds_[node])](*this, node);
+    }
+    
+    void assign_(NodeIndex node);
+    void binary_(NodeIndex node);
+    void number_add_(NodeIndex node);
+    void number_subtract_(NodeIndex node);
+    void number_multiply_(NodeIndex node);
+    void number_divide_(NodeIndex node);
+    void number_less_(NodeIndex node);
+    void number_less_equal_(NodeIndex node);
+    void number_greater_(NodeIndex node);
+    void number_greater_equal_(NodeIndex node);
+    void string_concat_(NodeIndex node);
+    void equal_(NodeIndex node);
+    void not_equal_(NodeIndex node);
+    void literal_(NodeIndex node);
+    void grouping_(NodeIndex node);
+    void unary_(NodeIndex node);
+    void variable_(NodeIndex node);
+    void logical_(NodeIndex node);
+    void call_expr_(NodeIndex node);
+    void get_(NodeIndex node);
+    void set_(NodeIndex node);
+    void super_(NodeIndex node);
+    void print_(NodeIndex node);
+    void expression_(NodeIndex node);
+    void var_decl_(NodeIndex node);
+    void block_(NodeIndex node);
+    void if_(NodeIndex node);
+    void while_(NodeIndex node);
+    void function_decl_(NodeIndex node);
+    void return_(NodeIndex node);
+    void class_decl_(NodeIndex node);
+    const Value& lookup_variable_(NodeIndex node);
+    
+    VariableSlot resolved_(NodeIndex node) const {
+        return VariableSlot{static_cast<Storage>(b_[node]), static_cast<int>(c_[node])};
+    }
+    
+    void use_ast_(FlatAst* ast);
+    
+    /// Runs the program's statements, on the native stack interpret switched to.
+    void run_program_(FlatAst& ast);
+    
+    /// Evaluates a binary node's operands, left to right.
+    void evaluate_operands_(NodeIndex node, Value& lhs, Value& rhs);
+    
+    /// Runs a binary node specialized for two numbers.  The guard is that both operands are numbers, when it fails
+    /// the node goes back to being generic.
+    template<typename Operation>
+    void number_binary_(NodeIndex node, Operation operation);
+    
+    /// The generic binary operation, which checks the operand types and throws a RuntimeError on a mismatch.
+    Value binary_operation_(NodeIndex node, const Value& lhs, const Value& rhs);
+    
+    /// Rewrites a Binary node into the specialized kind for the operands it just saw, or into BinaryGeneric.
+    void specialize_(NodeIndex node, const Value& lhs, const Value& rhs);
+    
+    /// Turns a specialized node whose guard failed into a generic one for good, so a site that sees mixed types
+    /// does not keep flipping between kinds.
+    void despecialize_(NodeIndex node);
+    
+    Value concatenate_(const Value& lhs, const Value& rhs);
+    void execute_block_(NodeIndex block,
+                        Environment* env);
+    
+    /// Runs a block's statements in the current environment, until one of them returns.
+    void execute_statements_(NodeIndex block);
+    
+    /// Ends a block that ran in the current environment, where its locals took the slots from defined on.
+    void end_block_(uint32_t defined) {
+        if (curr_env_ != nullptr) {
+            close_upvalues_(curr_env_->values() + defined);
+            curr_env_->truncate(defined);
+        }
+    }
+    void define_variable_(std::string_view name, const Value& value);
+    bool is_thruthy_(const Value& value);
+    bool is_equal_(const Value& a, const Value& b);
     void stringify_();
-    Callable make_func_callable_(const std::shared_ptr<FunctionDeclStatement>& stmt,
-                                 const std::shared_ptr<LoxInstance>& instance = nullptr,
-                                 const std::shared_ptr<LoxClass>& super_class = nullptr);
+    void collect_garbage_();
+    
+    /// Makes a function from its declaration in ast, capturing the variables it uses from the running code.
+    LoxFunction* make_function_(FlatAst* ast, NodeIndex declaration);
+    
+    /// The upvalue for a variable of the current environment, shared by every closure that captures it.
+    ObjUpvalue* capture_upvalue_(Value* local);
+    
+    /// Closes the open upvalues for the variables from last on, their closures keep the values from now on.
+    void close_upvalues_(const Value* last) {
+        while (open_upvalues_ != nullptr && open_upvalues_->location >= last) {
+            auto upvalue = open_upvalues_;
+            upvalue->closed = *upvalue->location;
+            upvalue->location = &upvalue->closed;
+            open_upvalues_ = upvalue->next_open;
+        }
+    }
+    
+    /// One of the running function's upvalues.
+    Value& upvalue_(int slot) {
+        return *frames_.back().function->upvalues[slot]->location;
+    }
+    
+    /// Deletes env once its scope is done with it, closing the upvalues that point into it.
+    void release_(Environment* env);
+    
+    // Makes sure environment gets setup correclty.  The one we leave goes on the saved stack so the collector still sees it.
+    struct EnvGuard {
+        Environment*& curr_env;
+        std::vector<Environment*>& saved;
+        EnvGuard(Environment*& curr_env,
+                 std::vector<Environment*>& saved,
+                 Environment* new_env): curr_env{curr_env}, saved{saved} {
+            saved.push_back(curr_env);
+            this->curr_env = new_env;
+        }
+        
+        ~EnvGuard() {
+            curr_env = saved.back();
+            saved.pop_back();
+        }
+    };
+    
+    // Releases an environment when its scope ends, however it ends.
+    struct ReleaseGuard {
+        Interpreter& interpreter;
+        Environment* env;
+        
+        ~ReleaseGuard() {
+            interpreter.release_(env);
+        }
+    };
+    
+    /// Starts a call to function, or throws a stack overflow when there is no room for one more.
+    CallFrame& push_frame_(LoxFunction* function) {
+        auto here = static_cast<const std::byte*>(__builtin_frame_address(0));
+        if (frames_.size() >= max_stack_depth_ || here < native_stack_limit_) {
+            throw RuntimeError("Stack overflow.");
+        }
+        
+        auto& frame = frames_.emplace_back(CallFrame{function, ast_, curr_env_, open_upvalues_});
+        open_upvalues_ = nullptr;
+        return frame;
+    }
+    
+    /// Returns to the caller's AST, environment and upvalues, and frees what the call made.
+    void pop_frame_();
+    
+    // Pops the call's frame, however the call ends.
+    struct FrameGuard {
+        Interpreter& interpreter;
+        
+        ~FrameGuard() {
+            interpreter.pop_frame_();
+        }
+    };
+    
+    PropertyCacheEntry lookup_get_(LoxInstance* instance, NodeIndex get, CacheCounters& counters);
+    LoxFunction* find_super_method_(NodeIndex super, LoxInstance*& receiver);
+    void call_(const Value& callee, LoxInstance* receiver, size_t arg_base, NodeIndex call);
+    
+    /// Evaluates a call's callee and then its arguments onto the value stack, returns where the arguments start.
+    size_t evaluate_call_(NodeIndex node, Value& callee, LoxInstance*& receiver);
+    
+    /// Evaluates a call in tail position, leaving a Lox function callee to run once the caller has returned.
+    void tail_call_(NodeIndex node);
+    
+    /// Calls the function and then whatever it, and its tail callees in turn, called in tail position.
+    void call_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base);
+    void run_function_(LoxFunction* function, LoxInstance* receiver, size_t arg_base);
+    
+    /// Runs a function's compiled code, in the function's own AST.
+    Value call_jit_(LoxFunction* function, const Value* args);
 };
 
 } // namespace cpplox
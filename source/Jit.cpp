@@ -0,0 +1,946 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Jit.hpp"
+
+#include "Interpreter.hpp"
+#include "LoxFunction.hpp"
+#include "RuntimeError.hpp"
+#include "TokenType.hpp"
+#include "X64Assembler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <print>
+#include <sstream>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define CPPLOX_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define CPPLOX_JIT 0
+#endif
+
+namespace cpplox {
+
+static constexpr uint64_t bits_(Value value) {
+    return std::bit_cast<uint64_t>(value);
+}
+
+static constexpr uint64_t nil_bits_ = bits_(Value::nil());
+static constexpr uint64_t false_bits_ = bits_(Value::boolean(false));
+static constexpr uint64_t true_bits_ = bits_(Value::boolean(true));
+static constexpr uint64_t sign_bit_ = 0x8000000000000000;
+
+/// A value is a number unless all the quiet NaN bits are set.
+static constexpr uint64_t quiet_nan_ = 0x7ffc000000000000;
+
+static_assert(true_bits_ == false_bits_ + 1, "Booleans are made by adding a comparison's result to false.");
+
+/// Compiles one function declaration into x86-64.
+///
+/// The code keeps the Jit in r12 and the frame in rbx, a value being computed is in rax.  Values that have to wait
+/// while another subexpression runs go to a frame slot rather than the machine stack, so the collector sees them.
+/// Anything the compiler does not handle clears supported_ and the declaration stays interpreted.
+class JitCompiler {
+private:
+    const FlatAst& ast_;
+    JitCode& code_;
+    X64Assembler as_;
+
+    /// The function's locals, the blocks in it included, take the first slot_count_ slots of the frame.  They are
+    /// defined in order, from next_slot_ on.
+    uint32_t slot_count_ = 0;
+    uint32_t next_slot_ = 0;
+
+    /// The first slot past the locals, and how many slots above it hold values in use.
+    uint32_t locals_top_ = 0;
+    uint32_t temps_ = 0;
+    uint32_t frame_size_ = 0;
+
+    size_t helper_calls_ = 0;
+    bool supported_ = true;
+    Label epilogue_;
+
+public:
+    JitCompiler(const FlatAst& ast, JitCode& code): ast_{ast}, code_{code} {
+    }
+
+    /// Returns false when the function uses something the compiler does not handle.
+    bool compile(NodeIndex declaration);
+
+    const std::vector<uint8_t>& machine_code() const {
+        return as_.code();
+    }
+
+// Internal Helpers
+private:
+    void statements_(uint32_t first, uint32_t count);
+    void statement_(NodeIndex node);
+    void block_(NodeIndex node);
+    void if_(NodeIndex node);
+    void while_(NodeIndex node);
+
+    void expression_(NodeIndex node);
+    void literal_(NodeIndex node);
+    void unary_(NodeIndex node);
+    void variable_(NodeIndex node);
+    void assign_(NodeIndex node);
+    void logical_(NodeIndex node);
+    void call_(NodeIndex node);
+    void binary_(NodeIndex node);
+    void number_binary_(NodeIndex node, TokenType operation);
+    void equality_(NodeIndex node, bool not_equal);
+
+    /// Evaluates a binary node's operands, left to right, into rcx and rax.
+    void operands_(NodeIndex node);
+
+    /// Whether node only loads a constant or a local into rax.
+    bool is_simple_(NodeIndex node) const;
+    bool is_number_literal_(NodeIndex node) const;
+
+    /// Jumps to target when the condition is falsey, comparisons of two numbers branch on the flags directly.
+    void jump_if_false_(NodeIndex condition, Label& target);
+    void jump_if_falsey_(Label& target);
+    void jump_if_truthy_(Label& target);
+
+    /// Jumps to fail unless reg holds a number, uses rdx and rsi.
+    void guard_number_(Reg reg, Label& fail);
+
+    /// Compares xmm0 and xmm1 for a comparison operator, returns the condition that holds when it is true.
+    Condition compare_(TokenType operation);
+    void boolean_(Condition condition);
+
+    /// Calls the generic operation for a binary node with the left side in rcx and the right side in rax.
+    void binary_slow_(NodeIndex node);
+
+    /// Calls a runtime helper whose arguments after the Jit are in place, and leaves when it returns an error.
+    void call_helper_(const void* helper, bool can_fail = true);
+
+    bool is_comparison_(TokenType operation) const;
+    uint32_t local_slot_(NodeIndex node);
+    bool is_global_(NodeIndex node) const;
+    uint32_t push_temps_(uint32_t count);
+    void pop_temps_(uint32_t count);
+
+    static int32_t offset_(uint32_t slot) {
+        return static_cast<int32_t>(slot * sizeof(Value));
+    }
+};
+
+bool JitCompiler::compile(NodeIndex declaration) {
+    auto body = ast_.c[declaration];
+    auto arity = ast_.b[declaration];
+    slot_count_ = ast_.c[body];
+    next_slot_ = arity;
+    locals_top_ = slot_count_;
+    frame_size_ = locals_top_;
+
+    // Three pushes after the return address keep the stack 16 byte aligned for the helpers.
+    as_.push(Reg::rbp);
+    as_.mov(Reg::rbp, Reg::rsp);
+    as_.push(Reg::rbx);
+    as_.push(Reg::r12);
+    as_.mov(Reg::r12, Reg::rdi);
+    as_.mov(Reg::rbx, Reg::rsi);
+
+    statements_(ast_.a[body], ast_.b[body]);
+
+    // Falling off the end returns nil.
+    as_.mov(Reg::rax, nil_bits_);
+
+    as_.bind(epilogue_);
+    as_.pop(Reg::r12);
+    as_.pop(Reg::rbx);
+    as_.pop(Reg::rbp);
+    as_.ret();
+
+    code_.frame_size = frame_size_;
+    return supported_;
+}
+
+void JitCompiler::statements_(uint32_t first, uint32_t count) {
+    for(uint32_t i = 0; i < count && supported_; ++i) {
+        statement_(ast_.lists[first + i]);
+    }
+}
+
+void JitCompiler::statement_(NodeIndex node) {
+    switch (ast_.kinds[node]) {
+        case NodeKind::Print:
+            expression_(ast_.a[node]);
+            as_.mov(Reg::rsi, Reg::rax);
+            call_helper_(reinterpret_cast<const void*>(&Jit::print_));
+            break;
+
+        case NodeKind::Expression:
+            expression_(ast_.a[node]);
+            break;
+
+        case NodeKind::VariableDecl: {
+            if (ast_.a[node] != no_node) {
+                expression_(ast_.a[node]);
+            } else {
+                as_.mov(Reg::rax, nil_bits_);
+            }
+
+            // Locals are defined in the order the Resolver gave them slots.
+            if (next_slot_ >= slot_count_) {
+                supported_ = false;
+                break;
+            }
+            as_.store(Reg::rbx, offset_(next_slot_++), Reg::rax);
+            break;
+        }
+
+        case NodeKind::Block:
+            block_(node);
+            break;
+
+        case NodeKind::If:
+            if_(node);
+            break;
+
+        case NodeKind::While:
+            while_(node);
+            break;
+
+        case NodeKind::Return:
+            // A tail call gives up the caller's frame, which compiled code can not do, the function stays interpreted.
+            if (ast_.b[node] != no_node) {
+                supported_ = false;
+                break;
+            }
+            if (ast_.a[node] != no_node) {
+                expression_(ast_.a[node]);
+            } else {
+                as_.mov(Reg::rax, nil_bits_);
+            }
+            as_.jmp(epilogue_);
+            break;
+
+        default:
+            // Nested functions and classes capture the environment, which compiled code does not have.
+            supported_ = false;
+            break;
+    }
+}
+
+void JitCompiler::block_(NodeIndex node) {
+    // Blocks in a function run in its environment, their locals take slots that are free again once they end.
+    if (ast_.has_environment(node)) {
+        supported_ = false;
+        return;
+    }
+
+    auto next_slot = next_slot_;
+    statements_(ast_.a[node], ast_.b[node]);
+    next_slot_ = next_slot;
+}
+
+void JitCompiler::if_(NodeIndex node) {
+    Label otherwise;
+    jump_if_false_(ast_.a[node], otherwise);
+    statement_(ast_.b[node]);
+
+    if (ast_.c[node] != no_node) {
+        Label done;
+        as_.jmp(done);
+        as_.bind(otherwise);
+        statement_(ast_.c[node]);
+        as_.bind(done);
+    } else {
+        as_.bind(otherwise);
+    }
+}
+
+void JitCompiler::while_(NodeIndex node) {
+    Label top;
+    Label done;
+    auto helper_calls = helper_calls_;
+
+    as_.bind(top);
+    jump_if_false_(ast_.a[node], done);
+    statement_(ast_.b[node]);
+
+    //
+    // The Interpreter collects between statements.  A loop that calls helpers may be allocating, so it stops to
+    // let the collector run, a loop that only does arithmetic never needs to.
+    //
+    if (helper_calls_ != helper_calls) {
+        call_helper_(reinterpret_cast<const void*>(&Jit::safepoint_), false);
+    }
+    as_.jmp(top);
+    as_.bind(done);
+}
+
+void JitCompiler::expression_(NodeIndex node) {
+    if (!supported_) {
+        return;
+    }
+
+    auto kind = ast_.kinds[node];
+    if (is_binary(kind)) {
+        binary_(node);
+        return;
+    }
+
+    switch (kind) {
+        case NodeKind::Literal:
+            literal_(node);
+            break;
+
+        case NodeKind::Grouping:
+            expression_(ast_.a[node]);
+            break;
+
+        case NodeKind::Unary:
+            unary_(node);
+            break;
+
+        case NodeKind::Variable:
+            variable_(node);
+            break;
+
+        case NodeKind::Assign:
+            assign_(node);
+            break;
+
+        case NodeKind::Logical:
+            logical_(node);
+            break;
+
+        case NodeKind::Call:
+            call_(node);
+            break;
+
+        default:
+            // Properties, this and super are left to the Interpreter.
+            supported_ = false;
+            break;
+    }
+}
+
+void JitCompiler::literal_(NodeIndex node) {
+    const auto& literal = ast_.literals[ast_.a[node]];
+
+    switch (literal.index()) {
+        case 1:
+            // Strings are interned when they are first needed, as the Interpreter does.
+            as_.mov(Reg::rsi, node);
+            call_helper_(reinterpret_cast<const void*>(&Jit::literal_));
+            break;
+
+        case 2:
+            as_.mov(Reg::rax, bits_(Value::number(std::get<double>(literal))));
+            break;
+
+        case 3:
+            as_.mov(Reg::rax, bits_(Value::boolean(std::get<bool>(literal))));
+            break;
+
+        default:
+            as_.mov(Reg::rax, nil_bits_);
+            break;
+    }
+}
+
+void JitCompiler::unary_(NodeIndex node) {
+    expression_(ast_.a[node]);
+
+    Label done;
+    switch (static_cast<TokenType>(ast_.c[node])) {
+        case TokenType::MINUS: {
+            // Negating a double only flips its sign bit.
+            Label slow;
+            guard_number_(Reg::rax, slow);
+            as_.mov(Reg::rcx, sign_bit_);
+            as_.xor_(Reg::rax, Reg::rcx);
+            as_.jmp(done);
+
+            as_.bind(slow);
+            as_.mov(Reg::rsi, Reg::rax);
+            call_helper_(reinterpret_cast<const void*>(&Jit::negate_));
+            break;
+        }
+
+        case TokenType::BANG: {
+            Label falsey;
+            jump_if_falsey_(falsey);
+            as_.mov(Reg::rax, false_bits_);
+            as_.jmp(done);
+
+            as_.bind(falsey);
+            as_.mov(Reg::rax, true_bits_);
+            break;
+        }
+
+        default:
+            supported_ = false;
+            break;
+    }
+    as_.bind(done);
+}
+
+void JitCompiler::variable_(NodeIndex node) {
+    if (!is_global_(node)) {
+        as_.load(Reg::rax, Reg::rbx, offset_(local_slot_(node)));
+        return;
+    }
+
+    Label slow;
+    Label done;
+    auto cell = &code_.global_cells.emplace_back(nullptr);
+    as_.mov(Reg::rcx, reinterpret_cast<uintptr_t>(cell));
+    as_.load(Reg::rcx, Reg::rcx, 0);
+    as_.test(Reg::rcx, Reg::rcx);
+    as_.jcc(Condition::Equal, slow);
+    as_.load(Reg::rax, Reg::rcx, 0);
+    as_.jmp(done);
+
+    as_.bind(slow);
+    as_.mov(Reg::rsi, node);
+    as_.mov(Reg::rdx, reinterpret_cast<uintptr_t>(cell));
+    call_helper_(reinterpret_cast<const void*>(&Jit::get_global_));
+    as_.bind(done);
+}
+
+void JitCompiler::assign_(NodeIndex node) {
+    expression_(ast_.a[node]);
+
+    if (!is_global_(node)) {
+        as_.store(Reg::rbx, offset_(local_slot_(node)), Reg::rax);
+        return;
+    }
+
+    Label slow;
+    Label done;
+    auto cell = &code_.global_cells.emplace_back(nullptr);
+    as_.mov(Reg::rcx, reinterpret_cast<uintptr_t>(cell));
+    as_.load(Reg::rcx, Reg::rcx, 0);
+    as_.test(Reg::rcx, Reg::rcx);
+    as_.jcc(Condition::Equal, slow);
+    as_.store(Reg::rcx, 0, Reg::rax);
+    as_.jmp(done);
+
+    as_.bind(slow);
+    as_.mov(Reg::rdx, Reg::rax);
+    as_.mov(Reg::rsi, node);
+    as_.mov(Reg::rcx, reinterpret_cast<uintptr_t>(cell));
+    call_helper_(reinterpret_cast<const void*>(&Jit::set_global_));
+    as_.bind(done);
+}
+
+void JitCompiler::logical_(NodeIndex node) {
+    // Short circuit, rax still holds the left side.
+    Label done;
+    expression_(ast_.a[node]);
+    if (static_cast<TokenType>(ast_.c[node]) == TokenType::OR) {
+        jump_if_truthy_(done);
+    } else {
+        jump_if_falsey_(done);
+    }
+
+    expression_(ast_.b[node]);
+    as_.bind(done);
+}
+
+void JitCompiler::call_(NodeIndex node) {
+    // The callee and the arguments go to consecutive slots, the helper reads them from there.
+    auto first_arg = ast_.b[node];
+    auto arg_count = ast_.c[node];
+    auto base = push_temps_(1 + arg_count);
+
+    expression_(ast_.a[node]);
+    as_.store(Reg::rbx, offset_(base), Reg::rax);
+    for(uint32_t i = 0; i < arg_count; ++i) {
+        expression_(ast_.lists[first_arg + i]);
+        as_.store(Reg::rbx, offset_(base + 1 + i), Reg::rax);
+    }
+
+    as_.mov(Reg::rsi, node);
+    as_.lea(Reg::rdx, Reg::rbx, offset_(base));
+    as_.mov(Reg::rcx, arg_count);
+    call_helper_(reinterpret_cast<const void*>(&Jit::call_));
+
+    pop_temps_(1 + arg_count);
+}
+
+void JitCompiler::binary_(NodeIndex node) {
+    auto operation = static_cast<TokenType>(ast_.c[node]);
+    switch (operation) {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::STAR:
+        case TokenType::SLASH:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+            number_binary_(node, operation);
+            break;
+
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+            equality_(node, operation == TokenType::BANG_EQUAL);
+            break;
+
+        default:
+            supported_ = false;
+            break;
+    }
+}
+
+void JitCompiler::number_binary_(NodeIndex node, TokenType operation) {
+    Label slow;
+    Label done;
+
+    operands_(node);
+    guard_number_(Reg::rcx, slow);
+    if (!is_number_literal_(ast_.b[node])) {
+        guard_number_(Reg::rax, slow);
+    }
+
+    as_.movq(Xmm::xmm0, Reg::rcx);
+    as_.movq(Xmm::xmm1, Reg::rax);
+    switch (operation) {
+        case TokenType::PLUS:   as_.addsd(Xmm::xmm0, Xmm::xmm1); break;
+        case TokenType::MINUS:  as_.subsd(Xmm::xmm0, Xmm::xmm1); break;
+        case TokenType::STAR:   as_.mulsd(Xmm::xmm0, Xmm::xmm1); break;
+        case TokenType::SLASH:  as_.divsd(Xmm::xmm0, Xmm::xmm1); break;
+        default: break;
+    }
+
+    if (is_comparison_(operation)) {
+        boolean_(compare_(operation));
+    } else {
+        as_.movq(Reg::rax, Xmm::xmm0);
+    }
+    as_.jmp(done);
+
+    as_.bind(slow);
+    binary_slow_(node);
+    as_.bind(done);
+}
+
+void JitCompiler::equality_(NodeIndex node, bool not_equal) {
+    //
+    // Two numbers compare as doubles, so NaN is not equal to itself.  Everything else is equal when the bits are,
+    // there is no guard to fail.
+    //
+    Label bits;
+    Label done;
+
+    operands_(node);
+    guard_number_(Reg::rcx, bits);
+    guard_number_(Reg::rax, bits);
+
+    as_.movq(Xmm::xmm0, Reg::rcx);
+    as_.movq(Xmm::xmm1, Reg::rax);
+    as_.ucomisd(Xmm::xmm0, Xmm::xmm1);
+    if (not_equal) {
+        as_.setcc(Condition::NotEqual, Reg::rax);
+        as_.setcc(Condition::Parity, Reg::rdx);
+        as_.or8(Reg::rax, Reg::rdx);
+    } else {
+        as_.setcc(Condition::Equal, Reg::rax);
+        as_.setcc(Condition::NotParity, Reg::rdx);
+        as_.and8(Reg::rax, Reg::rdx);
+    }
+    as_.jmp(done);
+
+    as_.bind(bits);
+    as_.cmp(Reg::rcx, Reg::rax);
+    as_.setcc(not_equal ? Condition::NotEqual : Condition::Equal, Reg::rax);
+
+    as_.bind(done);
+    as_.movzx8(Reg::rax, Reg::rax);
+    as_.mov(Reg::rcx, false_bits_);
+    as_.add(Reg::rax, Reg::rcx);
+}
+
+void JitCompiler::operands_(NodeIndex node) {
+    auto lhs = ast_.a[node];
+    auto rhs = ast_.b[node];
+
+    // A right side that is only a load can not disturb rcx, the left side need not go through the frame.
+    if (is_simple_(rhs)) {
+        expression_(lhs);
+        as_.mov(Reg::rcx, Reg::rax);
+        expression_(rhs);
+        return;
+    }
+
+    auto temp = push_temps_(1);
+    expression_(lhs);
+    as_.store(Reg::rbx, offset_(temp), Reg::rax);
+    expression_(rhs);
+    as_.load(Reg::rcx, Reg::rbx, offset_(temp));
+    pop_temps_(1);
+}
+
+bool JitCompiler::is_simple_(NodeIndex node) const {
+    switch (ast_.kinds[node]) {
+        case NodeKind::Literal:
+            return ast_.literals[ast_.a[node]].index() != 1;
+        case NodeKind::Variable:
+            return !is_global_(node);
+        default:
+            return false;
+    }
+}
+
+bool JitCompiler::is_number_literal_(NodeIndex node) const {
+    return ast_.kinds[node] == NodeKind::Literal && ast_.literals[ast_.a[node]].index() == 2;
+}
+
+void JitCompiler::jump_if_false_(NodeIndex condition, Label& target) {
+    auto kind = ast_.kinds[condition];
+    auto operation = static_cast<TokenType>(ast_.c[condition]);
+    if (!is_binary(kind) || !is_comparison_(operation)) {
+        expression_(condition);
+        jump_if_falsey_(target);
+        return;
+    }
+
+    Label slow;
+    Label done;
+
+    operands_(condition);
+    guard_number_(Reg::rcx, slow);
+    if (!is_number_literal_(ast_.b[condition])) {
+        guard_number_(Reg::rax, slow);
+    }
+
+    //
+    // Every comparison is true on Above or AboveEqual, the opposite conditions also hold for NaN.
+    //
+    as_.movq(Xmm::xmm0, Reg::rcx);
+    as_.movq(Xmm::xmm1, Reg::rax);
+    auto holds = compare_(operation);
+    as_.jcc(holds == Condition::Above ? Condition::BelowEqual : Condition::Below, target);
+    as_.jmp(done);
+
+    as_.bind(slow);
+    binary_slow_(condition);
+    jump_if_falsey_(target);
+    as_.bind(done);
+}
+
+void JitCompiler::jump_if_falsey_(Label& target) {
+    as_.mov(Reg::rcx, nil_bits_);
+    as_.cmp(Reg::rax, Reg::rcx);
+    as_.jcc(Condition::Equal, target);
+    as_.mov(Reg::rcx, false_bits_);
+    as_.cmp(Reg::rax, Reg::rcx);
+    as_.jcc(Condition::Equal, target);
+}
+
+void JitCompiler::jump_if_truthy_(Label& target) {
+    Label falsey;
+    jump_if_falsey_(falsey);
+    as_.jmp(target);
+    as_.bind(falsey);
+}
+
+void JitCompiler::guard_number_(Reg reg, Label& fail) {
+    as_.mov(Reg::rdx, quiet_nan_);
+    as_.mov(Reg::rsi, reg);
+    as_.and_(Reg::rsi, Reg::rdx);
+    as_.cmp(Reg::rsi, Reg::rdx);
+    as_.jcc(Condition::Equal, fail);
+}
+
+Condition JitCompiler::compare_(TokenType operation) {
+    // ucomisd sets the flags like an unsigned compare, a < b is b above a.
+    switch (operation) {
+        case TokenType::LESS:
+            as_.ucomisd(Xmm::xmm1, Xmm::xmm0);
+            return Condition::Above;
+        case TokenType::LESS_EQUAL:
+            as_.ucomisd(Xmm::xmm1, Xmm::xmm0);
+            return Condition::AboveEqual;
+        case TokenType::GREATER:
+            as_.ucomisd(Xmm::xmm0, Xmm::xmm1);
+            return Condition::Above;
+        default:
+            as_.ucomisd(Xmm::xmm0, Xmm::xmm1);
+            return Condition::AboveEqual;
+    }
+}
+
+void JitCompiler::boolean_(Condition condition) {
+    as_.setcc(condition, Reg::rax);
+    as_.movzx8(Reg::rax, Reg::rax);
+    as_.mov(Reg::rcx, false_bits_);
+    as_.add(Reg::rax, Reg::rcx);
+}
+
+void JitCompiler::binary_slow_(NodeIndex node) {
+    as_.mov(Reg::rsi, Reg::rcx);
+    as_.mov(Reg::rdx, Reg::rax);
+    as_.mov(Reg::rcx, reinterpret_cast<uintptr_t>(&code_));
+    as_.mov(Reg::r8, node);
+    call_helper_(reinterpret_cast<const void*>(&Jit::binary_));
+}
+
+void JitCompiler::call_helper_(const void* helper, bool can_fail) {
+    as_.mov(Reg::rdi, Reg::r12);
+    as_.call(helper);
+    ++helper_calls_;
+
+    if (can_fail) {
+        // The error bits are already in rax, they are what the function returns.
+        as_.mov(Reg::rcx, Jit::error_bits_);
+        as_.cmp(Reg::rax, Reg::rcx);
+        as_.jcc(Condition::Equal, epilogue_);
+    }
+}
+
+bool JitCompiler::is_comparison_(TokenType operation) const {
+    return operation == TokenType::LESS || operation == TokenType::LESS_EQUAL ||
+           operation == TokenType::GREATER || operation == TokenType::GREATER_EQUAL;
+}
+
+uint32_t JitCompiler::local_slot_(NodeIndex node) {
+    //
+    // An upvalue belongs to a closure, which compiled code does not have.
+    //
+    auto resolved = ast_.resolved(node);
+    auto slot = static_cast<uint32_t>(resolved.slot);
+    if (resolved.is_upvalue() || slot >= slot_count_) {
+        supported_ = false;
+        return 0;
+    }
+
+    return slot;
+}
+
+bool JitCompiler::is_global_(NodeIndex node) const {
+    return ast_.resolved(node).is_global();
+}
+
+uint32_t JitCompiler::push_temps_(uint32_t count) {
+    auto first = locals_top_ + temps_;
+    temps_ += count;
+    frame_size_ = std::max(frame_size_, locals_top_ + temps_);
+    return first;
+}
+
+void JitCompiler::pop_temps_(uint32_t count) {
+    temps_ -= count;
+}
+
+// ---
+
+Jit::Jit(Interpreter& interpreter): interpreter_{interpreter} {
+}
+
+Jit::~Jit() {
+#if CPPLOX_JIT
+    for(auto& [declaration, code]: codes_) {
+        if (code) {
+            munmap(code->memory, code->mapped_size);
+        }
+    }
+#endif
+    if (perf_map_) {
+        std::fclose(perf_map_);
+    }
+}
+
+bool Jit::count_call(LoxFunction& function) {
+    return threshold_ != 0 && ++function.call_count == threshold_;
+}
+
+JitCode* Jit::compile(const LoxFunction& function) {
+    auto key = std::pair{static_cast<const FlatAst*>(function.ast), function.declaration};
+    if (auto found = codes_.find(key); found != codes_.end()) {
+        auto code = found->second.get();
+        return code && !code->deoptimized ? code : nullptr;
+    }
+
+    auto code = std::make_unique<JitCode>();
+    JitCompiler compiler{*function.ast, *code};
+    if (!CPPLOX_JIT || !compiler.compile(function.declaration) || !install_(*code, compiler.machine_code())) {
+        code.reset();
+    } else {
+        write_perf_map_(*code, function.name());
+    }
+
+    auto result = code.get();
+    codes_.emplace(key, std::move(code));
+    return result;
+}
+
+Value Jit::run(JitCode& code, const Value* args, int arity) {
+    if (!stack_) {
+        stack_ = std::make_unique<Value[]>(stack_size_);
+    }
+    if (stack_top_ + code.frame_size > stack_size_) {
+        throw RuntimeError("Stack overflow.");
+    }
+
+    // Every slot starts out as a value, the collector may look at them before the code stores to them.
+    auto frame = stack_.get() + stack_top_;
+    std::copy(args, args + arity, frame);
+    std::fill(frame + arity, frame + code.frame_size, Value::nil());
+
+    stack_top_ += code.frame_size;
+    auto result = code.entry(this, frame);
+    stack_top_ -= code.frame_size;
+
+    if (result == error_bits_) {
+        std::rethrow_exception(std::exchange(pending_, nullptr));
+    }
+    return std::bit_cast<Value>(result);
+}
+
+bool Jit::install_(JitCode& code, std::span<const uint8_t> machine_code) {
+#if CPPLOX_JIT
+    //
+    // The code is written while the pages are writable and only then made executable, they are never both.
+    //
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto mapped_size = (machine_code.size() + page_size - 1) / page_size * page_size;
+    auto memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    std::memcpy(memory, machine_code.data(), machine_code.size());
+    if (mprotect(memory, mapped_size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped_size);
+        return false;
+    }
+
+    code.memory = memory;
+    code.size = machine_code.size();
+    code.mapped_size = mapped_size;
+    code.entry = reinterpret_cast<JitCode::Entry>(memory);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::write_perf_map_(const JitCode& code, std::string_view name) {
+#if CPPLOX_JIT
+    if (perf_map_ == nullptr) {
+        perf_map_ = std::fopen(std::format("/tmp/perf-{}.map", getpid()).c_str(), "w");
+        if (perf_map_ == nullptr) {
+            return;
+        }
+    }
+
+    std::print(perf_map_, "{:x} {:x} lox:{}\n", reinterpret_cast<uintptr_t>(code.memory), code.size, name);
+    std::fflush(perf_map_);
+#endif
+}
+
+template<typename Helper>
+uint64_t Jit::guarded_(Jit* jit, Helper&& helper) {
+    try {
+        return bits_(helper());
+    } catch (...) {
+        jit->pending_ = std::current_exception();
+        return error_bits_;
+    }
+}
+
+uint64_t Jit::binary_(Jit* jit, uint64_t lhs, uint64_t rhs, JitCode* code, NodeIndex node) {
+    return guarded_(jit, [&] {
+        //
+        // The operands are not both numbers.  This operation still finishes here, the next call runs in the
+        // Interpreter, which specializes the node for what it actually sees.
+        //
+        auto operation = static_cast<TokenType>(jit->interpreter_.c_[node]);
+        if (operation != TokenType::EQUAL_EQUAL && operation != TokenType::BANG_EQUAL) {
+            code->deoptimized = true;
+        }
+        return jit->interpreter_.binary_operation_(node, std::bit_cast<Value>(lhs), std::bit_cast<Value>(rhs));
+    });
+}
+
+uint64_t Jit::negate_(Jit* jit, uint64_t) {
+    return guarded_(jit, [&]() -> Value {
+        throw RuntimeError("Operand must be a number.");
+    });
+}
+
+uint64_t Jit::literal_(Jit* jit, NodeIndex node) {
+    return guarded_(jit, [&] {
+        jit->interpreter_.literal_(node);
+        return jit->interpreter_.value;
+    });
+}
+
+uint64_t Jit::get_global_(Jit* jit, NodeIndex node, Value** cell) {
+    return guarded_(jit, [&] {
+        *cell = jit->find_global_(node);
+        return **cell;
+    });
+}
+
+uint64_t Jit::set_global_(Jit* jit, NodeIndex node, uint64_t value, Value** cell) {
+    return guarded_(jit, [&] {
+        *cell = jit->find_global_(node);
+        **cell = std::bit_cast<Value>(value);
+        return **cell;
+    });
+}
+
+uint64_t Jit::call_(Jit* jit, NodeIndex node, Value* callee_and_args, uint32_t arg_count) {
+    return guarded_(jit, [&] {
+        auto& interpreter = jit->interpreter_;
+        auto callee = callee_and_args[0];
+
+        // Compiled code calling compiled code skips the value stack.
+        if (is_obj_type(callee, ObjType::LoxFunction)) {
+            auto function = as_obj<LoxFunction>(callee);
+            if (function->jit_code && !function->jit_code->deoptimized && jit->has_room(*function->jit_code) &&
+                function->arity == static_cast<int>(arg_count)) {
+                return interpreter.call_jit_(function, callee_and_args + 1);
+            }
+        }
+
+        // The Interpreter reads the arguments off its value stack, the callee goes below them as call_expr_ does.
+        auto& value_stack = interpreter.value_stack_;
+        auto arg_base = value_stack.size() + 1;
+        value_stack.insert(value_stack.end(), callee_and_args, callee_and_args + 1 + arg_count);
+        interpreter.call_(callee, nullptr, arg_base, node);
+        value_stack.resize(arg_base - 1);
+        return interpreter.value;
+    });
+}
+
+uint64_t Jit::print_(Jit* jit, uint64_t value) {
+    return guarded_(jit, [&] {
+        jit->interpreter_.value = std::bit_cast<Value>(value);
+        jit->interpreter_.stringify_();
+        return Value::nil();
+    });
+}
+
+uint64_t Jit::safepoint_(Jit* jit) {
+    auto& interpreter = jit->interpreter_;
+    if (interpreter.heap_.should_collect()) {
+        interpreter.collect_garbage_();
+    }
+    return nil_bits_;
+}
+
+Value* Jit::find_global_(NodeIndex node) {
+    auto name = interpreter_.ast_->name(node);
+    auto global = interpreter_.globals_.find(name);
+    if (global == interpreter_.globals_.end()) {
+        std::stringstream stream;
+        stream << "Undefined variable: " << name;
+        throw RuntimeError(stream.str());
+    }
+    return &global->second;
+}
+
+} // namespace cpplox
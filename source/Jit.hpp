@@ -0,0 +1,139 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "FlatAst.hpp"
+#include "Value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace cpplox {
+
+// Forwards
+class Interpreter;
+class Jit;
+struct LoxFunction;
+
+/// The machine code for one function declaration.
+///
+/// The code works on NaN-boxed values kept in a frame of slots, the function's locals first and the values held in
+/// the middle of an expression after them.  Arithmetic and comparisons guard on both operands being numbers.
+struct JitCode {
+    using Entry = uint64_t (*)(Jit* jit, Value* frame);
+
+    Entry entry = nullptr;
+    void* memory = nullptr;
+    size_t size = 0;
+    size_t mapped_size = 0;
+    uint32_t frame_size = 0;
+
+    /// Set when a guard failed.  The operation that failed finishes the generic way and the function runs in the
+    /// Interpreter from its next call on.
+    bool deoptimized = false;
+
+    /// Where each global the code reads or writes lives, filled in the first time the code gets there.  Globals are
+    /// never removed, so the address stays good.
+    std::deque<Value*> global_cells;
+};
+
+/// A baseline JIT that compiles hot functions to x86-64.
+///
+/// The Interpreter counts the calls to each function.  When the count reaches the threshold the Jit compiles the
+/// declaration, once, and every function made from it runs as machine code from then on.  Anything the compiler
+/// does not handle, such as classes, closures over a local or a nested function, leaves the declaration to the
+/// Interpreter.  On other platforms than x86-64 nothing compiles.
+///
+/// Each compiled function is listed in /tmp/perf-<pid>.map, so perf can name its frames.
+class Jit {
+public:
+    static constexpr uint32_t default_threshold = 100;
+
+private:
+    /// Returned by the code and the runtime helpers when a RuntimeError is waiting in pending_, no value has
+    /// these bits.
+    static constexpr uint64_t error_bits_ = 0x7ffc000000000000;
+
+    /// Slots for every frame of compiled code, the collector marks them.
+    static constexpr size_t stack_size_ = 64 * 1024;
+
+    Interpreter& interpreter_;
+    uint32_t threshold_ = default_threshold;
+
+    /// The compiled declarations, a null entry is one the compiler could not handle.
+    std::map<std::pair<const FlatAst*, NodeIndex>, std::unique_ptr<JitCode>> codes_;
+
+    std::unique_ptr<Value[]> stack_;
+    size_t stack_top_ = 0;
+
+    /// An error thrown in a runtime helper, it is thrown again once the compiled code has unwound to run().
+    std::exception_ptr pending_;
+
+    std::FILE* perf_map_ = nullptr;
+
+public:
+    explicit Jit(Interpreter& interpreter);
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    ~Jit();
+
+    /// Functions are compiled after this many calls, 0 turns the JIT off.
+    void set_threshold(uint32_t threshold) {
+        threshold_ = threshold;
+    }
+
+    /// Counts a call to function, returns true on the call that makes it hot.
+    bool count_call(LoxFunction& function);
+
+    /// Compiles the function's declaration, or hands back what an earlier compile made of it.  Returns nullptr
+    /// when the declaration can not be compiled or its code was deoptimized.
+    JitCode* compile(const LoxFunction& function);
+
+    /// Whether the compiled code's stack has room for one more frame of code.  When it does not, the call runs in
+    /// the Interpreter, which has a deeper stack.
+    bool has_room(const JitCode& code) const {
+        return stack_top_ + code.frame_size <= stack_size_;
+    }
+
+    /// Runs compiled code with arity arguments.  Throws whatever RuntimeError the function ran into.
+    Value run(JitCode& code, const Value* args, int arity);
+
+    /// The frames of the compiled code that is running.
+    std::span<const Value> roots() const {
+        return {stack_.get(), stack_top_};
+    }
+
+// Internal Helpers
+private:
+    friend class JitCompiler;
+
+    bool install_(JitCode& code, std::span<const uint8_t> machine_code);
+    void write_perf_map_(const JitCode& code, std::string_view name);
+
+    /// Runs a helper, turning an exception into error_bits_ so it never unwinds through machine code.
+    template<typename Helper>
+    static uint64_t guarded_(Jit* jit, Helper&& helper);
+
+    //
+    // Runtime helpers, the compiled code calls them for everything that is not inline.
+    //
+    static uint64_t binary_(Jit* jit, uint64_t lhs, uint64_t rhs, JitCode* code, NodeIndex node);
+    static uint64_t negate_(Jit* jit, uint64_t operand);
+    static uint64_t literal_(Jit* jit, NodeIndex node);
+    static uint64_t get_global_(Jit* jit, NodeIndex node, Value** cell);
+    static uint64_t set_global_(Jit* jit, NodeIndex node, uint64_t value, Value** cell);
+    static uint64_t call_(Jit* jit, NodeIndex node, Value* callee_and_args, uint32_t arg_count);
+    static uint64_t print_(Jit* jit, uint64_t value);
+    static uint64_t safepoint_(Jit* jit);
+
+    Value* find_global_(NodeIndex node);
+};
+
+} // namespace cpplox
@@ -1,24 +1,52 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #include "LoxClass.hpp"
 
-#include "RuntimeError.hpp"
-
-#include <sstream>
+#include "LoxFunction.hpp"
 
 namespace cpplox {
 
-ValueType LoxClass::find_method(const std::string& method_name) {
-    auto itr = methods.find(method_name);
-    if (itr != std::end(methods)) {
-        return itr->second;
+int MethodIds::intern(std::string_view name) {
+    auto itr = ids_.find(name);
+    if (itr == ids_.end()) {
+        itr = ids_.emplace(name, static_cast<int>(ids_.size())).first;
     }
-    
+    return itr->second;
+}
+
+int MethodIds::find(std::string_view name) const {
+    auto itr = ids_.find(name);
+    return itr == ids_.end() ? -1 : itr->second;
+}
+
+// ---
+
+LoxClass::LoxClass(const std::string& name,
+                   const std::map<int, LoxFunction*>& methods,
+                   LoxClass* super_class,
+                   Shape* root_shape):
+    Obj{ObjType::LoxClass},
+    name{name},
+    super_class{super_class},
+    root_shape{root_shape} {
     if (super_class) {
-        return super_class->find_method(method_name);
+        method_table = super_class->method_table;
     }
     
-    return nullptr;
+    for(const auto& [method_id, method]: methods) {
+        if (method_id >= static_cast<int>(method_table.size())) {
+            method_table.resize(method_id + 1, nullptr);
+        }
+        method_table[method_id] = method;
+    }
+    
+    initializer = find_method(MethodIds::init_id);
 }
 
-} // namespace cpplox
+void LoxClass::trace(Heap& heap) {
+    heap.mark(super_class);
+    for(auto method: method_table) {
+        heap.mark(method);
+    }
+}
 
+} // namespace cpplox
@@ -1,36 +1,85 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
-#include "Common.hpp"
+#include "Heap.hpp"
+#include "Object.hpp"
+#include "Shape.hpp"
+#include "StringHash.hpp"
 
+#include <functional>
 #include <map>
-#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace cpplox {
 
+// Forwards
+struct LoxFunction;
+
+/// Hands out a small id for every method name, so classes can keep their methods in a plain array.
+class MethodIds {
+private:
+    std::unordered_map<std::string, int, StringHash, std::equal_to<>> ids_;
+
+public:
+    /// init is always the first name handed out.
+    static constexpr int init_id = 0;
+
+    MethodIds() {
+        intern("init");
+    }
+
+    /// Returns the id for name, handing out a new one if it has never been seen.
+    int intern(std::string_view name);
+
+    /// Returns the id for name, or -1 when no class has ever declared a method by that name.
+    int find(std::string_view name) const;
+};
+
+// ---
+
 /// Represents a class in lox, which is primarily a containter for the methods and creates new instances.
-struct LoxClass {
+///
+/// The method table is flattened when the class is declared: it starts as a copy of the super class's table and
+/// the class's own methods override entries in it, so finding a method never walks up the super classes.
+struct LoxClass: public Obj {
     std::string name;
-    std::map<std::string, ValueType> methods;
-    Callable initializer;
-    std::shared_ptr<LoxClass> super_class;
+    std::vector<LoxFunction*> method_table;
+    LoxClass* super_class = nullptr;
 
+    /// The init method, inherited or not, nullptr when the class has none.
+    LoxFunction* initializer = nullptr;
+    
+    /// Every new instance starts out with no fields in this shape.  The class does not own it, inline caches
+    /// compare shape pointers and must never see a freed shape's address reused.
+    Shape* root_shape = nullptr;
+
+    /// methods maps method ids from MethodIds to the methods this class declares itself.
     LoxClass(const std::string& name,
-             const std::map<std::string, ValueType>& methods,
-             const std::shared_ptr<LoxClass> super_class):
-        name{name},
-        methods{methods},
-        super_class{super_class} {
+             const std::map<int, LoxFunction*>& methods,
+             LoxClass* super_class,
+             Shape* root_shape);
+    
+    static LoxClass* create(Heap& heap,
+                            const std::string& name,
+                            const std::map<int, LoxFunction*>& methods,
+                            LoxClass* super_class,
+                            Shape* root_shape) {
+        return heap.allocate<LoxClass>(name, methods, super_class, root_shape);
     }
     
-    static std::shared_ptr<LoxClass> create(const std::string& name,
-                                            const std::map<std::string, ValueType>& methods,
-                                            const std::shared_ptr<LoxClass> super_class) {
-        return std::make_shared<LoxClass>(name, methods, super_class);
+    /// Returns the method, declared here or inherited, nullptr if the class has no method with that id.
+    LoxFunction* find_method(int method_id) const {
+        if (method_id < 0 || method_id >= static_cast<int>(method_table.size())) {
+            return nullptr;
+        }
+        
+        return method_table[method_id];
     }
     
-    ValueType find_method(const std::string& method_name);
+    void trace(Heap& heap) override;
 };
 
 } // namespace cpplox
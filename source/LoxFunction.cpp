@@ -0,0 +1,28 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "LoxFunction.hpp"
+
+#include "LoxClass.hpp"
+#include "LoxInstance.hpp"
+
+namespace cpplox {
+
+LoxFunction* LoxFunction::bind(Heap& heap, LoxInstance* instance) const {
+    auto bound = LoxFunction::create(heap, ast, declaration);
+    bound->upvalues = upvalues;
+    bound->is_method = is_method;
+    bound->is_initializer = is_initializer;
+    bound->super_class = super_class;
+    bound->closure_code = closure_code;
+    bound->receiver = instance;
+    return bound;
+}
+
+void LoxFunction::trace(Heap& heap) {
+    for(auto upvalue: upvalues) {
+        heap.mark(upvalue);
+    }
+    heap.mark(super_class);
+    heap.mark(receiver);
+}
+
+} // namespace cpplox
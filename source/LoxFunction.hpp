@@ -0,0 +1,72 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "FlatAst.hpp"
+#include "Heap.hpp"
+#include "Object.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+struct ClosureCode;
+struct JitCode;
+struct LoxClass;
+struct LoxInstance;
+
+/// A Lox function or method, the declaration plus the variables it closed over.
+///
+/// Methods are stored unbound in their class.  Calling one needs a receiver, which is either handed over at the
+/// call site or remembered in receiver when the method was read off an instance as a value.
+struct LoxFunction: public Obj {
+    /// The FunctionDecl node, in the flat AST of the Program the function was declared in.
+    FlatAst*                                ast;
+    NodeIndex                               declaration;
+
+    /// The variables of enclosing functions the function uses, in the order the Resolver numbered them.
+    std::vector<ObjUpvalue*>                upvalues;
+    int                                     arity = 0;
+    bool                                    is_method = false;
+    bool                                    is_initializer = false;
+
+    /// What "super" refers to inside a method, if its class has a super class, and inside the functions nested in
+    /// the method.
+    LoxClass*                               super_class = nullptr;
+
+    /// Set when the method has been bound to an instance.
+    LoxInstance*                            receiver = nullptr;
+
+    /// Calls so far, and the machine code once the function got hot enough for the Jit to compile it.
+    uint32_t                                call_count = 0;
+    JitCode*                                jit_code = nullptr;
+
+    /// The compiled body, when the closure engine runs the program.
+    ClosureCode*                            closure_code = nullptr;
+
+    LoxFunction(FlatAst* ast,
+                NodeIndex declaration):
+        Obj{ObjType::LoxFunction},
+        ast{ast},
+        declaration{declaration},
+        arity{static_cast<int>(ast->b[declaration])} {
+    }
+
+    static LoxFunction* create(Heap& heap,
+                               FlatAst* ast,
+                               NodeIndex declaration) {
+        return heap.allocate<LoxFunction>(ast, declaration);
+    }
+
+    std::string_view name() const {
+        return ast->name(declaration);
+    }
+
+    /// Returns a copy of the method that remembers instance as its receiver.
+    LoxFunction* bind(Heap& heap, LoxInstance* instance) const;
+    
+    void trace(Heap& heap) override;
+};
+
+} // namespace cpplox
@@ -4,29 +4,48 @@
 
 #include "LoxClass.hpp"
 #include "RuntimeError.hpp"
+#include "Shape.hpp"
 
 #include <sstream>
 
 namespace cpplox {
 
-ValueType LoxInstance::get(const Token& name) {
-    auto itr = fields.find(name.lexeme);
-    if (itr == fields.end()) {
-        auto result = lox_class->find_method(name.lexeme);
-        if (result.index() == 0) {
-            std::stringstream stream;
-            stream << "Field/method is unknown: " << name.lexeme;
-            throw RuntimeError(stream.str());
-        } else {
-            return result;
-        }
+LoxInstance::LoxInstance(LoxClass* lox_class):
+    Obj{ObjType::LoxInstance},
+    lox_class{lox_class},
+    shape{lox_class->root_shape} {
+}
+
+void LoxInstance::trace(Heap& heap) {
+    heap.mark(lox_class);
+    for(const auto& field: fields) {
+        heap.mark(field);
+    }
+}
+
+PropertyCacheEntry LoxInstance::lookup_get(std::string_view name, int method_id) const {
+    int slot = shape->find(name);
+    if (slot >= 0) {
+        return PropertyCacheEntry{shape, slot};
     }
     
-    return itr->second;
+    auto method = lox_class->find_method(method_id);
+    if (method == nullptr) {
+        std::stringstream stream;
+        stream << "Field/method is unknown: " << name;
+        throw RuntimeError(stream.str());
+    }
+    
+    return PropertyCacheEntry{shape, -1, method};
 }
 
-void LoxInstance::set(const Token& name, const ValueType& value) {
-    fields[name.lexeme] = value;
+PropertyCacheEntry LoxInstance::lookup_set(std::string_view name) const {
+    int slot = shape->find(name);
+    if (slot >= 0) {
+        return PropertyCacheEntry{shape, slot};
+    }
+    
+    return PropertyCacheEntry{shape, shape->slot_count(), nullptr, shape->add(name)};
 }
 
 } // namespace cpplox
@@ -1,30 +1,57 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
-#include "Common.hpp"
-#include "Token.hpp"
+#include "Heap.hpp"
+#include "Object.hpp"
+#include "PropertyCache.hpp"
+#include "Value.hpp"
 
-#include <map>
-#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace cpplox {
 
 // Forwards
-class LoxClass;
+struct LoxClass;
+class Shape;
 
 /// An instance of a Lox class.  Primarily this is where the state lives.
-struct LoxInstance {
-    std::shared_ptr<LoxClass> lox_class;
-    std::map<std::string, ValueType> fields;
+///
+/// The field values sit in one array and the shape says which slot holds which field.
+struct LoxInstance: public Obj {
+    LoxClass* lox_class = nullptr;
+    Shape* shape = nullptr;
+    std::vector<Value> fields;
     
+    LoxInstance(LoxClass* lox_class);
     
-    static std::shared_ptr<LoxInstance> create() {
-        return std::make_shared<LoxInstance>();
+    static LoxInstance* create(Heap& heap, LoxClass* lox_class) {
+        return heap.allocate<LoxInstance>(lox_class);
     }
     
-    ValueType get(const Token& name);
-    void set(const Token& name, const ValueType& value);
+    /// Works out what reading name means for instances of this shape.  Fields shadow methods, and it throws
+    /// when name is neither.  method_id is the name's id from MethodIds, -1 if it has none.
+    PropertyCacheEntry lookup_get(std::string_view name, int method_id) const;
+    
+    /// Works out where assigning name goes for instances of this shape, adding the field if needed.
+    PropertyCacheEntry lookup_set(std::string_view name) const;
+    
+    void trace(Heap& heap) override;
+    
+    size_t owned_bytes() const override {
+        return fields.capacity() * sizeof(Value);
+    }
+    
+    /// Stores value using an entry from lookup_set for this instance's shape.
+    void set(const PropertyCacheEntry& entry, const Value& value) {
+        if (entry.transition) {
+            shape = entry.transition;
+            fields.push_back(value);
+        } else {
+            fields[entry.slot] = value;
+        }
+    }
 };
 
 } // namespace cpplox
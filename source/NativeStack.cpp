@@ -0,0 +1,131 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+
+// macOS only declares the ucontext functions for X/Open, which has to be asked for before any system header.  The
+// Darwin extensions, such as MAP_ANONYMOUS, have to be asked for again once it is.
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 700
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "NativeStack.hpp"
+
+#include <cstdint>
+#include <exception>
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define CPPLOX_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CPPLOX_ASAN 1
+#endif
+#endif
+
+#if defined(CPPLOX_ASAN)
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+// The ucontext functions are deprecated on macOS, but still the only way there to switch stacks on one thread.
+#if defined(__clang__)
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+namespace cpplox {
+
+/// The work run() was given and what it threw, handed to the code running on the new stack.
+struct StackCall {
+    const std::function<void()>& work;
+    std::exception_ptr error;
+
+    /// The caller's stack, which AddressSanitizer is told it is going back to.
+    const void* caller_bottom = nullptr;
+    size_t caller_size = 0;
+};
+
+//
+// AddressSanitizer keeps track of which stack the thread is on and has to be told when it switches, or it takes
+// the other stack's frames for bad accesses.  Without it these do nothing.
+//
+#if defined(CPPLOX_ASAN)
+static void start_switch_(void** fake_stack, const void* bottom, size_t size) {
+    __sanitizer_start_switch_fiber(fake_stack, bottom, size);
+}
+
+static void finish_switch_(void* fake_stack, const void** bottom, size_t* size) {
+    __sanitizer_finish_switch_fiber(fake_stack, bottom, size);
+}
+#else
+static void start_switch_(void**, const void*, size_t) {
+}
+
+static void finish_switch_(void*, const void**, size_t*) {
+}
+#endif
+
+/// Where the new stack starts.  makecontext only passes ints, so the call's address comes in two halves.
+static void start_call_(uint32_t high, uint32_t low) {
+    auto call = reinterpret_cast<StackCall*>((static_cast<uintptr_t>(high) << 32) | low);
+    finish_switch_(nullptr, &call->caller_bottom, &call->caller_size);
+    try {
+        call->work();
+    } catch (...) {
+        call->error = std::current_exception();
+    }
+
+    // Returning switches back to the caller's context, and this stack is done with.
+    start_switch_(nullptr, call->caller_bottom, call->caller_size);
+}
+
+NativeStack::~NativeStack() {
+    if (memory_ != nullptr) {
+        munmap(memory_, mapped_size_);
+    }
+}
+
+std::unique_ptr<NativeStack> NativeStack::create(size_t size) {
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto mapped_size = (size + page_size - 1) / page_size * page_size + page_size;
+
+    auto memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    if (mprotect(memory, page_size, PROT_NONE) != 0) {
+        munmap(memory, mapped_size);
+        return nullptr;
+    }
+
+    std::unique_ptr<NativeStack> stack{new NativeStack()};
+    stack->memory_ = static_cast<std::byte*>(memory);
+    stack->mapped_size_ = mapped_size;
+    stack->guard_size_ = page_size;
+    return stack;
+}
+
+void NativeStack::run(const std::function<void()>& work) {
+    StackCall call{work, nullptr};
+
+    ucontext_t caller;
+    ucontext_t callee;
+    getcontext(&callee);
+    callee.uc_stack.ss_sp = memory_ + guard_size_;
+    callee.uc_stack.ss_size = size();
+    callee.uc_link = &caller;
+
+    auto address = reinterpret_cast<uintptr_t>(&call);
+    makecontext(&callee, reinterpret_cast<void (*)()>(&start_call_), 2, static_cast<uint32_t>(address >> 32),
+                static_cast<uint32_t>(address));
+    void* fake_stack = nullptr;
+    start_switch_(&fake_stack, bottom(), size());
+    swapcontext(&caller, &callee);
+    finish_switch_(fake_stack, nullptr, nullptr);
+
+    if (call.error) {
+        std::rethrow_exception(call.error);
+    }
+}
+
+} // namespace cpplox
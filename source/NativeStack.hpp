@@ -0,0 +1,45 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace cpplox {
+
+/// A native stack of our own, mapped from the heap, for code that recurses deeper than the thread's stack allows.
+///
+/// run() switches the thread onto this stack, calls the work and switches back once it is done, so everything
+/// still happens on the one thread.  The lowest page is a guard that faults, rather than running into whatever is
+/// mapped below.  Pages are only touched once the code gets that deep, so a big stack costs little until it is
+/// used.
+class NativeStack {
+private:
+    std::byte* memory_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t guard_size_ = 0;
+
+    NativeStack() = default;
+
+public:
+    NativeStack(const NativeStack&) = delete;
+    NativeStack& operator=(const NativeStack&) = delete;
+    ~NativeStack();
+
+    /// Maps a stack with at least size bytes to use, returns nullptr when the memory can not be had.
+    static std::unique_ptr<NativeStack> create(size_t size);
+
+    size_t size() const {
+        return mapped_size_ - guard_size_;
+    }
+
+    /// The lowest address the work can use, the stack grows down towards it.
+    const std::byte* bottom() const {
+        return memory_ + guard_size_;
+    }
+
+    /// Runs work on this stack, on the calling thread.  Whatever the work throws is thrown again here.
+    void run(const std::function<void()>& work);
+};
+
+} // namespace cpplox
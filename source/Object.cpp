@@ -0,0 +1,47 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Object.hpp"
+
+#include "Heap.hpp"
+
+namespace cpplox {
+
+void ObjFunction::trace(Heap& heap) {
+    heap.mark(name);
+    for(const auto& constant: chunk.constants) {
+        heap.mark(constant);
+    }
+}
+
+void ObjUpvalue::trace(Heap& heap) {
+    heap.mark(closed);
+}
+
+void ObjClosure::trace(Heap& heap) {
+    heap.mark(function);
+    for(auto upvalue: upvalues) {
+        heap.mark(upvalue);
+    }
+}
+
+void ObjClass::trace(Heap& heap) {
+    heap.mark(name);
+    for(const auto& [method_name, method]: methods) {
+        heap.mark(method_name);
+        heap.mark(method);
+    }
+}
+
+void ObjInstance::trace(Heap& heap) {
+    heap.mark(klass);
+    for(const auto& [field_name, field]: fields) {
+        heap.mark(field_name);
+        heap.mark(field);
+    }
+}
+
+void ObjBoundMethod::trace(Heap& heap) {
+    heap.mark(receiver);
+    heap.mark(method);
+}
+
+} // namespace cpplox
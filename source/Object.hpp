@@ -0,0 +1,195 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Chunk.hpp"
+#include "Value.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+class Heap;
+
+/// The types of heap objects.
+enum class ObjType: uint8_t {
+    String,
+    Function,
+    Native,
+    Closure,
+    Upvalue,
+    Class,
+    Instance,
+    BoundMethod,
+
+    // Objects used by the tree-walk interpreter.
+    LoxFunction,
+    LoxClass,
+    LoxInstance,
+    Environment
+};
+
+/// Base of everything that lives on the heap.  The heap chains all objects through next so it can sweep them.
+struct Obj {
+    ObjType     type;
+    bool        marked = false;
+    
+    /// What the heap counted for this object when it was allocated.
+    uint32_t    size = 0;
+    Obj*        next = nullptr;
+
+    Obj(ObjType type): type{type} {
+    }
+
+    virtual ~Obj() {
+    }
+    
+    /// Marks every object this one references.
+    virtual void trace(Heap&) {
+    }
+    
+    /// Memory the object owns outside of itself, such as the characters of a string.
+    virtual size_t owned_bytes() const {
+        return 0;
+    }
+};
+
+// ---
+
+/// Strings are interned by the heap, so two equal strings are always the same object.
+struct ObjString: public Obj {
+    std::string chars;
+
+    ObjString(const std::string& chars):
+        Obj{ObjType::String},
+        chars{chars} {
+    }
+    
+    size_t owned_bytes() const override {
+        return chars.capacity();
+    }
+};
+
+// ---
+
+/// A compiled function, the code plus what we need to call it.
+struct ObjFunction: public Obj {
+    int         arity = 0;
+    int         upvalue_count = 0;
+    int         slot_count = 1;     // The most locals in use at once, slot zero included.
+    Chunk       chunk;
+    ObjString*  name = nullptr;
+
+    ObjFunction(): Obj{ObjType::Function} {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+using NativeFn = Value (*)(int arg_count, Value* args);
+
+/// A function implemented in C++.
+struct ObjNative: public Obj {
+    int         arity = 0;
+    NativeFn    function = nullptr;
+
+    ObjNative(int arity, NativeFn function):
+        Obj{ObjType::Native},
+        arity{arity},
+        function{function} {
+    }
+};
+
+// ---
+
+/// A variable captured by a closure.  While open it points at the stack slot, once closed it points at closed.
+struct ObjUpvalue: public Obj {
+    Value*      location = nullptr;
+    Value       closed;
+    ObjUpvalue* next_open = nullptr;
+
+    ObjUpvalue(Value* location):
+        Obj{ObjType::Upvalue},
+        location{location} {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+/// A function plus the variables it captured, this is what actually gets called.
+struct ObjClosure: public Obj {
+    ObjFunction*                function;
+    std::vector<ObjUpvalue*>    upvalues;
+
+    ObjClosure(ObjFunction* function):
+        Obj{ObjType::Closure},
+        function{function},
+        upvalues(function->upvalue_count, nullptr) {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+struct ObjClass: public Obj {
+    ObjString*                              name;
+    std::unordered_map<ObjString*, Value>   methods;
+
+    ObjClass(ObjString* name):
+        Obj{ObjType::Class},
+        name{name} {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+struct ObjInstance: public Obj {
+    ObjClass*                               klass;
+    std::unordered_map<ObjString*, Value>   fields;
+
+    ObjInstance(ObjClass* klass):
+        Obj{ObjType::Instance},
+        klass{klass} {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+/// A method that remembers the instance it was accessed from.
+struct ObjBoundMethod: public Obj {
+    Value       receiver;
+    ObjClosure* method;
+
+    ObjBoundMethod(const Value& receiver, ObjClosure* method):
+        Obj{ObjType::BoundMethod},
+        receiver{receiver},
+        method{method} {
+    }
+    
+    void trace(Heap& heap) override;
+};
+
+// ---
+
+inline bool is_obj_type(const Value& value, ObjType type) {
+    return value.is_obj() && value.as_obj()->type == type;
+}
+
+template<typename T>
+inline T* as_obj(const Value& value) {
+    return static_cast<T*>(value.as_obj());
+}
+
+} // namespace cpplox
@@ -5,17 +5,18 @@
 
 namespace cpplox {
 
-std::vector<std::unique_ptr<Stmt>> Parser::parse() {
-    auto statements = std::vector<std::unique_ptr<Stmt>>();
+std::span<Stmt*> Parser::parse() {
+    auto statements = std::vector<Stmt*>();
     
     while(!is_at_end_()) {
         statements.push_back(declaration_());
     }
     
-    return statements;
+    program.statements = program.list(statements);
+    return program.statements;
 }
 
-std::unique_ptr<Stmt> Parser::declaration_() {
+Stmt* Parser::declaration_() {
     if (match_({TokenType::VAR})) {
         return var_declaration_();
     }
@@ -31,13 +32,13 @@ std::unique_ptr<Stmt> Parser::declaration_() {
     return statement_();
 }
 
-std::unique_ptr<Stmt> Parser::statement_() {
+Stmt* Parser::statement_() {
     if (match_({TokenType::PRINT})) {
         return print_statement_();
     }
     
     if (match_({TokenType::LEFT_BRACE})) {
-        return BlockStatement::create(block_());
+        return BlockStatement::create(program, block_());
     }
     
     if (match_({TokenType::IF})) {
@@ -59,107 +60,107 @@ std::unique_ptr<Stmt> Parser::statement_() {
     return expression_statement_();
 }
 
-std::unique_ptr<Stmt> Parser::if_statement_() {
+Stmt* Parser::if_statement_() {
     consume_(TokenType::LEFT_PAREN, "Expect '(' after if.");
-    std::unique_ptr<Expr> condition = expression_();
+    Expr* condition = expression_();
     consume_(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
     
     auto then_branch = statement_();
-    std::unique_ptr<Stmt> else_branch;
+    Stmt* else_branch = nullptr;
     if (match_({TokenType::ELSE})) {
         else_branch = statement_();
     }
     
-    return IfStatement::create(std::move(condition), std::move(then_branch), std::move(else_branch));
+    return IfStatement::create(program, condition, then_branch, else_branch);
     
 }
 
-std::unique_ptr<Stmt> Parser::for_statement_() {
+Stmt* Parser::for_statement_() {
     consume_(TokenType::LEFT_PAREN, "Expect '(' after for.");
     
-    std::unique_ptr<Stmt> initializer;
+    Stmt* initializer = nullptr;
     if (match_({TokenType::SEMICOLON})) {
-        initializer = nullptr;
+        // No initializer.
     } else if (match_({TokenType::VAR})) {
         initializer = var_declaration_();
     } else {
         initializer = expression_statement_();
     }
     
-    std::unique_ptr<Expr> condition;
+    Expr* condition = nullptr;
     if (!check_(TokenType::SEMICOLON)) {
         condition = expression_();
     }
     
     consume_(TokenType::SEMICOLON, "Expect ';' after loop condition.");
     
-    std::unique_ptr<Expr> increment;
+    Expr* increment = nullptr;
     if (!check_(TokenType::RIGHT_PAREN)) {
         increment = expression_();
     }
     
     consume_(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
     
-    std::unique_ptr<Stmt> body = statement_();
+    Stmt* body = statement_();
     
     if (increment) {
-        std::vector<std::unique_ptr<Stmt>> stmts;
-        stmts.push_back(std::move(body));
-        stmts.push_back(ExpressionStatement::create(std::move(increment)));
+        std::vector<Stmt*> stmts;
+        stmts.push_back(body);
+        stmts.push_back(ExpressionStatement::create(program, increment));
         
-        body = BlockStatement::create(std::move(stmts));
+        body = BlockStatement::create(program, stmts);
     }
     
     if (!condition) {
-        condition = LiteralExpr::create(true);
+        condition = LiteralExpr::create(program, true);
     }
     
-    body = WhileStatement::create(std::move(condition), std::move(body));
+    body = WhileStatement::create(program, condition, body);
     
     if (initializer) {
-        std::vector<std::unique_ptr<Stmt>> stmts;
-        stmts.push_back(std::move(initializer));
-        stmts.push_back(std::move(body));
-        body = BlockStatement::create(std::move(stmts));
+        std::vector<Stmt*> stmts;
+        stmts.push_back(initializer);
+        stmts.push_back(body);
+        body = BlockStatement::create(program, stmts);
     }
     
     return body;
 }
 
-std::unique_ptr<Stmt> Parser::print_statement_() {
+Stmt* Parser::print_statement_() {
     auto expr = expression_();
     consume_(TokenType::SEMICOLON, "Expect ';' after print.");
     
-    return PrintStatement::create(std::move(expr));
+    return PrintStatement::create(program, expr);
 }
 
-std::unique_ptr<Stmt> Parser::return_statement_() {
-    Token keyword = previous_();
+Stmt* Parser::return_statement_() {
+    const Token& keyword = previous_();
     
-    std::unique_ptr<Expr> value;
+    Expr* value = nullptr;
     if (!check_(TokenType::SEMICOLON)) {
         value = expression_();
     }
     
     consume_(TokenType::SEMICOLON, "Expect ';' after return value.");
     
-    return ReturnStatement::create(keyword, std::move(value));
+    return ReturnStatement::create(program, keyword, value);
 }
 
-std::unique_ptr<Stmt> Parser::var_declaration_() {
-    auto name = consume_(TokenType::IDENTIFIER, "Expected variable name.");
+Stmt* Parser::var_declaration_() {
+    const auto& name = consume_(TokenType::IDENTIFIER, "Expected variable name.");
     
-    std::unique_ptr<Expr> initializer;
+    Expr* initializer = nullptr;
     if (match_({TokenType::EQUAL})) {
         initializer = expression_();
     }
     
     consume_(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
     
-    return VariableDeclStatement::create(name, std::move(initializer));
+    return VariableDeclStatement::create(program, name, initializer);
 }
 
-std::unique_ptr<Stmt> Parser::while_statement_() {
+Stmt* Parser::while_statement_() {
     consume_(TokenType::LEFT_PAREN, "Expect '(' after 'while.'");
     
     auto condition = expression_();
@@ -168,28 +169,28 @@ std::unique_ptr<Stmt> Parser::while_statement_() {
     
     auto body = statement_();
     
-    return WhileStatement::create(std::move(condition), std::move(body));
+    return WhileStatement::create(program, condition, body);
     
 }
 
-std::unique_ptr<Stmt> Parser::expression_statement_() {
+Stmt* Parser::expression_statement_() {
     auto expr = expression_();
     consume_(TokenType::SEMICOLON, "Expect ';' after expression.");
     
-    return ExpressionStatement::create(std::move(expr));
+    return ExpressionStatement::create(program, expr);
 }
 
-std::unique_ptr<Stmt> Parser::function_decl_statement_(const std::string& kind) {
-    Token name = consume_(TokenType::IDENTIFIER, "Expect " + kind + " name");
+Stmt* Parser::function_decl_statement_(const std::string& kind) {
+    const Token& name = consume_(TokenType::IDENTIFIER, "Expect " + kind + " name");
     consume_(TokenType::LEFT_PAREN, "Expect '('" + kind + " after name.");
-    std::vector<Token> params;
+    std::vector<TokenRef> params;
     if (!check_(TokenType::RIGHT_PAREN)) {
         if (params.size() >= 255) {
             throw ParserError("Too many parameters.", name);
         }
         
         do {
-            params.push_back(consume_(TokenType::IDENTIFIER, "Exepect param name."));
+            params.push_back(program.ref(consume_(TokenType::IDENTIFIER, "Exepect param name.")));
         } while (match_({TokenType::COMMA}));
         
     }
@@ -198,33 +199,33 @@ std::unique_ptr<Stmt> Parser::function_decl_statement_(const std::string& kind)
     
     auto body = block_();
     
-    return FunctionDeclStatementProxy::create(name, params, std::move(body));
+    return FunctionDeclStatementProxy::create(program, name, params, body);
 }
 
-std::unique_ptr<Stmt> Parser::class_decl_statement_() {
-    Token name = consume_(TokenType::IDENTIFIER, "Expect class name");
-    std::unique_ptr<VariableExpr> super_class;
+Stmt* Parser::class_decl_statement_() {
+    const Token& name = consume_(TokenType::IDENTIFIER, "Expect class name");
+    VariableExpr* super_class = nullptr;
     if (match_({TokenType::LESS})) {
         consume_(TokenType::IDENTIFIER, "Expect superclass name.");
-        super_class = VariableExpr::create(previous_());
+        super_class = VariableExpr::create(program, previous_());
     }
     consume_(TokenType::LEFT_BRACE, "Expect '{' before class body.");
     
-    std::vector<std::shared_ptr<FunctionDeclStatement>> methods;
+    std::vector<FunctionDeclStatement*> methods;
     while(!check_(TokenType::RIGHT_BRACE) && !is_at_end_()) {
         auto stmt = function_decl_statement_("method");
-        auto proxy = dynamic_cast<FunctionDeclStatementProxy*>(stmt.get());
+        auto proxy = static_cast<FunctionDeclStatementProxy*>(stmt);
         
         methods.push_back(proxy->stmt);
     }
     
     consume_(TokenType::RIGHT_BRACE, "Expect '}' after body.");
     
-    return ClassDeclStatement::create(name, std::move(super_class), std::move(methods));
+    return ClassDeclStatement::create(program, name, super_class, methods);
 }
 
-std::vector<std::unique_ptr<Stmt>> Parser::block_() {
-    std::vector<std::unique_ptr<Stmt>> statements;
+std::vector<Stmt*> Parser::block_() {
+    std::vector<Stmt*> statements;
     
     while(!check_(TokenType::RIGHT_BRACE) && !is_at_end_()) {
         statements.push_back(declaration_());
@@ -235,23 +236,21 @@ std::vector<std::unique_ptr<Stmt>> Parser::block_() {
     return statements;
 }
 
-std::unique_ptr<Expr> Parser::expression_() {
+Expr* Parser::expression_() {
     return assignment_();
 }
 
-std::unique_ptr<Expr> Parser::assignment_() {
+Expr* Parser::assignment_() {
     auto expr = or_();
     
     if (match_({TokenType::EQUAL})) {
-        Token equals = previous_();
+        const Token& equals = previous_();
         auto value = assignment_();
         
-        if (dynamic_cast<VariableExpr*>(expr.get())) {
-            auto name = dynamic_cast<VariableExpr*>(expr.get())->name;
-            return AssignExpr::create(name, std::move(value));
-        } else if (dynamic_cast<GetExpr*>(expr.get())) {
-            auto get_expr = dynamic_cast<GetExpr*>(expr.get());
-            return SetExpr::create(std::move(get_expr->object), get_expr->name, std::move(value));
+        if (auto variable = dynamic_cast<VariableExpr*>(expr)) {
+            return AssignExpr::create(program, variable->name, value);
+        } else if (auto get_expr = dynamic_cast<GetExpr*>(expr)) {
+            return SetExpr::create(program, get_expr->object, get_expr->name, value);
         }
         
         throw ParserError("Invalid assignment target.", equals);
@@ -260,99 +259,99 @@ std::unique_ptr<Expr> Parser::assignment_() {
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::or_() {
+Expr* Parser::or_() {
     auto expr = and_();
     
     while(match_({TokenType::OR})) {
-        Token operation = previous_();
+        const Token& operation = previous_();
         auto right = and_();
-        return LogicalExpr::create(std::move(expr), std::move(operation), std::move(right));
+        expr = LogicalExpr::create(program, expr, operation, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::and_() {
+Expr* Parser::and_() {
     auto expr = equality_();
     
     while(match_({TokenType::AND})) {
-        Token operation = previous_();
+        const Token& operation = previous_();
         auto right = equality_();
-        return LogicalExpr::create(std::move(expr), std::move(operation), std::move(right));
+        expr = LogicalExpr::create(program, expr, operation, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::equality_() {
+Expr* Parser::equality_() {
     auto expr = comparison_();
     
     while (match_({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL})) {
-        auto operation = previous_();
+        const auto& operation = previous_();
         auto right = comparison_();
         
-        expr = BinaryExpr::create(std::move(expr), operation, std::move(right));
+        expr = BinaryExpr::create(program, expr, operation, right);
         
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::comparison_() {
+Expr* Parser::comparison_() {
     auto expr = term_();
     
     while(match_({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL})) {
-        auto operation = previous_();
+        const auto& operation = previous_();
         auto right = term_();
-        expr = BinaryExpr::create(std::move(expr), operation, std::move(right));
+        expr = BinaryExpr::create(program, expr, operation, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::term_() {
+Expr* Parser::term_() {
     auto expr = factor_();
     
     while(match_({TokenType::MINUS, TokenType::PLUS})) {
-        auto operation = previous_();
+        const auto& operation = previous_();
         auto right = factor_();
-        expr = BinaryExpr::create(std::move(expr), operation, std::move(right));
+        expr = BinaryExpr::create(program, expr, operation, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::factor_() {
+Expr* Parser::factor_() {
     auto expr = unary_();
     
     while(match_({TokenType::SLASH, TokenType::STAR})) {
-        auto operation = previous_();
+        const auto& operation = previous_();
         auto right = unary_();
-        expr = BinaryExpr::create(std::move(expr), operation, std::move(right));
+        expr = BinaryExpr::create(program, expr, operation, right);
     }
     
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::unary_() {
+Expr* Parser::unary_() {
     if (match_({TokenType::BANG, TokenType::MINUS})) {
-        auto operation = previous_();
+        const auto& operation = previous_();
         auto right = unary_();
-        return UnaryExpr::create(operation, std::move(right));
+        return UnaryExpr::create(program, operation, right);
     }
     
     return call_();
 }
 
-std::unique_ptr<Expr> Parser::call_() {
-    std::unique_ptr<Expr> expr = primary_();
+Expr* Parser::call_() {
+    Expr* expr = primary_();
     
     while (true) {
         if (match_({TokenType::LEFT_PAREN})) {
-            expr = finish_call_(std::move(expr));
+            expr = finish_call_(expr);
         } else if (match_({TokenType::DOT})) {
-            Token name = consume_(TokenType::IDENTIFIER, "Expect property name after '.'");
-            expr = GetExpr::create(std::move(expr), name);
+            const Token& name = consume_(TokenType::IDENTIFIER, "Expect property name after '.'");
+            expr = GetExpr::create(program, expr, name);
         } else {
             break;
         }
@@ -361,8 +360,8 @@ std::unique_ptr<Expr> Parser::call_() {
     return expr;
 }
 
-std::unique_ptr<Expr> Parser::finish_call_(std::unique_ptr<Expr> callee) {
-    std::vector<std::unique_ptr<Expr>> args;
+Expr* Parser::finish_call_(Expr* callee) {
+    std::vector<Expr*> args;
     
     if (!check_(TokenType::RIGHT_PAREN)) {
         do {
@@ -373,48 +372,48 @@ std::unique_ptr<Expr> Parser::finish_call_(std::unique_ptr<Expr> callee) {
         } while (match_({TokenType::COMMA}));
     }
     
-    Token paren = consume_(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
+    const Token& paren = consume_(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
     
-    return CallExpr::create(std::move(callee), paren, std::move(args));
+    return CallExpr::create(program, callee, paren, args);
 }
 
-std::unique_ptr<Expr> Parser::primary_() {
+Expr* Parser::primary_() {
     if (match_({TokenType::LEFT_PAREN})) {
         auto expr = expression_();
         consume_(TokenType::RIGHT_PAREN, "Expected ')' after expression.");
-        return GroupingExpr::create(std::move(expr));
+        return GroupingExpr::create(program, expr);
     }
     
     if (match_({TokenType::FALSE})) {
-        return LiteralExpr::create({false});
+        return LiteralExpr::create(program, {false});
     }
     
     if (match_({TokenType::TRUE})) {
-        return LiteralExpr::create({true});
+        return LiteralExpr::create(program, {true});
     }
     
     if (match_({TokenType::NIL})) {
-        return LiteralExpr::create(nullptr);
+        return LiteralExpr::create(program, nullptr);
     }
     
     if (match_({TokenType::STRING, TokenType::NUMBER})) {
-        return LiteralExpr::create({previous_().literal});
+        return LiteralExpr::create(program, {previous_().literal});
     }
     
     if (match_({TokenType::THIS})) {
-        return ThisExpr::create(previous_());
+        return ThisExpr::create(program, previous_());
     }
     
     if (match_({TokenType::SUPER})) {
-        Token keyword = previous_();
+        const Token& keyword = previous_();
         consume_(TokenType::DOT, "Expect '.' after 'super'.");
-        Token method = consume_(TokenType::IDENTIFIER, "Expect superclass method name.");
+        const Token& method = consume_(TokenType::IDENTIFIER, "Expect superclass method name.");
         
-        return SuperExpr::create(keyword, method);
+        return SuperExpr::create(program, keyword, method);
     }
     
     if (match_({TokenType::IDENTIFIER})) {
-        return VariableExpr::create(previous_());
+        return VariableExpr::create(program, previous_());
     }
     
     throw ParserError("Expect expression", peek_());
@@ -422,7 +421,7 @@ std::unique_ptr<Expr> Parser::primary_() {
 
 
 
-bool Parser::match_(const std::vector<TokenType>& match_types) {
+bool Parser::match_(std::initializer_list<TokenType> match_types) {
     for(auto curr_type: match_types) {
         if (check_(curr_type)) {
             advance_();
@@ -2,49 +2,53 @@
 #pragma once
 
 #include "Expr.hpp"
+#include "Program.hpp"
 #include "Stmt.hpp"
 #include "Token.hpp"
 
-#include <memory>
+#include <initializer_list>
 #include <source_location>
+#include <span>
 #include <vector>
 
 namespace cpplox {
 
-/// Parses tokens into AST nodes.
+/// Parses tokens into AST nodes, which are allocated in program.
 struct Parser {
     std::vector<Token> tokens;
+    Program& program;
     int current = 0;
     
-    std::vector<std::unique_ptr<Stmt>> parse();
+    /// Parses the whole script into program.statements and returns them.
+    std::span<Stmt*> parse();
 
 private:
 
-    std::unique_ptr<Stmt> declaration_();
-    std::unique_ptr<Stmt> statement_();
-    std::unique_ptr<Stmt> for_statement_();
-    std::unique_ptr<Stmt> if_statement_();
-    std::unique_ptr<Stmt> print_statement_();
-    std::unique_ptr<Stmt> return_statement_();
-    std::unique_ptr<Stmt> var_declaration_();
-    std::unique_ptr<Stmt> while_statement_();
-    std::unique_ptr<Stmt> expression_statement_();
-    std::unique_ptr<Stmt> function_decl_statement_(const std::string& kind);
-    std::unique_ptr<Stmt> class_decl_statement_();
-    std::vector<std::unique_ptr<Stmt>> block_();
-    std::unique_ptr<Expr> expression_();
-    std::unique_ptr<Expr> assignment_();
-    std::unique_ptr<Expr> or_();
-    std::unique_ptr<Expr> and_();
-    std::unique_ptr<Expr> equality_();
-    std::unique_ptr<Expr> comparison_();
-    std::unique_ptr<Expr> term_();
-    std::unique_ptr<Expr> factor_();
-    std::unique_ptr<Expr> unary_();
-    std::unique_ptr<Expr> call_();
-    std::unique_ptr<Expr> finish_call_(std::unique_ptr<Expr> callee);
-    std::unique_ptr<Expr> primary_();
-    bool match_(const std::vector<TokenType>& match_types);
+    Stmt* declaration_();
+    Stmt* statement_();
+    Stmt* for_statement_();
+    Stmt* if_statement_();
+    Stmt* print_statement_();
+    Stmt* return_statement_();
+    Stmt* var_declaration_();
+    Stmt* while_statement_();
+    Stmt* expression_statement_();
+    Stmt* function_decl_statement_(const std::string& kind);
+    Stmt* class_decl_statement_();
+    std::vector<Stmt*> block_();
+    Expr* expression_();
+    Expr* assignment_();
+    Expr* or_();
+    Expr* and_();
+    Expr* equality_();
+    Expr* comparison_();
+    Expr* term_();
+    Expr* factor_();
+    Expr* unary_();
+    Expr* call_();
+    Expr* finish_call_(Expr* callee);
+    Expr* primary_();
+    bool match_(std::initializer_list<TokenType> match_types);
     bool check_(TokenType token_type);
     const Token& advance_();
     bool is_at_end_();
@@ -1,6 +1,8 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
+#include "Token.hpp"
+
 #include <exception>
 #include <source_location>
 #include <sstream>
@@ -13,7 +15,8 @@ struct ParserError: public std::exception {
   
 private:
     std::string             inp_message_;
-    Token                   token_;
+    int                     line_;
+    std::string             lexeme_;
     std::source_location    caller_location_;
     mutable std::string     message_;
     
@@ -22,7 +25,17 @@ public:
                 const Token& token,
                 std::source_location location = std::source_location::current()):
         inp_message_{msg},
-        token_{token},
+        line_{token.line},
+        lexeme_{token.lexeme},
+        caller_location_{location} {
+    }
+    
+    ParserError(const std::string& msg,
+                const TokenRef& token,
+                std::source_location location = std::source_location::current()):
+        inp_message_{msg},
+        line_{token.line},
+        lexeme_{token.lexeme},
         caller_location_{location} {
     }
     
@@ -32,7 +45,7 @@ public:
     inline const char* what() const noexcept override {
         if (message_.empty()) {
             std::stringstream stream;
-            stream << "ParserError: " << inp_message_ << "  In line: " << token_.line << " at token: " << token_.lexeme << "\n";
+            stream << "ParserError: " << inp_message_ << "  In line: " << line_ << " at token: " << lexeme_ << "\n";
             stream << "In file: " << caller_location_.file_name() << ", line: " << caller_location_.line() << "\n";
             message_ = stream.str();
             return message_.c_str();
@@ -0,0 +1,58 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "FlatAst.hpp"
+
+#include <cstdint>
+#include <string_view>
+
+namespace cpplox {
+
+// Forwards
+class Program;
+
+/// One optimization over a program's flat AST.  Passes run after the Resolver and may count on what it wrote,
+/// the PassManager resolves the program again after any pass that changed it.
+class Pass {
+public:
+    virtual ~Pass() = default;
+
+    /// What --dump-ast calls the pass.
+    virtual std::string_view name() const = 0;
+
+    /// Rewrites program.flat, returns whether anything changed.
+    virtual bool run(Program& program) = 0;
+
+protected:
+    /// Calls visit with every node under the program's statements, each node after its children.
+    template<typename Visit>
+    static void visit_post_order(FlatAst& ast, Visit&& visit) {
+        for(auto stmt: ast.list(ast.first_statement, ast.statement_count)) {
+            visit_post_order_(ast, stmt, visit);
+        }
+    }
+
+    /// Drops the statements remove picks out of a list, keeps the rest in order and returns how many are left.
+    template<typename Remove>
+    static uint32_t remove_statements(FlatAst& ast, uint32_t first, uint32_t count, Remove&& remove) {
+        uint32_t kept = 0;
+        for(uint32_t i = 0; i < count; ++i) {
+            auto stmt = ast.lists[first + i];
+            if (!remove(stmt)) {
+                ast.lists[first + kept++] = stmt;
+            }
+        }
+        return kept;
+    }
+
+private:
+    template<typename Visit>
+    static void visit_post_order_(FlatAst& ast, NodeIndex node, Visit& visit) {
+        ast.for_each_child(node, [&](NodeIndex child) {
+            visit_post_order_(ast, child, visit);
+        });
+        visit(node);
+    }
+};
+
+} // namespace cpplox
@@ -0,0 +1,60 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "PassManager.hpp"
+
+#include "AstPrinter.hpp"
+#include "Passes.hpp"
+#include "Program.hpp"
+#include "Resolver.hpp"
+
+#include <cstdio>
+#include <print>
+
+namespace cpplox {
+
+PassManager PassManager::create(int level) {
+    PassManager manager;
+    if (level >= 1) {
+        manager.add(std::make_unique<ConstantFolding>());
+    }
+    if (level >= 2) {
+        manager.add(std::make_unique<AlgebraicSimplification>());
+    }
+    if (level >= 1) {
+        manager.add(std::make_unique<DeadBranchElimination>());
+    }
+    if (level >= 2) {
+        // Removing locals can leave blocks empty, the second round of dead branches takes those out.
+        manager.add(std::make_unique<UnusedLocalRemoval>());
+        manager.add(std::make_unique<DeadBranchElimination>());
+    }
+    return manager;
+}
+
+void PassManager::run(Program& program) {
+    if (dump_ast_) {
+        dump_(program, "resolve");
+    }
+
+    for(auto& pass: passes_) {
+        //
+        // Slots, slot counts and uses may be stale once nodes moved or went away, resolving again refreshes
+        // them for the next pass and the Interpreter.
+        //
+        bool changed = pass->run(program);
+        if (changed) {
+            Resolver{}.resolve(program.flat);
+        }
+
+        if (dump_ast_ && changed) {
+            dump_(program, pass->name());
+        } else if (dump_ast_) {
+            std::print(stderr, "*** AST after {}: no change\n", pass->name());
+        }
+    }
+}
+
+void PassManager::dump_(const Program& program, std::string_view title) {
+    std::print(stderr, "*** AST after {}\n{}", title, AstPrinter{}.print(program.flat));
+}
+
+} // namespace cpplox
@@ -0,0 +1,44 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Pass.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+class Program;
+
+/// Runs the optimization passes, in the order they were added, between the Resolver and the Interpreter.
+class PassManager {
+private:
+    std::vector<std::unique_ptr<Pass>> passes_;
+    bool dump_ast_ = false;
+
+public:
+    PassManager() = default;
+
+    /// The passes for an optimization level.  -O0 runs none, -O1 folds constants and drops dead branches, -O2
+    /// also simplifies arithmetic and removes unused locals.
+    static PassManager create(int level);
+
+    void add(std::unique_ptr<Pass> pass) {
+        passes_.push_back(std::move(pass));
+    }
+
+    /// Prints the AST to stderr before the first pass and after each one.
+    void set_dump_ast(bool dump_ast) {
+        dump_ast_ = dump_ast;
+    }
+
+    /// Runs every pass over the program's flat AST, which must have been resolved.
+    void run(Program& program);
+
+// Internal Helpers
+private:
+    void dump_(const Program& program, std::string_view title);
+};
+
+} // namespace cpplox
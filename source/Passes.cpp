@@ -0,0 +1,440 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Passes.hpp"
+
+#include "Program.hpp"
+#include "TokenType.hpp"
+
+#include <cmath>
+#include <string>
+#include <variant>
+
+namespace cpplox {
+
+static bool is_nil_(const LiteralValue& value) {
+    return std::holds_alternative<std::monostate>(value) || std::holds_alternative<nullptr_t>(value);
+}
+
+/// Same rule as the Interpreter, only nil and false are falsey.
+static bool is_truthy_(const LiteralValue& value) {
+    if (auto boolean = std::get_if<bool>(&value)) {
+        return *boolean;
+    }
+    return !is_nil_(value);
+}
+
+/// Same rule as the Interpreter, values of different types are never equal and NaN is not equal to itself.
+static bool is_equal_(const LiteralValue& lhs, const LiteralValue& rhs) {
+    if (is_nil_(lhs) || is_nil_(rhs)) {
+        return is_nil_(lhs) && is_nil_(rhs);
+    }
+    return lhs == rhs;
+}
+
+static TokenType operation_(const FlatAst& ast, NodeIndex node) {
+    return static_cast<TokenType>(ast.c[node]);
+}
+
+// ---
+
+bool ConstantFolding::run(Program& program) {
+    ast_ = &program.flat;
+    program_ = &program;
+    changed_ = false;
+
+    visit_post_order(*ast_, [this](NodeIndex node) {
+        fold_(node);
+    });
+    return changed_;
+}
+
+void ConstantFolding::fold_(NodeIndex node) {
+    switch (ast_->kinds[node]) {
+        case NodeKind::Grouping:
+            if (ast_->is_literal(ast_->a[node])) {
+                ast_->replace(node, ast_->a[node]);
+                changed_ = true;
+            }
+            break;
+
+        case NodeKind::Unary:
+            fold_unary_(node);
+            break;
+
+        case NodeKind::Logical:
+            fold_logical_(node);
+            break;
+
+        case NodeKind::Binary:
+            fold_binary_(node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void ConstantFolding::fold_unary_(NodeIndex node) {
+    auto operand = ast_->a[node];
+    if (!ast_->is_literal(operand)) {
+        return;
+    }
+
+    // A copy, set_literal adds to the literals.
+    auto value = ast_->literal(operand);
+    switch (operation_(*ast_, node)) {
+        case TokenType::MINUS:
+            if (auto number = std::get_if<double>(&value)) {
+                ast_->set_literal(node, -*number);
+                changed_ = true;
+            }
+            break;
+
+        case TokenType::BANG:
+            ast_->set_literal(node, !is_truthy_(value));
+            changed_ = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void ConstantFolding::fold_logical_(NodeIndex node) {
+    auto left = ast_->a[node];
+    if (!ast_->is_literal(left)) {
+        return;
+    }
+
+    // "or" stops at a truthy left side and "and" at a falsey one, either way the left side is the result.
+    bool is_or = operation_(*ast_, node) == TokenType::OR;
+    bool stops = is_truthy_(ast_->literal(left)) == is_or;
+    ast_->replace(node, stops ? left : ast_->b[node]);
+    changed_ = true;
+}
+
+void ConstantFolding::fold_binary_(NodeIndex node) {
+    auto left = ast_->a[node];
+    auto right = ast_->b[node];
+    if (!ast_->is_literal(left) || !ast_->is_literal(right)) {
+        return;
+    }
+
+    auto lhs = ast_->literal(left);
+    auto rhs = ast_->literal(right);
+    auto operation = operation_(*ast_, node);
+
+    switch (operation) {
+        case TokenType::EQUAL_EQUAL:
+            ast_->set_literal(node, is_equal_(lhs, rhs));
+            changed_ = true;
+            return;
+
+        case TokenType::BANG_EQUAL:
+            ast_->set_literal(node, !is_equal_(lhs, rhs));
+            changed_ = true;
+            return;
+
+        default:
+            break;
+    }
+
+    auto lhs_string = std::get_if<std::string_view>(&lhs);
+    auto rhs_string = std::get_if<std::string_view>(&rhs);
+    if (operation == TokenType::PLUS && lhs_string && rhs_string) {
+        std::string joined{*lhs_string};
+        joined += *rhs_string;
+        ast_->set_literal(node, program_->intern(joined));
+        changed_ = true;
+        return;
+    }
+
+    auto lhs_number = std::get_if<double>(&lhs);
+    auto rhs_number = std::get_if<double>(&rhs);
+    if (!lhs_number || !rhs_number) {
+        return;
+    }
+
+    LiteralValue result;
+    switch (operation) {
+        case TokenType::PLUS:           result = *lhs_number + *rhs_number; break;
+        case TokenType::MINUS:          result = *lhs_number - *rhs_number; break;
+        case TokenType::STAR:           result = *lhs_number * *rhs_number; break;
+        case TokenType::SLASH:          result = *lhs_number / *rhs_number; break;
+        case TokenType::GREATER:        result = *lhs_number > *rhs_number; break;
+        case TokenType::GREATER_EQUAL:  result = *lhs_number >= *rhs_number; break;
+        case TokenType::LESS:           result = *lhs_number < *rhs_number; break;
+        case TokenType::LESS_EQUAL:     result = *lhs_number <= *rhs_number; break;
+        default:
+            return;
+    }
+
+    ast_->set_literal(node, result);
+    changed_ = true;
+}
+
+// ---
+
+bool AlgebraicSimplification::run(Program& program) {
+    ast_ = &program.flat;
+    changed_ = false;
+
+    visit_post_order(*ast_, [this](NodeIndex node) {
+        simplify_(node);
+    });
+    return changed_;
+}
+
+void AlgebraicSimplification::simplify_(NodeIndex node) {
+    auto& ast = *ast_;
+
+    switch (ast.kinds[node]) {
+        case NodeKind::Grouping:
+            replace_(node, ast.a[node]);
+            break;
+
+        case NodeKind::Unary: {
+            auto operand = ast.a[node];
+            if (ast.kinds[operand] != NodeKind::Unary || operation_(ast, operand) != operation_(ast, node)) {
+                break;
+            }
+
+            auto inner = ast.a[operand];
+            if ((operation_(ast, node) == TokenType::MINUS && is_number_(inner)) ||
+                (operation_(ast, node) == TokenType::BANG && is_boolean_(inner))) {
+                replace_(node, inner);
+            }
+            break;
+        }
+
+        case NodeKind::Binary:
+            simplify_binary_(node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void AlgebraicSimplification::simplify_binary_(NodeIndex node) {
+    auto left = ast_->a[node];
+    auto right = ast_->b[node];
+
+    switch (operation_(*ast_, node)) {
+        case TokenType::MINUS:
+            if (is_number_literal_(right, 0.0) && is_number_(left)) {
+                replace_(node, left);
+            }
+            break;
+
+        case TokenType::STAR:
+            if (is_number_literal_(right, 1.0) && is_number_(left)) {
+                replace_(node, left);
+            } else if (is_number_literal_(left, 1.0) && is_number_(right)) {
+                replace_(node, right);
+            }
+            break;
+
+        case TokenType::SLASH:
+            if (is_number_literal_(right, 1.0) && is_number_(left)) {
+                replace_(node, left);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool AlgebraicSimplification::is_number_(NodeIndex node) const {
+    //
+    // Arithmetic other than + either gives a number or throws, so its result is a number wherever it is used.
+    //
+    switch (ast_->kinds[node]) {
+        case NodeKind::Literal:
+            return std::holds_alternative<double>(ast_->literal(node));
+        case NodeKind::Unary:
+            return operation_(*ast_, node) == TokenType::MINUS;
+        case NodeKind::Binary:
+            switch (operation_(*ast_, node)) {
+                case TokenType::MINUS:
+                case TokenType::STAR:
+                case TokenType::SLASH:
+                    return true;
+                case TokenType::PLUS:
+                    return is_number_(ast_->a[node]) && is_number_(ast_->b[node]);
+                default:
+                    return false;
+            }
+        case NodeKind::Grouping:
+        case NodeKind::Assign:
+            return is_number_(ast_->a[node]);
+        default:
+            return false;
+    }
+}
+
+bool AlgebraicSimplification::is_boolean_(NodeIndex node) const {
+    switch (ast_->kinds[node]) {
+        case NodeKind::Literal:
+            return std::holds_alternative<bool>(ast_->literal(node));
+        case NodeKind::Unary:
+            return operation_(*ast_, node) == TokenType::BANG;
+        case NodeKind::Binary:
+            switch (operation_(*ast_, node)) {
+                case TokenType::EQUAL_EQUAL:
+                case TokenType::BANG_EQUAL:
+                case TokenType::GREATER:
+                case TokenType::GREATER_EQUAL:
+                case TokenType::LESS:
+                case TokenType::LESS_EQUAL:
+                    return true;
+                default:
+                    return false;
+            }
+        case NodeKind::Grouping:
+            return is_boolean_(ast_->a[node]);
+        default:
+            return false;
+    }
+}
+
+bool AlgebraicSimplification::is_number_literal_(NodeIndex node, double number) const {
+    if (!ast_->is_literal(node)) {
+        return false;
+    }
+
+    // -0 does not count as 0, x - -0 is x + 0.
+    auto value = std::get_if<double>(&ast_->literal(node));
+    return value && *value == number && !std::signbit(*value);
+}
+
+void AlgebraicSimplification::replace_(NodeIndex node, NodeIndex other) {
+    ast_->replace(node, other);
+    changed_ = true;
+}
+
+// ---
+
+bool DeadBranchElimination::run(Program& program) {
+    ast_ = &program.flat;
+    changed_ = false;
+
+    visit_post_order(*ast_, [this](NodeIndex node) {
+        eliminate_(node);
+    });
+
+    auto count = remove_statements(*ast_, ast_->first_statement, ast_->statement_count, [this](NodeIndex stmt) {
+        return is_empty_block_(stmt);
+    });
+    changed_ = changed_ || count != ast_->statement_count;
+    ast_->statement_count = count;
+    return changed_;
+}
+
+void DeadBranchElimination::eliminate_(NodeIndex node) {
+    auto& ast = *ast_;
+
+    switch (ast.kinds[node]) {
+        case NodeKind::If: {
+            auto condition = ast.a[node];
+            if (!ast.is_literal(condition)) {
+                break;
+            }
+
+            if (is_truthy_(ast.literal(condition))) {
+                ast.replace(node, ast.b[node]);
+            } else if (ast.c[node] != no_node) {
+                ast.replace(node, ast.c[node]);
+            } else {
+                ast.clear(node);
+            }
+            changed_ = true;
+            break;
+        }
+
+        case NodeKind::While:
+            if (ast.is_literal(ast.a[node]) && !is_truthy_(ast.literal(ast.a[node]))) {
+                ast.clear(node);
+                changed_ = true;
+            }
+            break;
+
+        case NodeKind::Block: {
+            auto count = remove_statements(ast, ast.a[node], ast.b[node], [this](NodeIndex stmt) {
+                return is_empty_block_(stmt);
+            });
+            changed_ = changed_ || count != ast.b[node];
+            ast.b[node] = count;
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+bool DeadBranchElimination::is_empty_block_(NodeIndex node) const {
+    return ast_->kinds[node] == NodeKind::Block && ast_->b[node] == 0;
+}
+
+// ---
+
+bool UnusedLocalRemoval::run(Program& program) {
+    ast_ = &program.flat;
+    changed_ = false;
+
+    // Top-level declarations are globals, so only the lists of blocks need looking at.
+    visit_post_order(*ast_, [this](NodeIndex node) {
+        if (ast_->kinds[node] != NodeKind::Block) {
+            return;
+        }
+
+        auto count = remove_statements(*ast_, ast_->a[node], ast_->b[node], [this](NodeIndex stmt) {
+            return is_unused_(stmt);
+        });
+        changed_ = changed_ || count != ast_->b[node];
+        ast_->b[node] = count;
+    });
+    return changed_;
+}
+
+bool UnusedLocalRemoval::is_unused_(NodeIndex node) const {
+    if (ast_->kinds[node] != NodeKind::VariableDecl || ast_->b[node] != 0) {
+        return false;
+    }
+
+    auto initializer = ast_->a[node];
+    return initializer == no_node || is_pure_(initializer);
+}
+
+bool UnusedLocalRemoval::is_pure_(NodeIndex node) const {
+    //
+    // Reading a global can throw when it is not defined, and most operators throw on the wrong types, so only
+    // what can never throw or call anything counts.
+    //
+    switch (ast_->kinds[node]) {
+        case NodeKind::Literal:
+            return true;
+        case NodeKind::Variable:
+        case NodeKind::This:
+            return !ast_->resolved(node).is_global();
+        case NodeKind::Grouping:
+            return is_pure_(ast_->a[node]);
+        case NodeKind::Unary:
+            return operation_(*ast_, node) == TokenType::BANG && is_pure_(ast_->a[node]);
+        case NodeKind::Logical:
+            return is_pure_(ast_->a[node]) && is_pure_(ast_->b[node]);
+        case NodeKind::Binary:
+            switch (operation_(*ast_, node)) {
+                case TokenType::EQUAL_EQUAL:
+                case TokenType::BANG_EQUAL:
+                    return is_pure_(ast_->a[node]) && is_pure_(ast_->b[node]);
+                default:
+                    return false;
+            }
+        default:
+            return false;
+    }
+}
+
+} // namespace cpplox
@@ -0,0 +1,104 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Pass.hpp"
+
+namespace cpplox {
+
+/// Evaluates unary, binary and logical expressions whose operands are literals, and drops the parentheses
+/// around literals.  Anything that would fail at runtime, such as adding a number to a string, is left alone so
+/// the error still happens when the script runs.
+class ConstantFolding: public Pass {
+private:
+    FlatAst* ast_ = nullptr;
+    Program* program_ = nullptr;
+    bool changed_ = false;
+
+public:
+    std::string_view name() const override {
+        return "constant-folding";
+    }
+
+    bool run(Program& program) override;
+
+// Internal Helpers
+private:
+    void fold_(NodeIndex node);
+    void fold_unary_(NodeIndex node);
+    void fold_logical_(NodeIndex node);
+    void fold_binary_(NodeIndex node);
+};
+
+// ---
+
+/// Rewrites identities that hold for every number, x - 0, x * 1, 1 * x and x / 1 become x and -(-x) becomes x,
+/// when x is known to be a number.  !!x becomes x when x is known to be a boolean, and parentheses go away.
+///
+/// x + 0 is left alone, -0 + 0 is 0.
+class AlgebraicSimplification: public Pass {
+private:
+    FlatAst* ast_ = nullptr;
+    bool changed_ = false;
+
+public:
+    std::string_view name() const override {
+        return "algebraic-simplification";
+    }
+
+    bool run(Program& program) override;
+
+// Internal Helpers
+private:
+    void simplify_(NodeIndex node);
+    void simplify_binary_(NodeIndex node);
+    bool is_number_(NodeIndex node) const;
+    bool is_boolean_(NodeIndex node) const;
+    bool is_number_literal_(NodeIndex node, double number) const;
+    void replace_(NodeIndex node, NodeIndex other);
+};
+
+// ---
+
+/// Replaces an if whose condition is a literal by the branch it always takes, drops a while whose condition is a
+/// falsey literal, and drops empty blocks from statement lists.
+class DeadBranchElimination: public Pass {
+private:
+    FlatAst* ast_ = nullptr;
+    bool changed_ = false;
+
+public:
+    std::string_view name() const override {
+        return "dead-branch-elimination";
+    }
+
+    bool run(Program& program) override;
+
+// Internal Helpers
+private:
+    void eliminate_(NodeIndex node);
+    bool is_empty_block_(NodeIndex node) const;
+};
+
+// ---
+
+/// Removes the declarations of local variables that are never read or assigned, when running their initializer
+/// can have no effect.  Globals stay, another program or a function declared later may use them.
+class UnusedLocalRemoval: public Pass {
+private:
+    FlatAst* ast_ = nullptr;
+    bool changed_ = false;
+
+public:
+    std::string_view name() const override {
+        return "unused-local-removal";
+    }
+
+    bool run(Program& program) override;
+
+// Internal Helpers
+private:
+    bool is_unused_(NodeIndex node) const;
+    bool is_pure_(NodeIndex node) const;
+};
+
+} // namespace cpplox
@@ -0,0 +1,27 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Program.hpp"
+
+#include <cstring>
+
+namespace cpplox {
+
+std::string_view Program::intern(std::string_view text) {
+    auto itr = names_.find(text);
+    if (itr != names_.end()) {
+        return *itr;
+    }
+
+    auto chars = static_cast<char*>(names_arena_.allocate(text.size(), 1));
+    std::memcpy(chars, text.data(), text.size());
+
+    std::string_view interned{chars, text.size()};
+    names_.insert(interned);
+    return interned;
+}
+
+FlatAst& Program::flatten() {
+    flat = FlatAst::flatten(statements);
+    return flat;
+}
+
+} // namespace cpplox
@@ -0,0 +1,82 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Arena.hpp"
+#include "FlatAst.hpp"
+#include "SourceBuffer.hpp"
+#include "Token.hpp"
+
+#include <memory>
+#include <span>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cpplox {
+
+// Forwards
+struct Stmt;
+
+/// A parsed script.  Every node, list and name in its AST lives in the program's arenas, so the whole tree is
+/// freed in one go when the program goes away.
+///
+/// The program also holds the flattened AST the tree-walk interpreter runs.  Functions keep pointing at the
+/// declarations they were made from, so a program has to outlive anything that ran it.
+class Program {
+private:
+    Arena arena_;
+    Arena names_arena_;
+    std::unordered_set<std::string_view> names_;
+    std::unique_ptr<SourceBuffer> source_;
+
+public:
+    /// The top-level statements, filled in by the Parser.
+    std::span<Stmt*> statements;
+    
+    /// The statements flattened, filled in by flatten().
+    FlatAst flat;
+
+    Program() = default;
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        return arena_.make<T>(std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    std::span<T> list(const std::vector<T>& items) {
+        return arena_.copy(items);
+    }
+
+    /// Takes over the script's text and returns a view of it for the Scanner, whose tokens point into it.
+    std::string_view set_source(std::unique_ptr<SourceBuffer> source) {
+        source_ = std::move(source);
+        return source_->text();
+    }
+
+    /// Returns a copy of text owned by the program.  Equal texts share the one copy.
+    std::string_view intern(std::string_view text);
+
+    TokenRef ref(const Token& token) {
+        return TokenRef{token.type, intern(token.lexeme), token.line, token.offset};
+    }
+
+    /// Builds flat from the statements.
+    FlatAst& flatten();
+
+    /// Frees the nodes once only the flat AST is needed.  The interned names stay, the flat AST uses them too.
+    void discard_tree() {
+        statements = {};
+        arena_.release();
+    }
+
+    /// Bytes the nodes of the AST take up.
+    size_t bytes_used() const {
+        return arena_.bytes_used();
+    }
+};
+
+} // namespace cpplox
@@ -0,0 +1,63 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace cpplox {
+
+// Forwards
+class Shape;
+struct LoxFunction;
+
+/// What a property access site worked out for instances of one shape.
+///
+/// A shape belongs to a single class and classes do not change once declared, so the shape alone is enough to
+/// know both where a field lives and which method a name resolves to.
+struct PropertyCacheEntry {
+    const Shape* shape = nullptr;
+    
+    /// The field's slot, -1 when the name resolved to a method.
+    int slot = -1;
+    
+    /// The method the name resolved to, when it is not a field.
+    LoxFunction* method = nullptr;
+    
+    /// For a set that adds the field, the shape the instance moves to.  The new value goes into slot.
+    Shape* transition = nullptr;
+};
+
+/// A small polymorphic inline cache hung off a GetExpr or SetExpr.
+///
+/// Once a site has seen more shapes than fit it is megamorphic, it keeps the entries it has and the rest go
+/// down the slow path every time.
+struct PropertyCache {
+    static constexpr int max_entries = 4;
+    
+    std::array<PropertyCacheEntry, max_entries> entries;
+    int count = 0;
+    
+    const PropertyCacheEntry* find(const Shape* shape) const {
+        for(int i = 0; i < count; ++i) {
+            if (entries[i].shape == shape) {
+                return &entries[i];
+            }
+        }
+        
+        return nullptr;
+    }
+    
+    void add(const PropertyCacheEntry& entry) {
+        if (count < max_entries) {
+            entries[count++] = entry;
+        }
+    }
+};
+
+/// How often a kind of access site found what it needed in its cache.
+struct CacheCounters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+} // namespace cpplox
@@ -3,224 +3,327 @@
 
 #include "ParserError.hpp"
 
+#include <algorithm>
+
 namespace cpplox {
 
-void Resolver::resolve(const std::vector<std::unique_ptr<Stmt>>& stmts) {
-    for(const auto& stmt: stmts) {
-        resolve_(*(stmt));
-    }
+void Resolver::resolve(FlatAst& ast) {
+    ast_ = &ast;
+    resolve_list_(ast.first_statement, ast.statement_count);
 }
 
-void Resolver::visit(const AssignExpr& expr) {
-    resolve_(*(expr.value));
-    resolve_local_(expr, expr.name);
-}
+void Resolver::resolve_(NodeIndex node) {
+    auto& ast = *ast_;
 
-void Resolver::visit(const BinaryExpr& expr) {
-    resolve_(*(expr.left));
-    resolve_(*(expr.right));
-}
+    switch (ast.kinds[node]) {
+        case NodeKind::Assign:
+            resolve_(ast.a[node]);
+            resolve_local_(node, ast.name(node));
+            break;
 
-void Resolver::visit(const LiteralExpr& expr) {
-    // We do nothing in this case, no variables involved.
-}
+        case NodeKind::Binary:
+        case NodeKind::Logical:
+            resolve_(ast.a[node]);
+            resolve_(ast.b[node]);
+            break;
 
-void Resolver::visit(const GroupingExpr& expr) {
-    resolve_(*(expr.expression));
-}
+        case NodeKind::Literal:
+            // We do nothing in this case, no variables involved.
+            break;
 
-void Resolver::visit(const UnaryExpr& expr) {
-    resolve_(*(expr.right));
-}
+        case NodeKind::Grouping:
+        case NodeKind::Unary:
+        case NodeKind::Get:
+        case NodeKind::Print:
+        case NodeKind::Expression:
+            resolve_(ast.a[node]);
+            break;
 
-void Resolver::visit(const VariableExpr& expr) {
-    if (!scopes_.empty()) {
-        auto itr = scopes_.front().find(expr.name.lexeme);
-        if (itr != scopes_.front().end()) {
-            if (itr->second == false) {
-                throw ParserError("Can not read local variable in its own initializer.", expr.name);
+        case NodeKind::Variable:
+            resolve_variable_(node);
+            break;
+
+        case NodeKind::Call:
+            resolve_(ast.a[node]);
+            resolve_list_(ast.b[node], ast.c[node]);
+            break;
+
+        case NodeKind::Set:
+            resolve_(ast.a[node]);
+            resolve_(ast.b[node]);
+            break;
+
+        case NodeKind::This:
+            if (current_class_ == ClassType::None) {
+                throw ParserError("Can not use 'this' outside of class.", ast.token(node));
             }
-        }
-    }
-    
-    resolve_local_(expr, expr.name);
-}
+            resolve_local_(node, "this");
+            break;
 
-void Resolver::visit(const LogicalExpr& expr) {
-    resolve_(*(expr.left));
-    resolve_(*(expr.right));
-}
+        case NodeKind::Super:
+            // The method is looked up in the super class of the method running, on "this".
+            if (current_class_ == ClassType::Subclass) {
+                resolve_local_(node, "this");
+            } else {
+                ast.set_resolved(node, VariableSlot{});
+            }
+            break;
 
-void Resolver::visit(const CallExpr& expr) {
-    resolve_(*(expr.callee));
-    
-    for(const auto& arg: expr.args) {
-        resolve_(*(arg));
-    }
-}
+        case NodeKind::VariableDecl:
+            declare_(ast.name(node), node);
+            if (ast.a[node] != no_node) {
+                resolve_(ast.a[node]);
+            }
+            define_(ast.name(node));
+            break;
 
-void Resolver::visit(const GetExpr& expr) {
-    resolve_(*(expr.object));
-}
+        case NodeKind::Block:
+            begin_scope_(node);
+            resolve_block_(node);
+            end_scope_();
+            break;
 
-void Resolver::visit(const SetExpr& expr) {
-    resolve_(*(expr.object));
-    resolve_(*(expr.value));
-}
+        case NodeKind::If:
+            resolve_(ast.a[node]);
+            resolve_(ast.b[node]);
+            if (ast.c[node] != no_node) {
+                resolve_(ast.c[node]);
+            }
+            break;
 
-void Resolver::visit(const ThisExpr& expr) {
-    if (current_class_ != ClassType::Class) {
-        throw ParserError("Can not use 'this' outside of class.", expr.keyword);
-    }
-    resolve_local_(expr, expr.keyword);
-}
+        case NodeKind::While:
+            resolve_(ast.a[node]);
+            resolve_(ast.b[node]);
+            break;
 
-void Resolver::visit(const SuperExpr& expr) {
-    resolve_local_(expr, expr.keyword);
-}
+        case NodeKind::FunctionDecl:
+            declare_(ast.name(node));
+            define_(ast.name(node));
+            resolve_function_(node, FunctionType::Function);
+            break;
 
-void Resolver::visit(const PrintStatement& stmt) {
-    resolve_(*(stmt.expression));
-}
+        case NodeKind::Return:
+            if (current_func == FunctionType::None) {
+                throw ParserError("Can not return from top-level code.", ast.token(node));
+            }
 
-void Resolver::visit(const ExpressionStatement& stmt) {
-    resolve_(*(stmt.expression));
-}
+            if (ast.a[node] != no_node) {
+                resolve_(ast.a[node]);
+            }
+
+            // init hands back the instance whatever it returns, so its calls are never in tail position.
+            ast.b[node] = current_func == FunctionType::Initializer ? no_node : tail_call_(ast.a[node]);
+            break;
+
+        case NodeKind::ClassDecl:
+            resolve_class_(node);
+            break;
 
-void Resolver::visit(const VariableDeclStatement& stmt) {
-    declare_(stmt.name);
-    if (stmt.initializer) {
-        resolve_(*(stmt.initializer));
+        default:
+            // Only the Interpreter specializes binary nodes, and it runs after resolving is done.
+            break;
     }
-    
-    define_(stmt.name);
 }
 
-void Resolver::visit(const BlockStatement& stmt) {
-    begin_scope_();
-    resolve(stmt.statements);
-    end_scope_();
+void Resolver::resolve_list_(uint32_t first, uint32_t count) {
+    // Resolving a function adds its captures to the lists, which may move them.
+    for(uint32_t i = 0; i < count; ++i) {
+        resolve_(ast_->lists[first + i]);
+    }
 }
 
-void Resolver::visit(const IfStatement& stmt) {
-    resolve_(*(stmt.condition));
-    resolve_(*(stmt.then_branch));
-    if (stmt.else_branch) {
-        resolve_(*(stmt.else_branch));
+void Resolver::resolve_variable_(NodeIndex node) {
+    auto name = ast_->name(node);
+    if (!scopes_.empty()) {
+        auto itr = scopes_.front().vars.find(name);
+        if (itr != scopes_.front().vars.end()) {
+            if (itr->second.defined == false) {
+                throw ParserError("Can not read local variable in its own initializer.", ast_->token(node));
+            }
+        }
     }
-}
 
-void Resolver::visit(const WhileStatement& stmt) {
-    resolve_(*(stmt.condition));
-    resolve_(*(stmt.body));
+    resolve_local_(node, name);
 }
 
-void Resolver::visit(const FunctionDeclStatementProxy& stmt_proxy) {
-    declare_(stmt_proxy.stmt->name);
-    define_(stmt_proxy.stmt->name);
-    resolve_function_(*(stmt_proxy.stmt.get()), FunctionType::Function);
-}
+void Resolver::resolve_block_(NodeIndex node) {
+    resolve_list_(ast_->a[node], ast_->b[node]);
 
-void Resolver::visit(const ReturnStatement& stmt) {
-    if (current_func == FunctionType::None) {
-        throw ParserError("Can not return from top-level code.", stmt.keyword);
-    }
-    
-    if (stmt.value) {
-        resolve_(*(stmt.value));
-    }
+    const auto& scope = scopes_.front();
+    ast_->c[node] = scope.home == &scope ? static_cast<uint32_t>(scope.slot_count) : no_node;
 }
 
-void Resolver::visit(const ClassDeclStatement& stmt) {
+void Resolver::resolve_class_(NodeIndex node) {
+    auto& ast = *ast_;
+    auto name = ast.name(node);
+    auto super_class = ast.a[node];
+
     auto enclosing_class = current_class_;
-    current_class_ = ClassType::Class;
-    
-    declare_(stmt.name);
-    define_(stmt.name);
-    if (stmt.super_class &&
-        stmt.super_class->name.lexeme == stmt.name.lexeme) {
-        throw ParserError("A class can not inherit from itself", stmt.super_class->name);
-    }
-    
-    if (stmt.super_class) {
-        resolve_(*(stmt.super_class));
-    }
-    
-    begin_scope_();
-    if (stmt.super_class) {
-        scopes_.front()["super"] = true;
+    current_class_ = super_class != no_node ? ClassType::Subclass : ClassType::Class;
+
+    declare_(name);
+    define_(name);
+    if (super_class != no_node &&
+        ast.name(super_class) == name) {
+        throw ParserError("A class can not inherit from itself", ast.token(super_class));
+    }
+
+    if (super_class != no_node) {
+        resolve_(super_class);
     }
-    scopes_.front()["this"] = true;
-    
-    for(const auto& curr_method: stmt.methods) {
+
+    for(uint32_t i = 0; i < ast.c[node]; ++i) {
+        auto curr_method = ast.lists[ast.b[node] + i];
         FunctionType declaration = FunctionType::Method;
-        
-        resolve_function_(*(curr_method.get()), declaration);
+        if (ast.name(curr_method) == "init") {
+            declaration = FunctionType::Initializer;
+        }
+
+        resolve_function_(curr_method, declaration);
     }
-    
-    end_scope_();
-    
+
     current_class_ = enclosing_class;
 }
 
-void Resolver::begin_scope_() {
-    scopes_.push_front(std::map<std::string, bool>{});
+void Resolver::begin_scope_(NodeIndex block) {
+    //
+    // A block runs in the enclosing environment, unless it has locals and is outside of every function, where the
+    // only environment around it would be the globals.
+    //
+    Scope* home = scopes_.empty() ? nullptr : scopes_.front().home;
+    bool own_environment = block == no_node || (home == nullptr && declares_(block));
+
+    auto& scope = scopes_.emplace_front();
+    if (own_environment) {
+        scope.home = &scope;
+        scope.enclosing = home;
+    } else if (home != nullptr) {
+        scope.home = home;
+        scope.next_slot = home->next_slot;
+    }
 }
 
-void Resolver::resolve_(Stmt& stmt) {
-    stmt.accept(*this);
-}
+void Resolver::end_scope_() {
+    auto& scope = scopes_.front();
+    for(const auto& [name, info]: scope.vars) {
+        record_uses_(info);
+    }
 
-void Resolver::resolve_(Expr& expr) {
-    expr.accept(*this);
+    // The block's locals are gone, their slots are free for what the home scope declares next.
+    if (scope.home != nullptr && scope.home != &scope) {
+        scope.home->next_slot = scope.next_slot;
+    }
+    scopes_.pop_front();
 }
 
-void Resolver::end_scope_() {
-    scopes_.pop_front();
+void Resolver::record_uses_(const VarInfo& info) {
+    if (info.declaration != no_node) {
+        ast_->b[info.declaration] = info.uses;
+    }
 }
 
-void Resolver::declare_(const Token& name) {
+void Resolver::declare_(std::string_view name, NodeIndex declaration) {
     if (scopes_.empty()) {
         return;
     }
-    
-    scopes_.front()[name.lexeme] = false;
+
+    // Every declaration gets a new slot, even one that shadows a name already in this scope.
+    auto& scope = scopes_.front();
+    auto& home = *scope.home;
+    auto& info = scope.vars[name];
+    record_uses_(info);
+    info = VarInfo{home.next_slot++, false, declaration, 0};
+    home.slot_count = std::max(home.slot_count, home.next_slot);
 }
 
-void Resolver::define_(const Token& name) {
+void Resolver::define_(std::string_view name) {
     if (scopes_.empty()) {
         return;
     }
-    
-    scopes_.front()[name.lexeme] = true;
+
+    scopes_.front().vars[name].defined = true;
 }
 
-void Resolver::resolve_local_(const Expr& expr, const Token& name) {
-    int idx = 0;
-    for(const auto& curr_scope: scopes_) {
-        if (curr_scope.contains(name.lexeme)) {
-            interpreter_.resolve(reinterpret_cast<uintptr_t>(&expr), idx);
+void Resolver::resolve_local_(NodeIndex node, std::string_view name) {
+    VariableSlot resolved;
+
+    // A variable in the environment of an enclosing function is captured.
+    auto home = scopes_.empty() ? nullptr : scopes_.front().home;
+    for(auto& curr_scope: scopes_) {
+        auto itr = curr_scope.vars.find(name);
+        if (itr != curr_scope.vars.end()) {
+            ++itr->second.uses;
+            auto slot = itr->second.slot;
+            if (curr_scope.home == home) {
+                resolved = VariableSlot{Storage::Local, slot};
+            } else {
+                resolved = VariableSlot{Storage::Upvalue, capture_(*home, *curr_scope.home, slot)};
+            }
             break;
         }
-        ++idx;
     }
-    
+
+    ast_->set_resolved(node, resolved);
 }
 
-void Resolver::resolve_function_(const FunctionDeclStatement& stmt, const FunctionType& type) {
+void Resolver::resolve_function_(NodeIndex node, const FunctionType& type) {
+    auto& ast = *ast_;
     auto enclosing_func = current_func;
     current_func = type;
-    
+
+    // The params and the body share one scope, the body block does not get one of its own.  A method's receiver
+    // comes first.
     begin_scope_();
-    for(const auto& curr_param: stmt.params) {
-        declare_(curr_param);
-        define_(curr_param);
+    if (type == FunctionType::Method || type == FunctionType::Initializer) {
+        declare_("this");
+        define_("this");
+    }
+    for(auto curr_param: ast.list(ast.a[node], ast.b[node])) {
+        declare_(ast.name_table[curr_param]);
+        define_(ast.name_table[curr_param]);
     }
-    resolve(stmt.body);
+    resolve_block_(ast.c[node]);
+    ast.set_captures(node, scopes_.front().captures);
     end_scope_();
-    
+
     current_func = enclosing_func;
 }
 
+int Resolver::capture_(Scope& function, const Scope& home, int slot) {
+    Capture capture{static_cast<uint32_t>(slot), true};
+    if (function.enclosing != &home) {
+        capture = Capture{static_cast<uint32_t>(capture_(*function.enclosing, home, slot)), false};
+    }
+
+    // A variable used more than once is still one upvalue.
+    auto& captures = function.captures;
+    for(size_t i = 0; i < captures.size(); ++i) {
+        if (captures[i].index == capture.index && captures[i].local == capture.local) {
+            return static_cast<int>(i);
+        }
+    }
+    captures.push_back(capture);
+    return static_cast<int>(captures.size() - 1);
+}
+
+bool Resolver::declares_(NodeIndex block) const {
+    for(auto stmt: ast_->list(ast_->a[block], ast_->b[block])) {
+        auto kind = ast_->kinds[stmt];
+        if (kind == NodeKind::VariableDecl || kind == NodeKind::FunctionDecl || kind == NodeKind::ClassDecl) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+NodeIndex Resolver::tail_call_(NodeIndex node) const {
+    while (node != no_node && ast_->kinds[node] == NodeKind::Grouping) {
+        node = ast_->a[node];
+    }
+
+    return node != no_node && ast_->kinds[node] == NodeKind::Call ? node : no_node;
+}
+
 
 } // namespace cpplox
@@ -1,87 +1,100 @@
 // Copyright 2025, See LICENSE for details.
 #pragma once
 
-#include "Expr.hpp"
-#include "Interpreter.hpp"
-#include "Stmt.hpp"
+#include "FlatAst.hpp"
 
-#include <map>
-#include <stack>
-#include <string>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace cpplox {
 
 /// Resolves which environment to use for a variable, and various ther checks on the script.
-class Resolver: public ExprVisitor,
-                public StmtVisitor {
+///
+/// The results are written into the flat AST itself, so they go away together with the program.
+///
+/// Each call gets one environment, the blocks in the function run in it and their locals take slots there that are
+/// free again once the block ends.  A variable of an enclosing function is one of the function's upvalues, which
+/// its closures capture when they are made, rather than something found by walking out through environments.
+class Resolver {
                     
 private:
     enum class FunctionType {
         None,
         Function,
-        Method
+        Method,
+        Initializer
     };
                     
     enum class ClassType {
         None,
-        Class
+        Class,
+        Subclass
     };
                     
-    Interpreter& interpreter_;
-                    
+    /// Where a variable lives in its scope's environment, and whether its initializer has finished.  Uses are
+    /// counted for the VariableDecl that declared it, if one did, and written to it once the scope is done.
     struct VarInfo {
-        std::string name;
-        bool used = false;
+        int slot = 0;
+        bool defined = false;
+        NodeIndex declaration = no_node;
+        uint32_t uses = 0;
+    };
+                    
+    /// Names point into the program being resolved, which outlives the Resolver's work on it.
+    struct Scope {
+        std::unordered_map<std::string_view, VarInfo> vars;
+
+        /// The scope whose environment holds the locals, this one's own when it has one.  A block that declares
+        /// nothing outside of any function has neither.
+        Scope* home = nullptr;
+
+        /// For a scope with an environment, the one it is made in, whose variables its closures capture.
+        Scope* enclosing = nullptr;
+
+        /// The next free slot and the most slots in use at once, which is what the environment is made with.  A
+        /// scope without an environment hands the home scope's next free slot back at its end.
+        int next_slot = 0;
+        int slot_count = 0;
+
+        /// A function's upvalues, in the order its closures hold them.
+        std::vector<Capture> captures;
     };
-    std::deque<std::map<std::string, bool>> scopes_;
+    FlatAst* ast_ = nullptr;
+
+    /// The innermost scope first.  The deque keeps the scopes where they are as others come and go.
+    std::deque<Scope> scopes_;
     FunctionType current_func = FunctionType::None;
     ClassType current_class_ = ClassType::None;
                     
 public:
-    Resolver(Interpreter& interpreter):
-        interpreter_{interpreter} {
-    }
-                    
-    void resolve(const std::vector<std::unique_ptr<Stmt>>& stmts);
-
-// ExprVisitor Implementation
-public:
-    void visit(const AssignExpr& expr) override;
-    void visit(const BinaryExpr& expr) override;
-    void visit(const LiteralExpr& expr) override;
-    void visit(const GroupingExpr& expr) override;
-    void visit(const UnaryExpr& expr) override;
-    void visit(const VariableExpr& expr) override;
-    void visit(const LogicalExpr& expr) override;
-    void visit(const CallExpr& expr) override;
-    void visit(const GetExpr& expr) override;
-    void visit(const SetExpr& expr) override;
-    void visit(const ThisExpr& expr) override;
-    void visit(const SuperExpr& expr) override;
-    
-// StmtVisitor Implementation
-public:
-    void visit(const PrintStatement& stmt) override;
-    void visit(const ExpressionStatement& stmt) override;
-    void visit(const VariableDeclStatement& stmt) override;
-    void visit(const BlockStatement& stmt) override;
-    void visit(const IfStatement& stmt) override;
-    void visit(const WhileStatement& stmt) override;
-    void visit(const FunctionDeclStatementProxy& stmt_proxy) override;
-    void visit(const ReturnStatement& stmt) override;
-    void visit(const ClassDeclStatement& stmt) override;
+    void resolve(FlatAst& ast);
                     
 // Internal Helpers
 private:
-    void begin_scope_();
-    void resolve_(Stmt& stmt);
-    void resolve_(Expr& expr);
+    void resolve_(NodeIndex node);
+    void resolve_list_(uint32_t first, uint32_t count);
+    void resolve_variable_(NodeIndex node);
+    void resolve_block_(NodeIndex node);
+    void resolve_class_(NodeIndex node);
+    void begin_scope_(NodeIndex block = no_node);
     void end_scope_();
-    void declare_(const Token& name);
-    void define_(const Token& name);
-    void resolve_local_(const Expr& expr, const Token& name);
-    void resolve_function_(const FunctionDeclStatement& stmt, const FunctionType& type);
+    void declare_(std::string_view name, NodeIndex declaration = no_node);
+    void record_uses_(const VarInfo& info);
+    void define_(std::string_view name);
+    void resolve_local_(NodeIndex node, std::string_view name);
+    void resolve_function_(NodeIndex node, const FunctionType& type);
+
+    /// Makes slot of home's environment one of function's upvalues, and of every function between them, returns
+    /// which upvalue it is.
+    int capture_(Scope& function, const Scope& home, int slot);
+
+    /// Whether any of the block's own statements declares a name.
+    bool declares_(NodeIndex block) const;
+    
+    /// The Call a Return hands its value straight back from, no_node if there is none.
+    NodeIndex tail_call_(NodeIndex node) const;
 };
 
 } // namespace cpplox
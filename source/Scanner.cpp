@@ -1,24 +1,87 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #include "Scanner.hpp"
 
+#include "CharScan.hpp"
 #include "ScannerError.hpp"
 
+#include <array>
+#include <charconv>
+#include <string_view>
 
 namespace cpplox {
 
+//
+// Keywords are found with a perfect hash over an identifier's length and its first and last characters, which
+// gives each of the 16 keywords a slot of its own in a table of 32.  An identifier is a keyword only if it is the
+// word in its slot, so a lookup is one hash and at most one compare, and the table is built at compile time.
+//
+
+struct Keyword {
+    std::string_view word;
+    TokenType type = TokenType::IDENTIFIER;
+};
+
+static constexpr std::array<Keyword, 16> keywords_{{
+    {"and", TokenType::AND},
+    {"class", TokenType::CLASS},
+    {"else", TokenType::ELSE},
+    {"false", TokenType::FALSE},
+    {"for", TokenType::FOR},
+    {"fun", TokenType::FUN},
+    {"if", TokenType::IF},
+    {"nil", TokenType::NIL},
+    {"or", TokenType::OR},
+    {"print", TokenType::PRINT},
+    {"return", TokenType::RETURN},
+    {"super", TokenType::SUPER},
+    {"this", TokenType::THIS},
+    {"true", TokenType::TRUE},
+    {"var", TokenType::VAR},
+    {"while", TokenType::WHILE}
+}};
+
+static constexpr size_t keyword_slot_(std::string_view word) {
+    return (static_cast<unsigned char>(word.front()) + 5 * static_cast<unsigned char>(word.back()) + word.size()) & 31;
+}
+
+static constexpr std::array<Keyword, 32> keyword_table_ = [] {
+    std::array<Keyword, 32> table{};
+    for(const auto& keyword: keywords_) {
+        table[keyword_slot_(keyword.word)] = keyword;
+    }
+    return table;
+}();
+
+static_assert([] {
+    for(const auto& keyword: keywords_) {
+        if (keyword_table_[keyword_slot_(keyword.word)].word != keyword.word) {
+            return false;
+        }
+    }
+    return true;
+}(), "Two keywords hash to the same slot, the hash needs changing.");
+
+/// The keyword's type, or IDENTIFIER when the word is not one.  word is never empty.
+static constexpr TokenType keyword_type_(std::string_view word) {
+    const auto& keyword = keyword_table_[keyword_slot_(word)];
+    return keyword.word == word ? keyword.type : TokenType::IDENTIFIER;
+}
+
+static_assert(keyword_type_("while") == TokenType::WHILE && keyword_type_("whilst") == TokenType::IDENTIFIER);
+
 std::vector<Token> Scanner::scan_tokens() {
     while (!is_at_end_()) {
         start_ = current_;
         scan_token_();
     }
     
-    tokens_.push_back(Token{TokenType::ENDOFFILE, "", {}, line_});
+    tokens_.push_back(Token{TokenType::ENDOFFILE, "", {}, line_, current_});
     
     return std::move(tokens_);
 }
 
 bool Scanner::is_at_end_() {
-    return current_ >= source_.size();
+    return static_cast<size_t>(current_) >= source_.size();
 }
 
 void Scanner::scan_token_() {
@@ -65,22 +128,24 @@ void Scanner::scan_token_() {
             break;
         case '/':
             if (match_('/')) {
-                while (peek_() != '\n' && peek_() != '\r' && !is_at_end_()) {
-                    advance_();
-                }
+                int lines = 0;
+                current_ = offset_(CharScan::find(position_(current_), end_(), '\n', '\r', lines));
             } else if (match_('*')) {
                 eat_multi_line_comment_();
             } else {
                 add_token_(TokenType::SLASH);
             }
             break;
+        case '\n':
+            ++line_;
+            [[fallthrough]];
         case ' ':
         case '\r':
         case '\t':
-            // Ignore whitespace.
-            break;
-        case '\n':
-            ++line_;
+            // Ignore whitespace.  Most runs are a single space, those need no search.
+            if (is_whitespace_(peek_())) {
+                current_ = offset_(CharScan::skip_whitespace(position_(current_), end_(), line_));
+            }
             break;
         case '"':
             string_();
@@ -98,7 +163,7 @@ void Scanner::scan_token_() {
 }
 
 char Scanner::advance_() {
-    if (current_ >= source_.size()) {
+    if (static_cast<size_t>(current_) >= source_.size()) {
         throw ScannerError("You tried to go past end of script", line_);
     }
     
@@ -111,7 +176,7 @@ void Scanner::add_token_(TokenType type) {
 
 void Scanner::add_token_(TokenType type, const cpplox::TokenValueType& literal_value) {
     auto text = source_.substr(start_, (current_ - start_));
-    tokens_.push_back(Token(type, text, literal_value, line_));
+    tokens_.push_back(Token(type, text, literal_value, line_, start_));
 }
 
 bool Scanner::match_(char expected) {
@@ -140,7 +205,7 @@ char Scanner::peek_next_() {
         return '\0';
     }
     
-    if (current_ + 1 >= source_.size()) {
+    if (static_cast<size_t>(current_) + 1 >= source_.size()) {
         return '\0';
     }
     
@@ -148,12 +213,7 @@ char Scanner::peek_next_() {
 }
 
 void Scanner::string_() {
-    while (peek_() != '"' && !is_at_end_()) {
-        if (peek_() == '\n') {
-            ++line_;
-        }
-        advance_();
-    }
+    current_ = offset_(CharScan::find(position_(current_), end_(), '"', '"', line_));
     
     // We hit end of script, but no closing ".
     if (is_at_end_()) {
@@ -163,10 +223,7 @@ void Scanner::string_() {
     // Go past "
     advance_();
     
-    std::string string_value = source_.substr(start_ + 1, (current_ - start_) - 2);
-    add_token_(TokenType::STRING, string_value);
-    
-
+    add_token_(TokenType::STRING, source_.substr(start_ + 1, (current_ - start_) - 2));
 }
 
 void Scanner::number_() {
@@ -182,8 +239,8 @@ void Scanner::number_() {
         }
     }
     
-    std::string number_string = source_.substr(start_, current_ - start_);
-    double number_value = std::stod(number_string);
+    double number_value = 0;
+    std::from_chars(source_.data() + start_, source_.data() + current_, number_value);
     
     add_token_(TokenType::NUMBER, number_value);
 }
@@ -198,52 +255,39 @@ bool Scanner::is_alpha_numeric_(char c) {
     return is_alpha_(c) || std::isdigit(c);
 }
 
+bool Scanner::is_whitespace_(char c) {
+    return c == ' ' || c == '\r' || c == '\t' || c == '\n';
+}
+
 void Scanner::identifier_() {
-    while (is_alpha_numeric_(peek_())) {
-        advance_();
-    }
+    current_ = offset_(CharScan::skip_identifier(position_(current_), end_()));
     
-    std::string identifier = source_.substr(start_, current_ - start_);
-    auto itr = keywords_.find(identifier);
-    if (itr == keywords_.end()) {
-        add_token_(TokenType::IDENTIFIER, identifier);
-    } else {
-        add_token_(itr->second);
-    }
+    add_token_(keyword_type_(source_.substr(start_, current_ - start_)));
 }
 
 void Scanner::eat_multi_line_comment_() {
     // Go past *.
     advance_();
     
+    //
+    // Only a * or a / can end the comment or start a nested one, everything in between is skipped in one go.
+    //
     bool found_end_of_comment = false;
     while(!is_at_end_() && !found_end_of_comment) {
-        char c = peek_();
+        current_ = offset_(CharScan::find(position_(current_), end_(), '*', '/', line_));
+        if (is_at_end_()) {
+            break;
+        }
         
-        switch (c) {
-            case '*':
-                if (peek_next_() == '/') {
-                    advance_();
-                    advance_();
-                    found_end_of_comment = true;
-                } else {
-                    advance_();
-                }
-                break;
-            case '/':
-                // This is a comment within a comment.
-                if (peek_next_() == '*') {
-                    eat_multi_line_comment_();
-                } else {
-                    advance_();
-                }
-                break;
-            case '\n':
-                ++line_;
-            default:
-                // Eat it.
-                advance_();
-                break;
+        char c = peek_();
+        if (c == '*' && peek_next_() == '/') {
+            current_ += 2;
+            found_end_of_comment = true;
+        } else if (c == '/' && peek_next_() == '*') {
+            // This is a comment within a comment.
+            eat_multi_line_comment_();
+        } else {
+            ++current_;
         }
     }
     
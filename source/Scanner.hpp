@@ -3,50 +3,31 @@
 #include "Token.hpp"
 #include "TokenType.hpp"
 
-#include <iostream>
-#include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace cpplox {
 
 /// Used to break-up the stream into tokens that we use for parsing.
+///
+/// The scanner reads the source in place and never copies it.  Lexemes and string literals are views of the
+/// source and numbers are parsed straight out of it, so the source has to outlive the tokens, which the Program
+/// sees to by holding on to it.
 class Scanner {
 private:
-    std::string source_;
+    std::string_view source_;
     std::vector<Token> tokens_;
     int start_ = 0;
     int current_ = 0;
     int line_ = 1;
-    const std::map<std::string, TokenType> keywords_ = {
-        {"and", TokenType::AND},
-        {"class", TokenType::CLASS},
-        {"else", TokenType::ELSE},
-        {"false", TokenType::FALSE},
-        {"for", TokenType::FOR},
-        {"fun", TokenType::FUN},
-        {"if", TokenType::IF},
-        {"nil", TokenType::NIL},
-        {"or", TokenType::OR},
-        {"print", TokenType::PRINT},
-        {"return", TokenType::RETURN},
-        {"super", TokenType::SUPER},
-        {"this", TokenType::THIS},
-        {"true", TokenType::TRUE},
-        {"var", TokenType::VAR},
-        {"while", TokenType::WHILE}
-    };
     
     
 public:
-    Scanner(const std::string& source):
+    explicit Scanner(std::string_view source):
         source_{source} {
     }
     
-    Scanner(std::istream& stream) {
-        
-    }
-    
     std::vector<Token> scan_tokens();
     
 private:
@@ -62,8 +43,21 @@ private:
     void number_();
     bool is_alpha_(char c);
     bool is_alpha_numeric_(char c);
+    bool is_whitespace_(char c);
     void identifier_();
     void eat_multi_line_comment_();
+    
+    const char* position_(int offset) const {
+        return source_.data() + offset;
+    }
+    
+    const char* end_() const {
+        return source_.data() + source_.size();
+    }
+    
+    int offset_(const char* position) const {
+        return static_cast<int>(position - source_.data());
+    }
 };
 
 } // namespace cpplox
@@ -0,0 +1,18 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Shape.hpp"
+
+namespace cpplox {
+
+Shape* Shape::add(std::string_view name) {
+    auto itr = transitions_.find(name);
+    if (itr == transitions_.end()) {
+        auto next = std::make_unique<Shape>();
+        next->slots_ = slots_;
+        next->slots_.emplace(name, slot_count());
+        itr = transitions_.emplace(name, std::move(next)).first;
+    }
+
+    return itr->second.get();
+}
+
+} // namespace cpplox
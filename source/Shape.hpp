@@ -0,0 +1,45 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "StringHash.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace cpplox {
+
+/// The hidden class of an instance: which field lives in which slot of the instance's field array.
+///
+/// Shapes never change once made.  Adding a field moves the instance along a transition to the shape that has
+/// one more slot, and the transitions are shared, so instances that get the same fields in the same order (the
+/// usual case for anything built by one init) all end up pointing at the same shape.
+class Shape {
+private:
+    std::unordered_map<std::string, int, StringHash, std::equal_to<>> slots_;
+    std::unordered_map<std::string, std::unique_ptr<Shape>, StringHash, std::equal_to<>> transitions_;
+
+public:
+    Shape() {
+    }
+
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+    /// Returns the slot holding the field, or -1 if instances of this shape do not have it.
+    int find(std::string_view name) const {
+        auto itr = slots_.find(name);
+        return itr == slots_.end() ? -1 : itr->second;
+    }
+
+    int slot_count() const {
+        return static_cast<int>(slots_.size());
+    }
+
+    /// Returns the shape with name added as the next slot, creating it the first time anyone asks.
+    Shape* add(std::string_view name);
+};
+
+} // namespace cpplox
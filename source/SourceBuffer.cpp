@@ -0,0 +1,96 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "SourceBuffer.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace cpplox {
+
+/// Closes the file however open() leaves.  The mapping stays valid once the file is closed.
+struct FileCloser {
+    int fd;
+
+    ~FileCloser() {
+        close(fd);
+    }
+};
+
+SourceBuffer::~SourceBuffer() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, mapped_size_);
+    }
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Could not open " + path);
+    }
+    FileCloser closer{fd};
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        throw std::system_error(errno, std::generic_category(), "Could not read " + path);
+    }
+
+    std::unique_ptr<SourceBuffer> buffer{new SourceBuffer()};
+
+    //
+    // An empty file can not be mapped, and there is nothing to map anyway.  When mapping fails for any other
+    // reason, the file is read instead.
+    //
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        auto size = static_cast<size_t>(info.st_size);
+        auto mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // The scanner goes through it once, front to back.
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            buffer->mapping_ = mapping;
+            buffer->mapped_size_ = size;
+            return buffer;
+        }
+    }
+
+    buffer->read_(fd, S_ISREG(info.st_mode) ? static_cast<size_t>(info.st_size) : 0);
+    return buffer;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::create(std::string text) {
+    std::unique_ptr<SourceBuffer> buffer{new SourceBuffer()};
+    buffer->text_ = std::move(text);
+    return buffer;
+}
+
+void SourceBuffer::read_(int fd, size_t size_hint) {
+    //
+    // A regular file's size is known, so it comes in with one read, the byte to spare lets the next read see the end
+    // without growing the buffer.  A pipe is read until it ends, growing the buffer as it fills.
+    //
+    text_.resize(size_hint > 0 ? size_hint + 1 : 64 * 1024);
+    size_t used = 0;
+    while (true) {
+        if (used == text_.size()) {
+            text_.resize(text_.size() * 2);
+        }
+
+        auto count = ::read(fd, text_.data() + used, text_.size() - used);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "Could not read script");
+        }
+        if (count == 0) {
+            break;
+        }
+        used += static_cast<size_t>(count);
+    }
+    text_.resize(used);
+}
+
+} // namespace cpplox
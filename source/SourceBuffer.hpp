@@ -0,0 +1,52 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cpplox {
+
+/// The text of a script, which the Scanner's tokens point into.
+///
+/// A script file is mapped read-only rather than read, so loading it copies nothing and the text is exactly the
+/// file's bytes: a token's offset is its offset in the file.  What can not be mapped, such as a pipe, is read in
+/// one go instead.  The REPL hands over the text it collected.
+class SourceBuffer {
+private:
+    std::string text_;
+    void* mapping_ = nullptr;
+    size_t mapped_size_ = 0;
+
+    SourceBuffer() = default;
+
+public:
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    /// Maps, or reads, the file at path.  Throws std::system_error when it can not be opened or read.
+    static std::unique_ptr<SourceBuffer> open(const std::string& path);
+
+    /// Takes over text that is already in memory.
+    static std::unique_ptr<SourceBuffer> create(std::string text);
+
+    std::string_view text() const {
+        if (mapping_ != nullptr) {
+            return {static_cast<const char*>(mapping_), mapped_size_};
+        }
+        return text_;
+    }
+
+    /// True when the text is the file mapped into memory, false when it was copied.
+    bool is_mapped() const {
+        return mapping_ != nullptr;
+    }
+
+// Internal Helpers
+private:
+    void read_(int fd, size_t size_hint);
+};
+
+} // namespace cpplox
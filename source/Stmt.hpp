@@ -1,10 +1,11 @@
 // Copyright 2025, Yasser Zabuair.  See LICENSE for details.
 #pragma once
 
-#include <memory>
+#include <span>
 #include <vector>
 
 #include "Expr.hpp"
+#include "Program.hpp"
 
 namespace cpplox {
 
@@ -35,9 +36,9 @@ struct StmtVisitor {
     virtual void visit(const ClassDeclStatement& stmt) = 0;
 };
 
+/// Like expressions, statements live in their Program's arena and must stay trivially destructible.
 struct Stmt {
     Stmt(){ }
-    virtual ~Stmt(){ }
     
     virtual void accept(StmtVisitor& visit) = 0;
 };
@@ -45,13 +46,13 @@ struct Stmt {
 // ---
 
 struct PrintStatement: public Stmt {
-    std::unique_ptr<Expr>   expression;
+    Expr*   expression;
     
-    PrintStatement(std::unique_ptr<Expr> expr): expression{std::move(expr)} {
+    PrintStatement(Expr* expr): expression{expr} {
     }
     
-    static std::unique_ptr<PrintStatement> create(std::unique_ptr<Expr> expression) {
-        return std::make_unique<PrintStatement>(std::move(expression));
+    static PrintStatement* create(Program& program, Expr* expression) {
+        return program.make<PrintStatement>(expression);
     }
     
     virtual void accept(StmtVisitor& visitor) override {
@@ -62,13 +63,13 @@ struct PrintStatement: public Stmt {
 // ---
 
 struct ExpressionStatement: public Stmt {
-    std::unique_ptr<Expr>   expression;
+    Expr*   expression;
     
-    ExpressionStatement(std::unique_ptr<Expr> expr): expression(std::move(expr)) {
+    ExpressionStatement(Expr* expr): expression(expr) {
     }
     
-    static std::unique_ptr<ExpressionStatement> create(std::unique_ptr<Expr> expr) {
-        return std::make_unique<ExpressionStatement>(std::move(expr));
+    static ExpressionStatement* create(Program& program, Expr* expr) {
+        return program.make<ExpressionStatement>(expr);
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -79,18 +80,19 @@ struct ExpressionStatement: public Stmt {
 // ---
 
 struct VariableDeclStatement: public Stmt {
-    Token                   name;
-    std::unique_ptr<Expr>   initializer;
+    TokenRef    name;
+    Expr*       initializer;
     
-    VariableDeclStatement(const Token& name,
-                          std::unique_ptr<Expr> initializer):
+    VariableDeclStatement(const TokenRef& name,
+                          Expr* initializer):
         name{name},
-        initializer{std::move(initializer)} {
+        initializer{initializer} {
     }
     
-    static std::unique_ptr<VariableDeclStatement> create(const Token& name,
-                                                         std::unique_ptr<Expr> initializer) {
-        return std::make_unique<VariableDeclStatement>(name, std::move(initializer));
+    static VariableDeclStatement* create(Program& program,
+                                         const Token& name,
+                                         Expr* initializer) {
+        return program.make<VariableDeclStatement>(program.ref(name), initializer);
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -101,14 +103,14 @@ struct VariableDeclStatement: public Stmt {
 // ---
 
 struct BlockStatement: public Stmt {
-    std::vector<std::unique_ptr<Stmt>> statements;
+    std::span<Stmt*> statements;
     
-    BlockStatement(std::vector<std::unique_ptr<Stmt>> statements): statements{std::move(statements)} {
+    BlockStatement(std::span<Stmt*> statements): statements{statements} {
         
     }
     
-    static std::unique_ptr<BlockStatement> create(std::vector<std::unique_ptr<Stmt>> statements) {
-        return std::make_unique<BlockStatement>(std::move(statements));
+    static BlockStatement* create(Program& program, const std::vector<Stmt*>& statements) {
+        return program.make<BlockStatement>(program.list(statements));
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -119,22 +121,23 @@ struct BlockStatement: public Stmt {
 // ---
 
 struct IfStatement: public Stmt {
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> then_branch;
-    std::unique_ptr<Stmt> else_branch;
-    
-    IfStatement(std::unique_ptr<Expr> condition,
-                std::unique_ptr<Stmt> then_branch,
-                std::unique_ptr<Stmt> else_branch):
-        condition{std::move(condition)},
-        then_branch{std::move(then_branch)},
-        else_branch{std::move(else_branch)} {
+    Expr* condition;
+    Stmt* then_branch;
+    Stmt* else_branch;
+    
+    IfStatement(Expr* condition,
+                Stmt* then_branch,
+                Stmt* else_branch):
+        condition{condition},
+        then_branch{then_branch},
+        else_branch{else_branch} {
     }
     
-    static std::unique_ptr<IfStatement> create(std::unique_ptr<Expr> condition,
-                                               std::unique_ptr<Stmt> then_branch,
-                                               std::unique_ptr<Stmt> else_branch) {
-        return std::make_unique<IfStatement>(std::move(condition), std::move(then_branch), std::move(else_branch));
+    static IfStatement* create(Program& program,
+                               Expr* condition,
+                               Stmt* then_branch,
+                               Stmt* else_branch) {
+        return program.make<IfStatement>(condition, then_branch, else_branch);
     }
 
     void accept(StmtVisitor& visitor) override {
@@ -145,19 +148,20 @@ struct IfStatement: public Stmt {
 // ---
 
 struct WhileStatement: public Stmt {
-    std::unique_ptr<Expr> condition;
-    std::unique_ptr<Stmt> body;
+    Expr* condition;
+    Stmt* body;
     
-    WhileStatement(std::unique_ptr<Expr> condition,
-                   std::unique_ptr<Stmt> body):
-        condition{std::move(condition)},
-        body{std::move(body)} {
+    WhileStatement(Expr* condition,
+                   Stmt* body):
+        condition{condition},
+        body{body} {
         
     }
     
-    static std::unique_ptr<WhileStatement> create(std::unique_ptr<Expr> condition,
-                                                  std::unique_ptr<Stmt> body) {
-        return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+    static WhileStatement* create(Program& program,
+                                  Expr* condition,
+                                  Stmt* body) {
+        return program.make<WhileStatement>(condition, body);
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -167,39 +171,41 @@ struct WhileStatement: public Stmt {
 
 // ---
 
-struct FunctionDeclStatement: public std::enable_shared_from_this<FunctionDeclStatement> {
-    Token                               name;
-    std::vector<Token>                  params;
-    std::vector<std::unique_ptr<Stmt>>  body;
-    
-    FunctionDeclStatement(const Token& name,
-                          std::vector<Token> params,
-                          std::vector<std::unique_ptr<Stmt>> body):
+struct FunctionDeclStatement {
+    TokenRef                name;
+    std::span<TokenRef>     params;
+    std::span<Stmt*>        body;
+    
+    FunctionDeclStatement(const TokenRef& name,
+                          std::span<TokenRef> params,
+                          std::span<Stmt*> body):
         name{name},
-        params{std::move(params)},
-        body{std::move(body)} {
+        params{params},
+        body{body} {
     }
     
-    static std::shared_ptr<FunctionDeclStatement> create(const Token& name,
-                                                         const std::vector<Token>& params,
-                                                         std::vector<std::unique_ptr<Stmt>> body) {
-        return std::make_shared<FunctionDeclStatement>(name, params, std::move(body));
+    static FunctionDeclStatement* create(Program& program,
+                                         const Token& name,
+                                         const std::vector<TokenRef>& params,
+                                         const std::vector<Stmt*>& body) {
+        return program.make<FunctionDeclStatement>(program.ref(name), program.list(params), program.list(body));
     }
         
     
 };
 
 struct FunctionDeclStatementProxy: public Stmt {
-    std::shared_ptr<FunctionDeclStatement> stmt;
+    FunctionDeclStatement* stmt;
     
-    FunctionDeclStatementProxy(const std::shared_ptr<FunctionDeclStatement>& stmt): stmt{stmt} {
+    FunctionDeclStatementProxy(FunctionDeclStatement* stmt): stmt{stmt} {
     }
     
-    static std::unique_ptr<FunctionDeclStatementProxy> create(const Token& name,
-                                                              const std::vector<Token>& params,
-                                                              std::vector<std::unique_ptr<Stmt>> body) {
-        auto func_decl = FunctionDeclStatement::create(name, params, std::move(body));
-        return std::make_unique<FunctionDeclStatementProxy>(func_decl);
+    static FunctionDeclStatementProxy* create(Program& program,
+                                              const Token& name,
+                                              const std::vector<TokenRef>& params,
+                                              const std::vector<Stmt*>& body) {
+        auto func_decl = FunctionDeclStatement::create(program, name, params, body);
+        return program.make<FunctionDeclStatementProxy>(func_decl);
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -211,18 +217,19 @@ struct FunctionDeclStatementProxy: public Stmt {
 // ---
 
 struct ReturnStatement: public Stmt {
-    Token                   keyword;
-    std::unique_ptr<Expr>   value;
+    TokenRef    keyword;
+    Expr*       value;
     
-    ReturnStatement(const Token& keyword,
-                    std::unique_ptr<Expr> value):
+    ReturnStatement(const TokenRef& keyword,
+                    Expr* value):
         keyword{keyword},
-        value{std::move(value)} {
+        value{value} {
     }
     
-    static std::unique_ptr<ReturnStatement> create(const Token& keyword,
-                                                   std::unique_ptr<Expr> value) {
-        return std::make_unique<ReturnStatement>(keyword, std::move(value));
+    static ReturnStatement* create(Program& program,
+                                   const Token& keyword,
+                                   Expr* value) {
+        return program.make<ReturnStatement>(program.ref(keyword), value);
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -233,22 +240,23 @@ struct ReturnStatement: public Stmt {
 // ---
 
 struct ClassDeclStatement: public Stmt {
-    Token                                               name;
-    std::unique_ptr<VariableExpr>                       super_class;
-    std::vector<std::shared_ptr<FunctionDeclStatement>> methods;
+    TokenRef                                name;
+    VariableExpr*                           super_class;
+    std::span<FunctionDeclStatement*>       methods;
     
-    ClassDeclStatement(const Token& name,
-                       std::unique_ptr<VariableExpr> super_class,
-                       std::vector<std::shared_ptr<FunctionDeclStatement>> methods):
+    ClassDeclStatement(const TokenRef& name,
+                       VariableExpr* super_class,
+                       std::span<FunctionDeclStatement*> methods):
         name{name},
-        super_class{std::move(super_class)},
-        methods{std::move(methods)} {
+        super_class{super_class},
+        methods{methods} {
     }
     
-    static std::unique_ptr<ClassDeclStatement> create(const Token& name,
-                                                      std::unique_ptr<VariableExpr> super_class,
-                                                      std::vector<std::shared_ptr<FunctionDeclStatement>> methods) {
-        return std::make_unique<ClassDeclStatement>(name, std::move(super_class), std::move(methods));
+    static ClassDeclStatement* create(Program& program,
+                                      const Token& name,
+                                      VariableExpr* super_class,
+                                      const std::vector<FunctionDeclStatement*>& methods) {
+        return program.make<ClassDeclStatement>(program.ref(name), super_class, program.list(methods));
     }
     
     void accept(StmtVisitor& visitor) override {
@@ -0,0 +1,20 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+namespace cpplox {
+
+/// Lets maps keyed by std::string be searched with a std::string_view without building a string first.  Use it
+/// together with std::equal_to<>.
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view text) const {
+        return std::hash<std::string_view>{}(text);
+    }
+};
+
+} // namespace cpplox
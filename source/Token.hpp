@@ -5,34 +5,56 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace cpplox {
 
-using TokenValueType = std::variant<std::monostate, std::string, double, bool, nullptr_t>;
+/// A token's literal.  A string's text points into the source, between the quotes.
+using TokenValueType = std::variant<std::monostate, std::string_view, double, bool, nullptr_t>;
+
+/// Same alternatives as TokenValueType, but strings point at text interned by the Program.
+using LiteralValue = std::variant<std::monostate, std::string_view, double, bool, nullptr_t>;
 
 /// Represents a token we've scanned from the stream.
+///
+/// The lexeme is a view of the source buffer, so a token copies no characters, and the buffer has to outlive the
+/// tokens scanned from it.
 struct Token {
     
 public:
     TokenType type = TokenType::UNDEFINED;
-    std::string lexeme;
+    std::string_view lexeme;
     TokenValueType literal;
     int line = 0;
     
+    /// Where the token starts in the source, in bytes.
+    int offset = 0;
+    
 public:
     friend std::ostream& operator<<(std::ostream& stream, const Token& token);
     Token(TokenType type,
-          const std::string& lexeme,
+          std::string_view lexeme,
           const TokenValueType& literal,
-          int line): type{type},
-                     lexeme{lexeme},
-                     literal{literal},
-                     line{line} {
+          int line,
+          int offset = 0): type{type},
+                           lexeme{lexeme},
+                           literal{literal},
+                           line{line},
+                           offset{offset} {
     }
     
 };
 
+/// A token as the AST keeps it.  The lexeme points at a name interned by the Program, so copying one copies no
+/// characters, and offset plus the lexeme's length is the token's span in the source.
+struct TokenRef {
+    TokenType type = TokenType::UNDEFINED;
+    std::string_view lexeme;
+    int line = 0;
+    int offset = 0;
+};
+
 inline std::ostream& operator<<(std::ostream& stream, const Token& token) {
     switch (token.type) {
         case TokenType::STRING:
@@ -44,7 +66,7 @@ inline std::ostream& operator<<(std::ostream& stream, const Token& token) {
             if (token.literal.index() == 0) {
                 stream << token.type << " " << token.lexeme << "empty \n";
             } else if (token.literal.index() == 1) {
-                stream << token.type << " " << token.lexeme << " " << std::get<std::string>(token.literal) << "\n";
+                stream << token.type << " " << token.lexeme << " " << std::get<std::string_view>(token.literal) << "\n";
             } else if (token.literal.index() == 2){
                 stream << token.type << " " << token.lexeme << " " << std::get<double>(token.literal) << "\n";
             } else if (token.literal.index() == 3) {
@@ -0,0 +1,707 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "VM.hpp"
+
+#include "Compiler.hpp"
+#include "RuntimeError.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <print>
+
+namespace cpplox {
+
+static Value clock_native_(int, Value*) {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return Value::number(std::chrono::duration<double>(now).count());
+}
+
+VM::VM():
+    stack_(initial_frames_ * frame_slots_),
+    frames_(initial_frames_) {
+    reset_stack_();
+    init_string_ = heap_.intern("init");
+    define_native_("clock", 0, clock_native_);
+}
+
+void VM::interpret(std::span<Stmt*> stmts) {
+    //
+    // An error that did not come through runtime_error_, such as the heap running past --max-heap in the middle of
+    // a collection, leaves the last run's frames behind.  They would keep everything they reference alive.
+    //
+    reset_stack_();
+
+    Compiler compiler{heap_};
+    ObjFunction* function = compiler.compile(stmts);
+
+    auto closure = heap_.allocate<ObjClosure>(function);
+    push_(Value::object(closure));
+    call_(closure, 0);
+
+    run_();
+}
+
+void VM::run_() {
+    CallFrame* frame = &frames_[frame_count_ - 1];
+    uint8_t* ip = frame->ip;
+
+    auto read_byte = [&ip]() -> uint8_t {
+        return *ip++;
+    };
+
+    auto read_short = [&ip]() -> uint16_t {
+        ip += 2;
+        return static_cast<uint16_t>((ip[-2] << 8) | ip[-1]);
+    };
+
+    auto read_offset = [&ip]() -> uint32_t {
+        ip += 4;
+        return (uint32_t{ip[-4]} << 24) | (uint32_t{ip[-3]} << 16) | (uint32_t{ip[-2]} << 8) | ip[-1];
+    };
+
+    auto read_constant = [&frame, &read_short]() -> const Value& {
+        return frame->closure->function->chunk.constants[read_short()];
+    };
+
+    auto read_string = [&read_constant]() -> ObjString* {
+        return as_obj<ObjString>(read_constant());
+    };
+
+    // The frame keeps its own copy of ip, it needs to be current before we call out or report an error.
+    auto save_ip = [&frame, &ip]() {
+        frame->ip = ip;
+    };
+
+    auto load_frame = [this, &frame, &ip]() {
+        frame = &frames_[frame_count_ - 1];
+        ip = frame->ip;
+    };
+
+    auto error = [this, &save_ip](const std::string& message) {
+        save_ip();
+        runtime_error_(message);
+    };
+
+    auto check_number_operands = [this, &error]() {
+        if (!peek_(0).is_number() || !peek_(1).is_number()) {
+            error("Operands must be numbers.");
+        }
+    };
+
+    while (true) {
+        switch (static_cast<OpCode>(read_byte())) {
+            case OpCode::CONSTANT:
+                push_(read_constant());
+                break;
+
+            case OpCode::NIL:
+                push_(Value::nil());
+                break;
+
+            case OpCode::TRUE:
+                push_(Value::boolean(true));
+                break;
+
+            case OpCode::FALSE:
+                push_(Value::boolean(false));
+                break;
+
+            case OpCode::POP:
+                pop_();
+                break;
+
+            case OpCode::GET_LOCAL:
+                push_(frame->slots[read_short()]);
+                break;
+
+            case OpCode::SET_LOCAL:
+                frame->slots[read_short()] = peek_(0);
+                break;
+
+            case OpCode::GET_GLOBAL: {
+                ObjString* name = read_string();
+                auto itr = globals_.find(name);
+                if (itr == globals_.end()) {
+                    error(std::format("Undefined variable: {}", name->chars));
+                }
+                push_(itr->second);
+                break;
+            }
+
+            case OpCode::DEFINE_GLOBAL:
+                globals_[read_string()] = peek_(0);
+                pop_();
+                break;
+
+            case OpCode::SET_GLOBAL: {
+                ObjString* name = read_string();
+                auto itr = globals_.find(name);
+                if (itr == globals_.end()) {
+                    error(std::format("Undefined variable: {}", name->chars));
+                }
+                itr->second = peek_(0);
+                break;
+            }
+
+            case OpCode::GET_UPVALUE:
+                push_(*(frame->closure->upvalues[read_short()]->location));
+                break;
+
+            case OpCode::SET_UPVALUE:
+                *(frame->closure->upvalues[read_short()]->location) = peek_(0);
+                break;
+
+            case OpCode::GET_PROPERTY: {
+                if (!is_obj_type(peek_(0), ObjType::Instance)) {
+                    error("Only object instances have properties.");
+                }
+
+                auto instance = as_obj<ObjInstance>(peek_(0));
+                ObjString* name = read_string();
+
+                auto itr = instance->fields.find(name);
+                if (itr != instance->fields.end()) {
+                    pop_();
+                    push_(itr->second);
+                    break;
+                }
+
+                save_ip();
+                bind_method_(instance->klass, name);
+                break;
+            }
+
+            case OpCode::SET_PROPERTY: {
+                if (!is_obj_type(peek_(1), ObjType::Instance)) {
+                    error("Only object instances have properties.");
+                }
+
+                auto instance = as_obj<ObjInstance>(peek_(1));
+                instance->fields[read_string()] = peek_(0);
+
+                Value value = pop_();
+                pop_();
+                push_(value);
+                break;
+            }
+
+            case OpCode::GET_SUPER: {
+                ObjString* name = read_string();
+                auto super_class = as_obj<ObjClass>(pop_());
+
+                save_ip();
+                bind_method_(super_class, name);
+                break;
+            }
+
+            case OpCode::NO_SUPER:
+                error("Could not find 'super' in environment.");
+                break;
+
+            case OpCode::EQUAL: {
+                Value b = pop_();
+                Value a = pop_();
+                push_(Value::boolean(a == b));
+                break;
+            }
+
+            case OpCode::GREATER: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::boolean(a > b));
+                break;
+            }
+
+            // Not LESS then NOT, a comparison with NaN is false either way.
+            case OpCode::GREATER_EQUAL: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::boolean(a >= b));
+                break;
+            }
+
+            case OpCode::LESS: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::boolean(a < b));
+                break;
+            }
+
+            case OpCode::LESS_EQUAL: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::boolean(a <= b));
+                break;
+            }
+
+            case OpCode::ADD: {
+                if (is_obj_type(peek_(0), ObjType::String) && is_obj_type(peek_(1), ObjType::String)) {
+                    auto b = as_obj<ObjString>(peek_(0));
+                    auto a = as_obj<ObjString>(peek_(1));
+                    auto result = heap_.intern(a->chars + b->chars);
+                    pop_();
+                    pop_();
+                    push_(Value::object(result));
+                } else if (peek_(0).is_number() && peek_(1).is_number()) {
+                    double b = pop_().as_number();
+                    double a = pop_().as_number();
+                    push_(Value::number(a + b));
+                } else {
+                    error("Operands must be two numbers or two strings.");
+                }
+                break;
+            }
+
+            case OpCode::SUBTRACT: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::number(a - b));
+                break;
+            }
+
+            case OpCode::MULTIPLY: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::number(a * b));
+                break;
+            }
+
+            case OpCode::DIVIDE: {
+                check_number_operands();
+                double b = pop_().as_number();
+                double a = pop_().as_number();
+                push_(Value::number(a / b));
+                break;
+            }
+
+            case OpCode::NOT:
+                push_(Value::boolean(pop_().is_falsey()));
+                break;
+
+            case OpCode::NEGATE:
+                if (!peek_(0).is_number()) {
+                    error("Operand must be a number.");
+                }
+                push_(Value::number(-pop_().as_number()));
+                break;
+
+            case OpCode::PRINT:
+                std::print("{}\n", stringify(pop_()));
+                break;
+
+            case OpCode::JUMP: {
+                uint32_t offset = read_offset();
+                ip += offset;
+                break;
+            }
+
+            case OpCode::JUMP_IF_FALSE: {
+                uint32_t offset = read_offset();
+                if (peek_(0).is_falsey()) {
+                    ip += offset;
+                }
+                break;
+            }
+
+            case OpCode::LOOP: {
+                uint32_t offset = read_offset();
+                ip -= offset;
+                
+                // Loops and calls are where the VM collects, everything live is on the stack at this point.
+                if (heap_.should_collect()) {
+                    collect_garbage_();
+                }
+                break;
+            }
+
+            case OpCode::CALL: {
+                int arg_count = read_byte();
+                save_ip();
+                call_value_(peek_(arg_count), arg_count);
+                load_frame();
+                break;
+            }
+
+            case OpCode::TAIL_CALL: {
+                int arg_count = read_byte();
+                save_ip();
+                tail_call_(peek_(arg_count), arg_count);
+                load_frame();
+                break;
+            }
+
+            case OpCode::INVOKE: {
+                ObjString* method = read_string();
+                int arg_count = read_byte();
+                save_ip();
+                invoke_(method, arg_count);
+                load_frame();
+                break;
+            }
+
+            case OpCode::SUPER_INVOKE: {
+                ObjString* method = read_string();
+                int arg_count = read_byte();
+                auto super_class = as_obj<ObjClass>(pop_());
+                save_ip();
+                invoke_from_class_(super_class, method, arg_count);
+                load_frame();
+                break;
+            }
+
+            case OpCode::CLOSURE: {
+                auto function = as_obj<ObjFunction>(read_constant());
+                auto closure = heap_.allocate<ObjClosure>(function);
+                push_(Value::object(closure));
+
+                for(int i = 0; i < function->upvalue_count; ++i) {
+                    uint8_t is_local = read_byte();
+                    uint16_t index = read_short();
+                    if (is_local) {
+                        closure->upvalues[i] = capture_upvalue_(frame->slots + index);
+                    } else {
+                        closure->upvalues[i] = frame->closure->upvalues[index];
+                    }
+                }
+                break;
+            }
+
+            case OpCode::CLOSE_UPVALUE:
+                close_upvalues_(stack_top_ - 1);
+                pop_();
+                break;
+
+            case OpCode::RETURN: {
+                Value result = pop_();
+                close_upvalues_(frame->slots);
+                --frame_count_;
+
+                // Returning from the script itself, we are done.
+                if (frame_count_ == 0) {
+                    pop_();
+                    return;
+                }
+
+                stack_top_ = frame->slots;
+                push_(result);
+                load_frame();
+                break;
+            }
+
+            case OpCode::CLASS:
+                push_(Value::object(heap_.allocate<ObjClass>(read_string())));
+                break;
+
+            case OpCode::INHERIT: {
+                if (!is_obj_type(peek_(1), ObjType::Class)) {
+                    error("The superclass is not a class.");
+                }
+
+                // Copy down the inherited methods, the subclass's own methods are added after and override these.
+                auto super_class = as_obj<ObjClass>(peek_(1));
+                auto sub_class = as_obj<ObjClass>(peek_(0));
+                sub_class->methods.insert(super_class->methods.begin(), super_class->methods.end());
+                pop_();
+                break;
+            }
+
+            case OpCode::METHOD:
+                define_method_(read_string());
+                break;
+        }
+    }
+}
+
+inline void VM::push_(const Value& value) {
+    *stack_top_ = value;
+    ++stack_top_;
+}
+
+inline Value VM::pop_() {
+    --stack_top_;
+    return *stack_top_;
+}
+
+inline const Value& VM::peek_(int distance) {
+    return stack_top_[-1 - distance];
+}
+
+void VM::reset_stack_() {
+    stack_top_ = stack_.data();
+    frame_count_ = 0;
+    open_upvalues_ = nullptr;
+}
+
+void VM::collect_garbage_() {
+    for(Value* slot = stack_.data(); slot < stack_top_; ++slot) {
+        heap_.mark(*slot);
+    }
+    for(int i = 0; i < frame_count_; ++i) {
+        heap_.mark(frames_[i].closure);
+    }
+    for(ObjUpvalue* upvalue = open_upvalues_; upvalue != nullptr; upvalue = upvalue->next_open) {
+        heap_.mark(upvalue);
+    }
+    for(const auto& [name, global]: globals_) {
+        heap_.mark(name);
+        heap_.mark(global);
+    }
+    heap_.mark(init_string_);
+    
+    heap_.collect();
+}
+
+void VM::call_value_(const Value& callee, int arg_count) {
+    if (callee.is_obj()) {
+        switch (callee.as_obj()->type) {
+            case ObjType::BoundMethod: {
+                auto bound = as_obj<ObjBoundMethod>(callee);
+                stack_top_[-arg_count - 1] = bound->receiver;
+                call_(bound->method, arg_count);
+                return;
+            }
+
+            case ObjType::Class: {
+                auto klass = as_obj<ObjClass>(callee);
+                stack_top_[-arg_count - 1] = Value::object(heap_.allocate<ObjInstance>(klass));
+
+                auto itr = klass->methods.find(init_string_);
+                if (itr != klass->methods.end()) {
+                    call_(as_obj<ObjClosure>(itr->second), arg_count);
+                } else if (arg_count != 0) {
+                    runtime_error_(std::format("Expected 0 arguments but got {}.", arg_count));
+                }
+                return;
+            }
+
+            case ObjType::Closure:
+                call_(as_obj<ObjClosure>(callee), arg_count);
+                return;
+
+            case ObjType::Native: {
+                auto native = as_obj<ObjNative>(callee);
+                if (arg_count != native->arity) {
+                    runtime_error_(std::format("Expected {} arguments but got {}.", native->arity, arg_count));
+                }
+
+                Value result = native->function(arg_count, stack_top_ - arg_count);
+                stack_top_ -= arg_count + 1;
+                push_(result);
+                return;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    runtime_error_(std::format("This is not a callable object at line: {}", current_line_()));
+}
+
+void VM::call_(ObjClosure* closure, int arg_count) {
+    if (arg_count != closure->function->arity) {
+        runtime_error_(std::format("Expected {} arguments but got {}.", closure->function->arity, arg_count));
+    }
+
+    // The script's own frame does not count towards the depth.
+    if (static_cast<size_t>(frame_count_) > max_stack_depth_) {
+        runtime_error_("Stack overflow.");
+    }
+
+    // Make sure the value stack has room for all the slots the frame can use.
+    int room = closure->function->slot_count + frame_slots_;
+    if (frame_count_ == static_cast<int>(frames_.size()) ||
+        (stack_top_ - stack_.data()) + room > static_cast<ptrdiff_t>(stack_.size())) {
+        grow_stack_(room);
+    }
+
+    CallFrame& frame = frames_[frame_count_++];
+    frame.closure = closure;
+    frame.ip = closure->function->chunk.code.data();
+    frame.slots = stack_top_ - arg_count - 1;
+    
+    if (heap_.should_collect()) {
+        collect_garbage_();
+    }
+}
+
+void VM::tail_call_(Value callee, int arg_count) {
+    ObjClosure* closure = nullptr;
+    if (is_obj_type(callee, ObjType::Closure)) {
+        closure = as_obj<ObjClosure>(callee);
+    } else if (is_obj_type(callee, ObjType::BoundMethod)) {
+        auto bound = as_obj<ObjBoundMethod>(callee);
+        stack_top_[-arg_count - 1] = bound->receiver;
+        closure = bound->method;
+    } else {
+        call_value_(callee, arg_count);
+        return;
+    }
+
+    if (arg_count != closure->function->arity) {
+        runtime_error_(std::format("Expected {} arguments but got {}.", closure->function->arity, arg_count));
+    }
+
+    //
+    // The callee and its arguments move down over the caller's, and the caller's frame starts over as the callee's.
+    // The callee may have more locals than the caller had room for.
+    //
+    CallFrame& frame = frames_[frame_count_ - 1];
+    close_upvalues_(frame.slots);
+    std::copy(stack_top_ - arg_count - 1, stack_top_, frame.slots);
+    stack_top_ = frame.slots + arg_count + 1;
+    frame.closure = closure;
+    frame.ip = closure->function->chunk.code.data();
+
+    int room = closure->function->slot_count + frame_slots_;
+    if ((stack_top_ - stack_.data()) + room > static_cast<ptrdiff_t>(stack_.size())) {
+        grow_stack_(room);
+    }
+
+    if (heap_.should_collect()) {
+        collect_garbage_();
+    }
+}
+
+void VM::grow_stack_(int room) {
+    if (frame_count_ == static_cast<int>(frames_.size())) {
+        frames_.resize(frames_.size() * 2);
+    }
+
+    auto needed = static_cast<size_t>(stack_top_ - stack_.data()) + room;
+    if (needed <= stack_.size()) {
+        return;
+    }
+
+    //
+    // Frames and open upvalues point into the stack, they move along with it.  The caller's frame pointer is
+    // reloaded after every call anyway.
+    //
+    auto size = stack_.size() * 2;
+    while (size < needed) {
+        size *= 2;
+    }
+
+    std::vector<Value> stack(size);
+    std::copy(stack_.data(), stack_top_, stack.data());
+    auto rebase = [&](Value* slot) {
+        return stack.data() + (slot - stack_.data());
+    };
+
+    stack_top_ = rebase(stack_top_);
+    for(int i = 0; i < frame_count_; ++i) {
+        frames_[i].slots = rebase(frames_[i].slots);
+    }
+    for(ObjUpvalue* upvalue = open_upvalues_; upvalue != nullptr; upvalue = upvalue->next_open) {
+        upvalue->location = rebase(upvalue->location);
+    }
+    stack_.swap(stack);
+}
+
+void VM::invoke_(ObjString* name, int arg_count) {
+    const Value& receiver = peek_(arg_count);
+    if (!is_obj_type(receiver, ObjType::Instance)) {
+        runtime_error_("Only object instances have properties.");
+    }
+
+    //
+    // A field can shadow a method, in that case it is a normal call of whatever the field holds.
+    //
+    auto instance = as_obj<ObjInstance>(receiver);
+    auto itr = instance->fields.find(name);
+    if (itr != instance->fields.end()) {
+        stack_top_[-arg_count - 1] = itr->second;
+        call_value_(itr->second, arg_count);
+        return;
+    }
+
+    invoke_from_class_(instance->klass, name, arg_count);
+}
+
+void VM::invoke_from_class_(ObjClass* klass, ObjString* name, int arg_count) {
+    auto itr = klass->methods.find(name);
+    if (itr == klass->methods.end()) {
+        runtime_error_(std::format("Field/method is unknown: {}", name->chars));
+    }
+
+    call_(as_obj<ObjClosure>(itr->second), arg_count);
+}
+
+void VM::bind_method_(ObjClass* klass, ObjString* name) {
+    auto itr = klass->methods.find(name);
+    if (itr == klass->methods.end()) {
+        runtime_error_(std::format("Field/method is unknown: {}", name->chars));
+    }
+
+    auto bound = heap_.allocate<ObjBoundMethod>(peek_(0), as_obj<ObjClosure>(itr->second));
+    pop_();
+    push_(Value::object(bound));
+}
+
+ObjUpvalue* VM::capture_upvalue_(Value* local) {
+    //
+    // Open upvalues are sorted by stack slot, top of the stack first.  Reuse one if the slot is already captured.
+    //
+    ObjUpvalue* prev = nullptr;
+    ObjUpvalue* curr = open_upvalues_;
+    while (curr != nullptr && curr->location > local) {
+        prev = curr;
+        curr = curr->next_open;
+    }
+
+    if (curr != nullptr && curr->location == local) {
+        return curr;
+    }
+
+    auto created = heap_.allocate<ObjUpvalue>(local);
+    created->next_open = curr;
+    if (prev == nullptr) {
+        open_upvalues_ = created;
+    } else {
+        prev->next_open = created;
+    }
+
+    return created;
+}
+
+void VM::close_upvalues_(Value* last) {
+    while (open_upvalues_ != nullptr && open_upvalues_->location >= last) {
+        ObjUpvalue* upvalue = open_upvalues_;
+        upvalue->closed = *(upvalue->location);
+        upvalue->location = &upvalue->closed;
+        open_upvalues_ = upvalue->next_open;
+    }
+}
+
+void VM::define_method_(ObjString* name) {
+    Value method = peek_(0);
+    auto klass = as_obj<ObjClass>(peek_(1));
+    klass->methods[name] = method;
+    pop_();
+}
+
+void VM::define_native_(const std::string& name, int arity, NativeFn function) {
+    globals_[heap_.intern(name)] = Value::object(heap_.allocate<ObjNative>(arity, function));
+}
+
+int VM::current_line_() const {
+    const CallFrame& frame = frames_[frame_count_ - 1];
+    const Chunk& chunk = frame.closure->function->chunk;
+
+    // ip is already past the failing instruction.
+    return chunk.lines[frame.ip - chunk.code.data() - 1];
+}
+
+void VM::runtime_error_(const std::string& message) {
+    // The message is the tree-walker's, word for word, so the engines can be compared on the same scripts.
+    reset_stack_();
+    throw RuntimeError(message);
+}
+
+} // namespace cpplox
@@ -0,0 +1,85 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include "Heap.hpp"
+#include "Object.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cpplox {
+
+/// Runs the AST by compiling it to bytecode first and then executing that on a stack machine.
+class VM {
+private:
+    /// One active function call.  Slots points at the first stack slot the function owns.
+    struct CallFrame {
+        ObjClosure* closure = nullptr;
+        uint8_t*    ip = nullptr;
+        Value*      slots = nullptr;
+    };
+
+    /// A frame gets room for its function's locals plus 256 slots for temporaries.  The stack starts with room for
+    /// 64 frames of 256 slots and doubles when a call needs more, until there are max_stack_depth_ calls.
+    static constexpr int frame_slots_ = 256;
+    static constexpr int initial_frames_ = 64;
+
+    Heap                                    heap_;
+    std::vector<Value>                      stack_;
+    Value*                                  stack_top_ = nullptr;
+    std::vector<CallFrame>                  frames_;
+    int                                     frame_count_ = 0;
+    size_t                                  max_stack_depth_ = default_max_stack_depth;
+    std::unordered_map<ObjString*, Value>   globals_;
+    ObjUpvalue*                             open_upvalues_ = nullptr;
+    ObjString*                              init_string_ = nullptr;
+
+public:
+    /// How deep Lox calls may nest, the same as on the tree-walker.
+    static constexpr size_t default_max_stack_depth = 100'000;
+
+    VM();
+
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    void interpret(std::span<Stmt*> stmts);
+    
+    void set_heap_policy(const HeapPolicy& policy) {
+        heap_.set_policy(policy);
+    }
+
+    /// How deep Lox calls may nest before a call fails with a stack overflow.
+    void set_max_stack_depth(size_t depth) {
+        max_stack_depth_ = depth;
+    }
+
+// Internal Helpers
+private:
+    void run_();
+    void push_(const Value& value);
+    Value pop_();
+    const Value& peek_(int distance);
+    void reset_stack_();
+    void collect_garbage_();
+    void call_value_(const Value& callee, int arg_count);
+    void call_(ObjClosure* closure, int arg_count);
+    void tail_call_(Value callee, int arg_count);
+    void grow_stack_(int room);
+    void invoke_(ObjString* name, int arg_count);
+    void invoke_from_class_(ObjClass* klass, ObjString* name, int arg_count);
+    void bind_method_(ObjClass* klass, ObjString* name);
+    ObjUpvalue* capture_upvalue_(Value* local);
+    void close_upvalues_(Value* last);
+    void define_method_(ObjString* name);
+    void define_native_(const std::string& name, int arity, NativeFn function);
+    int current_line_() const;
+    [[noreturn]] void runtime_error_(const std::string& message);
+};
+
+} // namespace cpplox
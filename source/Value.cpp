@@ -0,0 +1,75 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "Value.hpp"
+
+#include "LoxClass.hpp"
+#include "LoxFunction.hpp"
+#include "LoxInstance.hpp"
+#include "Object.hpp"
+
+#include <format>
+
+namespace cpplox {
+
+static std::string stringify_function_(const ObjFunction* function) {
+    if (function->name == nullptr) {
+        return "<script>";
+    }
+
+    return std::format("<fn {}>", function->name->chars);
+}
+
+std::string stringify(const Value& value) {
+    if (value.is_nil()) {
+        return "nil";
+    }
+
+    if (value.is_bool()) {
+        return value.as_bool() ? "true" : "false";
+    }
+
+    if (value.is_number()) {
+        return std::format("{}", value.as_number());
+    }
+
+    switch (value.as_obj()->type) {
+        case ObjType::String:
+            return as_obj<ObjString>(value)->chars;
+
+        case ObjType::Function:
+            return stringify_function_(as_obj<ObjFunction>(value));
+
+        case ObjType::Native:
+            return "<native fn>";
+
+        case ObjType::Closure:
+            return stringify_function_(as_obj<ObjClosure>(value)->function);
+
+        case ObjType::Upvalue:
+            return "upvalue";
+
+        case ObjType::Class:
+            return as_obj<ObjClass>(value)->name->chars;
+
+        case ObjType::Instance:
+            return as_obj<ObjInstance>(value)->klass->name->chars + " instance";
+
+        case ObjType::BoundMethod:
+            return stringify_function_(as_obj<ObjBoundMethod>(value)->method->function);
+
+        case ObjType::LoxFunction:
+            return std::format("<fn {}>", as_obj<LoxFunction>(value)->name());
+
+        case ObjType::LoxClass:
+            return as_obj<LoxClass>(value)->name;
+
+        case ObjType::LoxInstance:
+            return as_obj<LoxInstance>(value)->lox_class->name + " instance";
+
+        case ObjType::Environment:
+            return "environment";
+    }
+
+    return "Unknown value type";
+}
+
+} // namespace cpplox
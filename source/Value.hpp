@@ -0,0 +1,86 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+
+namespace cpplox {
+
+// Forwards.
+struct Obj;
+
+/// A Lox value packed into 64 bits using NaN-boxing.
+///
+/// Numbers are stored as plain doubles.  Every other value hides in the payload of a quiet NaN, which real
+/// arithmetic never produces: nil, true and false are small tags in the low bits, and objects set the sign bit
+/// and keep their pointer in the low 48 bits.
+struct Value {
+private:
+    static constexpr uint64_t sign_bit_ = 0x8000000000000000;
+    static constexpr uint64_t quiet_nan_ = 0x7ffc000000000000;
+
+    static constexpr uint64_t tag_nil_ = 1;
+    static constexpr uint64_t tag_false_ = 2;
+    static constexpr uint64_t tag_true_ = 3;
+
+    static constexpr uint64_t nil_bits_ = quiet_nan_ | tag_nil_;
+    static constexpr uint64_t false_bits_ = quiet_nan_ | tag_false_;
+    static constexpr uint64_t true_bits_ = quiet_nan_ | tag_true_;
+    static constexpr uint64_t obj_bits_ = sign_bit_ | quiet_nan_;
+
+    uint64_t bits_ = nil_bits_;
+
+    constexpr explicit Value(uint64_t bits): bits_{bits} {
+    }
+
+public:
+    constexpr Value() {
+    }
+
+    static constexpr Value nil() {
+        return Value{nil_bits_};
+    }
+
+    static constexpr Value boolean(bool value) {
+        return Value{value ? true_bits_ : false_bits_};
+    }
+
+    static constexpr Value number(double value) {
+        return Value{std::bit_cast<uint64_t>(value)};
+    }
+
+    static Value object(Obj* value) {
+        return Value{obj_bits_ | static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value))};
+    }
+
+    constexpr bool is_nil() const { return bits_ == nil_bits_; }
+    constexpr bool is_bool() const { return (bits_ | 1) == true_bits_; }
+    constexpr bool is_number() const { return (bits_ & quiet_nan_) != quiet_nan_; }
+    constexpr bool is_obj() const { return (bits_ & obj_bits_) == obj_bits_; }
+
+    constexpr bool as_bool() const { return bits_ == true_bits_; }
+    constexpr double as_number() const { return std::bit_cast<double>(bits_); }
+    Obj* as_obj() const { return reinterpret_cast<Obj*>(static_cast<uintptr_t>(bits_ & ~obj_bits_)); }
+
+    /// Lox semantics, only nil and false are falsey.
+    constexpr bool is_falsey() const {
+        return bits_ == nil_bits_ || bits_ == false_bits_;
+    }
+
+    /// Numbers compare as doubles so NaN is not equal to itself, everything else is the same value when the bits match.
+    friend constexpr bool operator==(const Value& a, const Value& b) {
+        if (a.is_number() && b.is_number()) {
+            return a.as_number() == b.as_number();
+        }
+
+        return a.bits_ == b.bits_;
+    }
+};
+
+static_assert(sizeof(Value) == sizeof(uint64_t), "Value must stay NaN-boxed into 64 bits.");
+
+/// Converts the value into the text that print shows.
+std::string stringify(const Value& value);
+
+} // namespace cpplox
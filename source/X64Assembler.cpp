@@ -0,0 +1,242 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#include "X64Assembler.hpp"
+
+namespace cpplox {
+
+static uint8_t low_(Reg reg) {
+    return static_cast<uint8_t>(reg) & 7;
+}
+
+static uint8_t extension_(Reg reg) {
+    return static_cast<uint8_t>(reg) >> 3;
+}
+
+static uint8_t low_(Xmm reg) {
+    return static_cast<uint8_t>(reg);
+}
+
+void X64Assembler::mov(Reg dst, uint64_t imm) {
+    // Writing the 32 bit register clears the upper half, which saves four bytes of immediate.
+    if (imm <= 0xffffffff) {
+        if (extension_(dst)) {
+            emit_(0x41);
+        }
+        emit_(0xb8 + low_(dst));
+        emit32_(static_cast<uint32_t>(imm));
+    } else {
+        emit_(0x48 | extension_(dst));
+        emit_(0xb8 + low_(dst));
+        emit64_(imm);
+    }
+}
+
+void X64Assembler::mov(Reg dst, Reg src) {
+    register_op_(0x89, src, dst);
+}
+
+void X64Assembler::load(Reg dst, Reg base, int32_t disp) {
+    rex_w_(dst, base);
+    emit_(0x8b);
+    memory_operand_(dst, base, disp);
+}
+
+void X64Assembler::store(Reg base, int32_t disp, Reg src) {
+    rex_w_(src, base);
+    emit_(0x89);
+    memory_operand_(src, base, disp);
+}
+
+void X64Assembler::lea(Reg dst, Reg base, int32_t disp) {
+    rex_w_(dst, base);
+    emit_(0x8d);
+    memory_operand_(dst, base, disp);
+}
+
+void X64Assembler::add(Reg dst, Reg src) {
+    register_op_(0x01, src, dst);
+}
+
+void X64Assembler::and_(Reg dst, Reg src) {
+    register_op_(0x21, src, dst);
+}
+
+void X64Assembler::xor_(Reg dst, Reg src) {
+    register_op_(0x31, src, dst);
+}
+
+void X64Assembler::cmp(Reg lhs, Reg rhs) {
+    register_op_(0x39, rhs, lhs);
+}
+
+void X64Assembler::test(Reg lhs, Reg rhs) {
+    register_op_(0x85, rhs, lhs);
+}
+
+void X64Assembler::and8(Reg dst, Reg src) {
+    emit_(0x20);
+    emit_(0xc0 | (low_(src) << 3) | low_(dst));
+}
+
+void X64Assembler::or8(Reg dst, Reg src) {
+    emit_(0x08);
+    emit_(0xc0 | (low_(src) << 3) | low_(dst));
+}
+
+void X64Assembler::setcc(Condition condition, Reg dst) {
+    emit_(0x0f);
+    emit_(0x90 | static_cast<uint8_t>(condition));
+    emit_(0xc0 | low_(dst));
+}
+
+void X64Assembler::movzx8(Reg dst, Reg src) {
+    emit_(0x0f);
+    emit_(0xb6);
+    emit_(0xc0 | (low_(dst) << 3) | low_(src));
+}
+
+void X64Assembler::movq(Xmm dst, Reg src) {
+    emit_(0x66);
+    emit_(0x48 | extension_(src));
+    emit_(0x0f);
+    emit_(0x6e);
+    emit_(0xc0 | (low_(dst) << 3) | low_(src));
+}
+
+void X64Assembler::movq(Reg dst, Xmm src) {
+    emit_(0x66);
+    emit_(0x48 | extension_(dst));
+    emit_(0x0f);
+    emit_(0x7e);
+    emit_(0xc0 | (low_(src) << 3) | low_(dst));
+}
+
+void X64Assembler::addsd(Xmm dst, Xmm src) {
+    sse_(0xf2, 0x58, dst, src);
+}
+
+void X64Assembler::subsd(Xmm dst, Xmm src) {
+    sse_(0xf2, 0x5c, dst, src);
+}
+
+void X64Assembler::mulsd(Xmm dst, Xmm src) {
+    sse_(0xf2, 0x59, dst, src);
+}
+
+void X64Assembler::divsd(Xmm dst, Xmm src) {
+    sse_(0xf2, 0x5e, dst, src);
+}
+
+void X64Assembler::ucomisd(Xmm lhs, Xmm rhs) {
+    sse_(0x66, 0x2e, lhs, rhs);
+}
+
+void X64Assembler::push(Reg reg) {
+    if (extension_(reg)) {
+        emit_(0x41);
+    }
+    emit_(0x50 + low_(reg));
+}
+
+void X64Assembler::pop(Reg reg) {
+    if (extension_(reg)) {
+        emit_(0x41);
+    }
+    emit_(0x58 + low_(reg));
+}
+
+void X64Assembler::ret() {
+    emit_(0xc3);
+}
+
+void X64Assembler::call(const void* target) {
+    mov(Reg::r11, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(target)));
+
+    // call r11
+    emit_(0x41);
+    emit_(0xff);
+    emit_(0xd3);
+}
+
+void X64Assembler::jmp(Label& label) {
+    emit_(0xe9);
+    jump_to_(label);
+}
+
+void X64Assembler::jcc(Condition condition, Label& label) {
+    emit_(0x0f);
+    emit_(0x80 | static_cast<uint8_t>(condition));
+    jump_to_(label);
+}
+
+void X64Assembler::bind(Label& label) {
+    label.position = code_.size();
+    for(auto use: label.uses) {
+        auto rel = static_cast<uint32_t>(label.position - (use + 4));
+        for(int i = 0; i < 4; ++i) {
+            code_[use + i] = static_cast<uint8_t>(rel >> (8 * i));
+        }
+    }
+    label.uses.clear();
+}
+
+void X64Assembler::emit32_(uint32_t value) {
+    for(int i = 0; i < 4; ++i) {
+        emit_(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void X64Assembler::emit64_(uint64_t value) {
+    emit32_(static_cast<uint32_t>(value));
+    emit32_(static_cast<uint32_t>(value >> 32));
+}
+
+void X64Assembler::rex_w_(Reg reg, Reg rm) {
+    emit_(0x48 | (extension_(reg) << 2) | extension_(rm));
+}
+
+void X64Assembler::register_op_(uint8_t opcode, Reg reg, Reg rm) {
+    rex_w_(reg, rm);
+    emit_(opcode);
+    emit_(0xc0 | (low_(reg) << 3) | low_(rm));
+}
+
+void X64Assembler::memory_operand_(Reg reg, Reg base, int32_t disp) {
+    //
+    // rbp and r13 as a base have no form without a displacement, and rsp and r12 need a SIB byte.
+    //
+    uint8_t mod = 0x80;
+    if (disp == 0 && low_(base) != 5) {
+        mod = 0x00;
+    } else if (disp >= -128 && disp <= 127) {
+        mod = 0x40;
+    }
+
+    emit_(mod | (low_(reg) << 3) | low_(base));
+    if (low_(base) == 4) {
+        emit_(0x24);
+    }
+
+    if (mod == 0x40) {
+        emit_(static_cast<uint8_t>(disp));
+    } else if (mod == 0x80) {
+        emit32_(static_cast<uint32_t>(disp));
+    }
+}
+
+void X64Assembler::sse_(uint8_t prefix, uint8_t opcode, Xmm dst, Xmm src) {
+    emit_(prefix);
+    emit_(0x0f);
+    emit_(opcode);
+    emit_(0xc0 | (low_(dst) << 3) | low_(src));
+}
+
+void X64Assembler::jump_to_(Label& label) {
+    if (label.position != Label::unbound) {
+        emit32_(static_cast<uint32_t>(label.position - (code_.size() + 4)));
+    } else {
+        label.uses.push_back(code_.size());
+        emit32_(0);
+    }
+}
+
+} // namespace cpplox
@@ -0,0 +1,116 @@
+// Copyright 2025, Yasser Zabuair.  See LICENSE for details.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cpplox {
+
+/// The general purpose registers, numbered the way the instruction encoding numbers them.
+enum class Reg: uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15
+};
+
+/// The SSE registers the JIT does its arithmetic in.
+enum class Xmm: uint8_t {
+    xmm0, xmm1
+};
+
+/// Condition codes, as they appear in the low nibble of jcc and setcc.
+enum class Condition: uint8_t {
+    Below = 0x2,
+    AboveEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    BelowEqual = 0x6,
+    Above = 0x7,
+    Parity = 0xa,
+    NotParity = 0xb
+};
+
+/// A place in the code that jumps can go to, before or after it is bound.
+struct Label {
+    static constexpr size_t unbound = static_cast<size_t>(-1);
+
+    size_t position = unbound;
+
+    /// Where the rel32 of each jump to the label is, they are patched when the label is bound.
+    std::vector<size_t> uses;
+};
+
+/// Encodes the handful of x86-64 instructions the JIT needs into a byte buffer.  Operands are 64 bits wide unless
+/// the name says otherwise, memory operands are always a base register plus a displacement.
+class X64Assembler {
+private:
+    std::vector<uint8_t> code_;
+
+public:
+    const std::vector<uint8_t>& code() const {
+        return code_;
+    }
+
+    /// mov dst, imm, using the short form when the value fits in 32 bits.
+    void mov(Reg dst, uint64_t imm);
+    void mov(Reg dst, Reg src);
+    void load(Reg dst, Reg base, int32_t disp);
+    void store(Reg base, int32_t disp, Reg src);
+    void lea(Reg dst, Reg base, int32_t disp);
+
+    void add(Reg dst, Reg src);
+    void and_(Reg dst, Reg src);
+    void xor_(Reg dst, Reg src);
+    void cmp(Reg lhs, Reg rhs);
+    void test(Reg lhs, Reg rhs);
+
+    /// The 8 bit forms, on the low byte of rax, rcx, rdx or rbx.
+    void and8(Reg dst, Reg src);
+    void or8(Reg dst, Reg src);
+    void setcc(Condition condition, Reg dst);
+
+    /// movzx dst32, src8.
+    void movzx8(Reg dst, Reg src);
+
+    void movq(Xmm dst, Reg src);
+    void movq(Reg dst, Xmm src);
+    void addsd(Xmm dst, Xmm src);
+    void subsd(Xmm dst, Xmm src);
+    void mulsd(Xmm dst, Xmm src);
+    void divsd(Xmm dst, Xmm src);
+    void ucomisd(Xmm lhs, Xmm rhs);
+
+    void push(Reg reg);
+    void pop(Reg reg);
+    void ret();
+
+    /// Calls a function anywhere in the address space, through r11.
+    void call(const void* target);
+
+    void jmp(Label& label);
+    void jcc(Condition condition, Label& label);
+    void bind(Label& label);
+
+// Internal Helpers
+private:
+    void emit_(uint8_t byte) {
+        code_.push_back(byte);
+    }
+
+    void emit32_(uint32_t value);
+    void emit64_(uint64_t value);
+
+    /// A REX prefix with W set, and R and B extending the reg and rm fields.
+    void rex_w_(Reg reg, Reg rm);
+
+    /// Encodes a register to register operation, reg goes in the reg field and rm in the rm field.
+    void register_op_(uint8_t opcode, Reg reg, Reg rm);
+
+    /// Encodes a [base + disp] memory operand, with the smaller displacement when it fits.
+    void memory_operand_(Reg reg, Reg base, int32_t disp);
+
+    void sse_(uint8_t prefix, uint8_t opcode, Xmm dst, Xmm src);
+    void jump_to_(Label& label);
+};
+
+} // namespace cpplox
@@ -2,34 +2,94 @@
 #include "Scanner.hpp"
 
 #include "AstPrinter.hpp"
+#include "CharScan.hpp"
+#include "CppEmitter.hpp"
 #include "Expr.hpp"
 #include "Interpreter.hpp"
 #include "Parser.hpp"
+#include "PassManager.hpp"
+#include "Program.hpp"
 #include "Resolver.hpp"
+#include "SourceBuffer.hpp"
 #include "Stmt.hpp"
 #include "TokenType.hpp"
+#include "VM.hpp"
 
+#include <charconv>
+#include <chrono>
+#include <cstdio>
 #include <exception>
-#include <fstream>
+#include <optional>
 #include <iostream>
 #include <memory>
 #include <print>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
+/// Which engine runs the script, the tree-walking interpreter, the closures compiled from its tree or the bytecode VM.
+enum class Engine {
+    Tree,
+    Closure,
+    VM
+};
+
+Engine engine = Engine::Tree;
+bool print_cache_stats = false;
+bool print_alloc_stats = false;
+bool print_scan_stats = false;
+int optimization_level = 1;
+bool dump_ast = false;
+bool emit_cpp = false;
+uint32_t jit_threshold = cpplox::Jit::default_threshold;
+size_t max_stack_depth = cpplox::Interpreter::default_max_stack_depth;
 cpplox::Interpreter interpreter;
+cpplox::VM vm;
+
+/// What the scanner got through, for --scan-stats.
+struct ScanStats {
+    size_t bytes = 0;
+    size_t tokens = 0;
+    std::chrono::steady_clock::duration time{};
+};
+
+ScanStats scan_stats;
+
+/// Every program run so far.  Functions point into the AST they were declared in, so in the REPL a program has to
+/// stay around for as long as the session does.
+std::vector<std::unique_ptr<cpplox::Program>> programs;
 
-void run(const std::string& source) {
+void run(std::unique_ptr<cpplox::SourceBuffer> source) {
     try {
-        cpplox::Scanner scanner = cpplox::Scanner(source);
+        auto& program = *(programs.emplace_back(std::make_unique<cpplox::Program>()));
+        auto text = program.set_source(std::move(source));
+        auto started = std::chrono::steady_clock::now();
+        cpplox::Scanner scanner = cpplox::Scanner(text);
         auto tokens = scanner.scan_tokens();
-        auto stmts = cpplox::Parser(tokens).parse();
+        scan_stats.time += std::chrono::steady_clock::now() - started;
+        scan_stats.bytes += text.size();
+        scan_stats.tokens += tokens.size();
         
-        auto resolver = cpplox::Resolver{interpreter};
-        resolver.resolve(stmts);
+        auto stmts = cpplox::Parser{std::move(tokens), program}.parse();
         
-        interpreter.interpret(stmts);
+        auto& ast = program.flatten();
+        
+        auto resolver = cpplox::Resolver{};
+        resolver.resolve(ast);
+        
+        if (engine == Engine::VM) {
+            vm.interpret(stmts);
+        } else {
+            // The tree-walker and the closures only need the flat AST.
+            program.discard_tree();
+            
+            auto passes = cpplox::PassManager::create(optimization_level);
+            passes.set_dump_ast(dump_ast);
+            passes.run(program);
+            
+            interpreter.interpret(ast);
+        }
     } catch (const std::exception& exc) {
         std::print("Caught exception: {}\n", exc.what());
     }
@@ -37,17 +97,35 @@ void run(const std::string& source) {
 }
 
 void run_file(const std::string& path) {
-    std::ifstream stream;
-    stream.open(path);
-    
-    std::string script;
-    std::string str;
-    while (std::getline(stream, str)) {
-        // std::getline drops the \n, but we need it.
-        script += str + "\n";
+    run(cpplox::SourceBuffer::open(path));
+}
+
+/// Writes the script as a C++ translation unit to stdout.  Anything wrong with the script goes to stderr, so it
+/// never ends up in the generated file.
+int emit_file(const std::string& path) {
+    try {
+        cpplox::Program program;
+        cpplox::Scanner scanner = cpplox::Scanner(program.set_source(cpplox::SourceBuffer::open(path)));
+        auto tokens = scanner.scan_tokens();
+        
+        cpplox::Parser{std::move(tokens), program}.parse();
+        
+        auto& ast = program.flatten();
+        
+        auto resolver = cpplox::Resolver{};
+        resolver.resolve(ast);
+        
+        program.discard_tree();
+        auto passes = cpplox::PassManager::create(optimization_level);
+        passes.run(program);
+        
+        std::print("{}", cpplox::CppEmitter{}.emit(ast, path));
+    } catch (const std::exception& exc) {
+        std::print(stderr, "Caught exception: {}\n", exc.what());
+        return 65;
     }
     
-    run(script);
+    return 0;
 }
 
 void run_prompt() {
@@ -62,7 +140,7 @@ void run_prompt() {
                 stop = true;
                 break;
             } else if (line == ".run") {
-                run(script);
+                run(cpplox::SourceBuffer::create(std::move(script)));
                 break;
             }
             // std::getline drops the \n, but we need it.
@@ -72,20 +150,172 @@ void run_prompt() {
     }
 }
 
+void usage() {
+    std::print("Usage: cpplox [--engine=tree|closure|vm] [-O0|-O1|-O2] [--dump-ast] [--jit-threshold=<calls>|--no-jit] [--ic-stats] [--alloc-stats] [--no-env-pool] [--scan-stats] [--scan-isa=avx2|sse2|scalar] [--emit-cpp] [--max-stack-depth=<calls>] [--max-heap=<bytes>[K|M|G]] [--heap-growth=<factor>] [script]\n");
+}
+
+/// Parses a size such as 512K or 64M into bytes.
+std::optional<size_t> parse_size(std::string_view text) {
+    size_t multiplier = 1;
+    if (!text.empty()) {
+        switch (text.back()) {
+            case 'K': multiplier = 1024; break;
+            case 'M': multiplier = 1024 * 1024; break;
+            case 'G': multiplier = 1024 * 1024 * 1024; break;
+            default: break;
+        }
+        if (multiplier != 1) {
+            text.remove_suffix(1);
+        }
+    }
+    
+    size_t size = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), size);
+    if (error != std::errc{} || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    
+    return size * multiplier;
+}
+
+/// Reports the inline cache hits and misses on stderr, so it stays out of the script's output.
+void report_cache_stats() {
+    auto report = [](const char* kind, const cpplox::CacheCounters& counters) {
+        auto total = counters.hits + counters.misses;
+        double rate = total ? 100.0 * static_cast<double>(counters.hits) / static_cast<double>(total) : 0.0;
+        std::print(stderr, "{:<8}{:>14} hits{:>10} misses{:>8.2f}%\n", kind, counters.hits, counters.misses, rate);
+    };
+    
+    auto& stats = interpreter.cache_stats();
+    std::print(stderr, "*** Inline caches\n");
+    report("get", stats.get);
+    report("set", stats.set);
+    report("invoke", stats.invoke);
+}
+
+/// Reports how many environments were made, how many of them reused a freed block and how many times they went to
+/// the global allocator, a chunk or an environment of their own, on stderr.
+void report_alloc_stats() {
+    auto& stats = cpplox::Environment::pool().stats();
+    std::print(stderr, "*** Environments\n");
+    std::print(stderr, "{:<8}{:>14}\n", "made", stats.environments);
+    std::print(stderr, "{:<8}{:>14}\n", "reused", stats.reused);
+    std::print(stderr, "{:<8}{:>14}\n", "chunks", stats.chunks);
+    std::print(stderr, "{:<8}{:>14}\n", "unpooled", stats.unpooled);
+    std::print(stderr, "{:<8}{:>14}\n", "mallocs", stats.chunks + stats.unpooled);
+}
+
+/// Reports how fast the scanner went through the scripts, on stderr.
+void report_scan_stats() {
+    auto seconds = std::chrono::duration<double>(scan_stats.time).count();
+    double rate = seconds > 0 ? static_cast<double>(scan_stats.bytes) / seconds / 1e6 : 0.0;
+    std::print(stderr, "*** Scanner ({})\n", cpplox::CharScan::isa());
+    std::print(stderr, "{:<8}{:>14}\n", "bytes", scan_stats.bytes);
+    std::print(stderr, "{:<8}{:>14}\n", "tokens", scan_stats.tokens);
+    std::print(stderr, "{:<8}{:>14.3f}\n", "ms", seconds * 1000);
+    std::print(stderr, "{:<8}{:>14.1f}\n", "MB/s", rate);
+}
+
 int main(int argc, const char * argv[]) {
     try {
-        if (argc > 2) {
-            std::print("Usage: cpplox [script]\n");
+        std::vector<std::string> scripts;
+        cpplox::HeapPolicy heap_policy;
+        for(int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            if (arg == "--engine=tree") {
+                engine = Engine::Tree;
+            } else if (arg == "--engine=closure") {
+                engine = Engine::Closure;
+            } else if (arg == "--engine=vm") {
+                engine = Engine::VM;
+            } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+                optimization_level = arg[2] - '0';
+            } else if (arg == "--dump-ast") {
+                dump_ast = true;
+            } else if (arg.starts_with("--jit-threshold=")) {
+                auto calls = arg.substr(arg.find('=') + 1);
+                auto [end, error] = std::from_chars(calls.data(), calls.data() + calls.size(), jit_threshold);
+                if (error != std::errc{} || end != calls.data() + calls.size()) {
+                    usage();
+                    return 64;
+                }
+            } else if (arg == "--no-jit") {
+                jit_threshold = 0;
+            } else if (arg == "--emit-cpp") {
+                emit_cpp = true;
+            } else if (arg == "--ic-stats") {
+                print_cache_stats = true;
+            } else if (arg == "--alloc-stats") {
+                print_alloc_stats = true;
+            } else if (arg == "--no-env-pool") {
+                cpplox::Environment::pool().disable();
+            } else if (arg == "--scan-stats") {
+                print_scan_stats = true;
+            } else if (arg.starts_with("--scan-isa=")) {
+                if (!cpplox::CharScan::use(arg.substr(arg.find('=') + 1))) {
+                    usage();
+                    return 64;
+                }
+            } else if (arg.starts_with("--max-stack-depth=")) {
+                auto depth = arg.substr(arg.find('=') + 1);
+                auto [end, error] = std::from_chars(depth.data(), depth.data() + depth.size(), max_stack_depth);
+                if (error != std::errc{} || end != depth.data() + depth.size() || max_stack_depth == 0) {
+                    usage();
+                    return 64;
+                }
+            } else if (arg.starts_with("--max-heap=")) {
+                auto size = parse_size(arg.substr(arg.find('=') + 1));
+                if (!size) {
+                    usage();
+                    return 64;
+                }
+                heap_policy.max_heap = *size;
+            } else if (arg.starts_with("--heap-growth=")) {
+                auto factor = arg.substr(arg.find('=') + 1);
+                auto [end, error] = std::from_chars(factor.data(), factor.data() + factor.size(), heap_policy.growth_factor);
+                if (error != std::errc{} || end != factor.data() + factor.size() || heap_policy.growth_factor < 1.0) {
+                    usage();
+                    return 64;
+                }
+            } else if (arg.starts_with("--")) {
+                usage();
+                return 64;
+            } else {
+                scripts.emplace_back(arg);
+            }
+        }
+        
+        interpreter.set_heap_policy(heap_policy);
+        interpreter.set_jit_threshold(jit_threshold);
+        interpreter.set_compile_closures(engine == Engine::Closure);
+        interpreter.set_max_stack_depth(max_stack_depth);
+        vm.set_heap_policy(heap_policy);
+        vm.set_max_stack_depth(max_stack_depth);
+        
+        if (scripts.size() > 1 || (emit_cpp && scripts.empty())) {
+            usage();
             return 64;
-        } else if (argc == 2) {
-            std::print("*** Running file: {}\n", argv[1]);
-            run_file(argv[1]);
+        } else if (emit_cpp) {
+            return emit_file(scripts[0]);
+        } else if (scripts.size() == 1) {
+            std::print("*** Running file: {}\n", scripts[0]);
+            run_file(scripts[0]);
         } else {
             std::print("*** Running REPL\n");
             std::print(".run to run the script.\n");
             std::print(".quit to exit REPL.\n");
             run_prompt();
         }
+        
+        if (print_cache_stats && engine != Engine::VM) {
+            report_cache_stats();
+        }
+        if (print_alloc_stats && engine != Engine::VM) {
+            report_alloc_stats();
+        }
+        if (print_scan_stats) {
+            report_scan_stats();
+        }
     } catch (const std::exception& exc) {
         std::print("Caught exception: {}\n", exc.what());
         return 64;
@@ -93,6 +323,3 @@ int main(int argc, const char * argv[]) {
     
     return 0;
 }
-
-
-
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Runs each benchmark with the environment pool and again without it, --no-env-pool, and prints how many
+# environments it made, how many times they went to the global allocator, from --alloc-stats, and how long the run
+# took.  Without the pool every environment is a malloc and a free of its own.  zoo_batch runs for ten seconds
+# either way, so compare how many environments it got through.
+#
+#   test/benchmark/alloc.sh <cpplox> [--engine=closure]
+#
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <cpplox> [flags]..." >&2
+    exit 64
+fi
+
+cpplox=$1
+shift
+
+# Prints the environments made, the mallocs and the seconds of one run.
+measure() {
+    start=$(date +%s.%N)
+    stats=$("$cpplox" "$@" --alloc-stats 2>&1 >/dev/null)
+    end=$(date +%s.%N)
+    echo "$stats" | awk -v start="$start" -v end="$end" '
+        $1 == "made" { made = $2 }
+        $1 == "mallocs" { mallocs = $2 }
+        END { printf "%s %s %.2f", made, mallocs, end - start }'
+}
+
+printf "%-18s%12s%12s%9s%12s%9s\n" "" "made" "pool" "" "no pool" ""
+for script in "$(dirname "$0")"/*.lox; do
+    echo "$(basename "$script" .lox) $(measure "$@" "$script") $(measure "$@" --no-env-pool "$script")" |
+        awk '{ printf "%-18s%12s%12s%8ss%12s%8ss\n", $1, $2, $3, $4, $6, $7 }'
+done
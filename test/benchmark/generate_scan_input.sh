@@ -0,0 +1,30 @@
+#!/bin/sh
+#
+# Writes a large Lox script to stdout for scan.sh, shaped like our generated batch scripts: mostly comments and
+# string literals, with indentation, around short functions.  The script runs, it only declares functions.
+#
+#   test/benchmark/generate_scan_input.sh [megabytes] > input.lox
+#
+megabytes=${1:-25}
+
+# Each function below comes to a little under 800 bytes.
+awk -v count=$((megabytes * 1024 * 1024 / 790)) 'BEGIN {
+    for (i = 0; i < count; i++) {
+        print "// ----------------------------------------------------------------------------------------------"
+        print "// Step " i " of the batch.  Reads the record, checks the fields it needs and hands back the total,"
+        print "// or nil when the record is missing something.  Generated, do not edit."
+        print "/*"
+        print " * Inputs:   record, an instance with amount, count and label fields."
+        print " * Outputs:  the amount times the count, as a number."
+        print " */"
+        print "fun step_" i "(record, scale) {"
+        print "    var label = \"batch step " i ", a label long enough to be worth skipping in bulk\";"
+        print "    var note = \"records without an amount are skipped, see the batch documentation\";"
+        print "    if (record == nil) return nil;      // nothing to do"
+        print "    var total = record.amount * record.count * scale;"
+        print "    return total;                        // handed back to the driver"
+        print "}"
+        print ""
+    }
+    print "print \"done\";"
+}'
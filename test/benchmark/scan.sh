@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# The front-end benchmark: how many MB/s the scanner gets through a large, comment-heavy script with each version
+# of its searches.  scalar is the plain loops, the closest there is to the scanner from before the vector ones.
+# The best of three runs is reported, a version the CPU can not run is left out.
+#
+#   test/benchmark/scan.sh <cpplox> [megabytes]
+#
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 <cpplox> [megabytes]" >&2
+    exit 64
+fi
+
+cpplox=$1
+megabytes=${2:-25}
+input=$(mktemp "${TMPDIR:-/tmp}/scan.XXXXXX")
+trap 'rm -f "$input"' EXIT
+
+"$(dirname "$0")/generate_scan_input.sh" "$megabytes" > "$input"
+echo "$(wc -c < "$input") bytes of comment-heavy script"
+
+for isa in scalar sse2 avx2; do
+    best=""
+    for run in 1 2 3; do
+        rate=$("$cpplox" --scan-stats --scan-isa=$isa "$input" 2>&1 >/dev/null | awk '$1 == "MB/s" { print $2 }')
+        if [ -z "$rate" ]; then
+            break
+        fi
+        best=$(echo "$best $rate" | awk '{ print ($1 == "" || $2 > $1) ? $2 : $1 }')
+    done
+
+    if [ -n "$best" ]; then
+        printf "%-8s%10s MB/s\n" "$isa" "$best"
+    else
+        printf "%-8s%10s\n" "$isa" "not supported"
+    fi
+done
@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+#
+# Runs every script under test/ on the tree-walker, then again with the given flags, and lists the scripts whose
+# output differs.  The tree-walker is the reference, the other engines and modes have to match it file for file,
+# runtime and compile errors included.
+#
+#   test/compare.sh <cpplox> --engine=vm
+#   test/compare.sh <cpplox> --emit-cpp
+#
+# With --emit-cpp each script is written out as C++, built with $CXX and $CXXFLAGS, and the program it makes is
+# run instead.  Where an error was thrown from, the "In file:" line, is left out of the comparison, as is which
+# kind of error it was, since the generated program only has the one.
+#
+set -u
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <cpplox> <flags>..." >&2
+    exit 64
+fi
+
+cpplox=$1
+shift
+flags=("$@")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+emit_cpp=0
+for flag in "${flags[@]}"; do
+    if [ "$flag" = "--emit-cpp" ]; then
+        emit_cpp=1
+    fi
+done
+
+normalize() {
+    sed -e '/^\*\*\* Running file: /d' \
+        -e '/^In file: /d' \
+        -e 's/^Caught exception: [A-Za-z]*Error: /Caught exception: /' \
+        -e '/^$/d'
+}
+
+# Writes what the script printed, run with the flags, to out.
+run() {
+    local script=$1 out=$2
+    if [ $emit_cpp -eq 0 ]; then
+        "$cpplox" "${flags[@]}" "$script" 2>&1 | normalize > "$out"
+        return
+    fi
+
+    # A script the emitter rejects prints the error instead, the same way the interpreter does.
+    local program=$out.bin
+    if ! "$cpplox" "${flags[@]}" "$script" > "$program.cpp" 2> "$out.err"; then
+        normalize < "$out.err" > "$out"
+        return
+    fi
+    if ! ${CXX:-c++} -std=c++23 ${CXXFLAGS:-} -w "$program.cpp" -o "$program" 2> "$out.err"; then
+        echo "Could not build the generated C++:" > "$out"
+        head -n 20 "$out.err" >> "$out"
+        return
+    fi
+    "$program" 2>&1 | normalize > "$out"
+}
+
+compare() {
+    local script=$1 name=${1#"$tests"/}
+    local out=$work/${name//\//_}
+    "$cpplox" "$script" 2>&1 | normalize > "$out.expected"
+    run "$script" "$out.actual"
+    if ! cmp -s "$out.expected" "$out.actual"; then
+        echo "DIFF $name"
+        diff "$out.expected" "$out.actual" | head -n 10
+    fi
+}
+
+# The benchmarks take too long to run twice on every engine.
+scripts=$(find "$tests" -name '*.lox' -not -path '*/benchmark/*' | sort)
+count=0
+for script in $scripts; do
+    compare "$script" > "$work/$count.result" &
+    count=$((count + 1))
+    if [ $((count % $(nproc))) -eq 0 ]; then
+        wait
+    fi
+done
+wait
+
+differ=$(cat "$work"/*.result | grep -c '^DIFF ')
+cat "$work"/*.result
+echo "$((count - differ)) of $count scripts match the tree-walker with ${flags[*]}"
+[ "$differ" -eq 0 ]